@@ -14,6 +14,12 @@ sealed class HapPlayerEditor : Editor
         SerializedProperty _speed;
         SerializedProperty _loop;
 
+        SerializedProperty _preloadMode;
+        SerializedProperty _preloadWindowSize;
+
+        SerializedProperty _resolution;
+        SerializedProperty _mipmaps;
+
         SerializedProperty _targetTexture;
         SerializedProperty _targetRenderer;
         SerializedProperty _targetMaterialProperty;
@@ -22,6 +28,7 @@ static class Labels
         {
             public static readonly GUIContent Property = new GUIContent("Property");
             public static readonly GUIContent Select = new GUIContent("Select");
+            public static readonly GUIContent WindowSize = new GUIContent("Window Size (MB)");
         }
 
         string _sourceInfo;
@@ -64,6 +71,12 @@ void OnEnable()
             _speed = serializedObject.FindProperty("_speed");
             _loop = serializedObject.FindProperty("_loop");
 
+            _preloadMode = serializedObject.FindProperty("_preloadMode");
+            _preloadWindowSize = serializedObject.FindProperty("_preloadWindowSize");
+
+            _resolution = serializedObject.FindProperty("_resolution");
+            _mipmaps = serializedObject.FindProperty("_mipmaps");
+
             _targetTexture = serializedObject.FindProperty("_targetTexture");
             _targetRenderer = serializedObject.FindProperty("_targetRenderer");
             _targetMaterialProperty = serializedObject.FindProperty("_targetMaterialProperty");
@@ -94,6 +107,24 @@ public override void OnInspectorGUI()
             EditorGUILayout.PropertyField(_speed);
             EditorGUILayout.PropertyField(_loop);
 
+            // Preload mode
+            EditorGUI.BeginChangeCheck();
+            EditorGUILayout.PropertyField(_preloadMode);
+            if (_preloadMode.hasMultipleDifferentValues ||
+                _preloadMode.enumValueIndex == (int)HapPlayer.PreloadMode.Window)
+            {
+                EditorGUI.indentLevel++;
+                EditorGUILayout.PropertyField(_preloadWindowSize, Labels.WindowSize);
+                EditorGUI.indentLevel--;
+            }
+            reload |= EditorGUI.EndChangeCheck();
+
+            // Proxy resolution/mipmaps
+            EditorGUI.BeginChangeCheck();
+            EditorGUILayout.PropertyField(_resolution);
+            EditorGUILayout.PropertyField(_mipmaps);
+            reload |= EditorGUI.EndChangeCheck();
+
             // Target texture/renderer
             EditorGUILayout.PropertyField(_targetTexture);
             EditorGUILayout.PropertyField(_targetRenderer);
@@ -0,0 +1,226 @@
+using System;
+using System.Runtime.InteropServices;
+using UnityEngine;
+using UnityEngine.Rendering;
+
+namespace Klak.Hap
+{
+    // Plays many small clips of the same codec in the tiles of a single
+    // texture. The clips are preloaded into memory and decoded straight into
+    // their tiles, so they don't need their own players, textures or texture
+    // updates. The texture is only uploaded when one of the tiles was
+    // changed. Hap Q atlases need the YCoCg conversion (see the "Klak/HAP Q"
+    // shader) when they're drawn.
+    public sealed class HapAtlas : IDisposable
+    {
+        #region Public properties
+
+        public Texture2D texture => _texture;
+        public int slotCount => _columns * _rows;
+
+        #endregion
+
+        #region Constructor/destructor
+
+        public HapAtlas(int tileWidth, int tileHeight, int columns, int rows, CodecType codec)
+        {
+            var videoType = codec == CodecType.HapQ ? 0xf :
+                            codec == CodecType.HapAlpha ? 0xe :
+                            codec == CodecType.HapR ? 0xc :
+                            codec == CodecType.HapHDR ? 0x2 : 0xb;
+
+            _plugin = KlakHap_CreateAtlas(tileWidth, tileHeight, columns, rows, videoType);
+            (_columns, _rows) = (columns, rows);
+
+            _texture = new Texture2D(
+                KlakHap_GetAtlasWidth(_plugin), KlakHap_GetAtlasHeight(_plugin),
+                Utility.DetermineTextureFormat(videoType), false
+            );
+            _texture.wrapMode = TextureWrapMode.Clamp;
+            _texture.hideFlags = HideFlags.DontSave;
+
+            _times = new float[columns * rows];
+            _speeds = new float[columns * rows];
+
+            // Atlas IDs are kept apart from the decoder IDs.
+            _id = 0x80000000u | ++_instantiationCount;
+            KlakHap_AssignAtlas(_id, _plugin);
+
+            if (TextureUpdater.AsyncSupport)
+            {
+                _command = new CommandBuffer();
+                _command.name = "Klak HAP Atlas";
+                _command.IssuePluginCustomTextureUpdateV2(
+                    TextureUpdater.KlakHap_GetTextureUpdateCallback(),
+                    _texture, _id
+                );
+            }
+        }
+
+        public void Dispose()
+        {
+            if (_plugin == IntPtr.Zero) return;
+
+            _command?.Dispose();
+            _command = null;
+
+            KlakHap_AssignAtlas(_id, IntPtr.Zero);
+            KlakHap_DestroyAtlas(_plugin);
+            _plugin = IntPtr.Zero;
+
+            Utility.Destroy(_texture);
+            _texture = null;
+        }
+
+        #endregion
+
+        #region Slot methods
+
+        // Returns the slot index, or -1 when the clip can't be added (an
+        // invalid file, a different codec, larger than the tile size or no
+        // free slot).
+        public int AddClip(string filePath, HapPlayer.PathMode pathMode = HapPlayer.PathMode.StreamingAssets)
+        {
+            if (pathMode == HapPlayer.PathMode.StreamingAssets)
+                filePath = System.IO.Path.Combine(Application.streamingAssetsPath, filePath);
+            var slot = KlakHap_AddAtlasClip(_plugin, filePath);
+            if (slot >= 0) (_times[slot], _speeds[slot]) = (0, 1);
+            return slot;
+        }
+
+        public void RemoveClip(int slot)
+        {
+            KlakHap_RemoveAtlasClip(_plugin, slot);
+            if (slot >= 0 && slot < slotCount) _speeds[slot] = 0;
+        }
+
+        public double GetDuration(int slot)
+          => KlakHap_GetAtlasClipDuration(_plugin, slot);
+
+        // Playback time in seconds (wrapped around the clip duration)
+        public float GetTime(int slot) => _times[slot];
+        public void SetTime(int slot, float time) => _times[slot] = time;
+
+        // Playback speed. Zero pauses the clip.
+        public float GetSpeed(int slot) => _speeds[slot];
+        public void SetSpeed(int slot, float speed) => _speeds[slot] = speed;
+
+        // UV rectangle of the clip frame in the texture, as a scale/offset
+        // pair (size/position). The frames are stored from the top row, so
+        // the rectangle has a negative height to flip them.
+        public Rect GetUVRect(int slot)
+        {
+            var tw = _texture.width / _columns;
+            var th = _texture.height / _rows;
+            var w = KlakHap_GetAtlasClipWidth(_plugin, slot);
+            var h = KlakHap_GetAtlasClipHeight(_plugin, slot);
+            var x = slot % _columns * tw;
+            var y = slot / _columns * th;
+            return new Rect((float)x / _texture.width, (float)(y + h) / _texture.height,
+                            (float)w / _texture.width, -(float)h / _texture.height);
+        }
+
+        #endregion
+
+        #region Update method
+
+        // Advance the clips by the given time, decode the changed frames and
+        // update the texture. Call it once per frame.
+        public void Update(float deltaTime)
+        {
+            for (var i = 0; i < slotCount; i++)
+            {
+                _times[i] += _speeds[i] * deltaTime;
+                KlakHap_SetAtlasClipTime(_plugin, i, _times[i]);
+            }
+
+            KlakHap_UpdateAtlas(_plugin);
+
+            // Skip the upload when no tile was changed.
+            if (KlakHap_IsAtlasBufferUpdated(_plugin) == 0) return;
+
+            if (_command != null)
+            {
+                Graphics.ExecuteCommandBuffer(_command);
+            }
+            else
+            {
+                _texture.LoadRawTextureData(
+                    KlakHap_LockAtlasBuffer(_plugin),
+                    KlakHap_GetAtlasBufferSize(_plugin)
+                );
+                _texture.Apply(false);
+                KlakHap_UnlockAtlasBuffer(_plugin);
+            }
+        }
+
+        #endregion
+
+        #region Private members
+
+        static uint _instantiationCount;
+
+        IntPtr _plugin;
+        uint _id;
+        int _columns, _rows;
+        Texture2D _texture;
+        CommandBuffer _command;
+        float[] _times;
+        float[] _speeds;
+
+        #endregion
+
+        #region Native plugin entry points
+
+        [DllImport("KlakHap")]
+        static extern IntPtr KlakHap_CreateAtlas
+          (int tileWidth, int tileHeight, int columns, int rows, int typeID);
+
+        [DllImport("KlakHap")]
+        static extern void KlakHap_DestroyAtlas(IntPtr atlas);
+
+        [DllImport("KlakHap")]
+        static extern void KlakHap_AssignAtlas(uint id, IntPtr atlas);
+
+        [DllImport("KlakHap")]
+        static extern int KlakHap_GetAtlasWidth(IntPtr atlas);
+
+        [DllImport("KlakHap")]
+        static extern int KlakHap_GetAtlasHeight(IntPtr atlas);
+
+        [DllImport("KlakHap")]
+        static extern int KlakHap_AddAtlasClip(IntPtr atlas, string filePath);
+
+        [DllImport("KlakHap")]
+        static extern void KlakHap_RemoveAtlasClip(IntPtr atlas, int slot);
+
+        [DllImport("KlakHap")]
+        static extern int KlakHap_GetAtlasClipWidth(IntPtr atlas, int slot);
+
+        [DllImport("KlakHap")]
+        static extern int KlakHap_GetAtlasClipHeight(IntPtr atlas, int slot);
+
+        [DllImport("KlakHap")]
+        static extern double KlakHap_GetAtlasClipDuration(IntPtr atlas, int slot);
+
+        [DllImport("KlakHap")]
+        static extern void KlakHap_SetAtlasClipTime(IntPtr atlas, int slot, float time);
+
+        [DllImport("KlakHap")]
+        static extern void KlakHap_UpdateAtlas(IntPtr atlas);
+
+        [DllImport("KlakHap")]
+        static extern IntPtr KlakHap_LockAtlasBuffer(IntPtr atlas);
+
+        [DllImport("KlakHap")]
+        static extern void KlakHap_UnlockAtlasBuffer(IntPtr atlas);
+
+        [DllImport("KlakHap")]
+        static extern int KlakHap_GetAtlasBufferSize(IntPtr atlas);
+
+        [DllImport("KlakHap")]
+        static extern int KlakHap_IsAtlasBufferUpdated(IntPtr atlas);
+
+        #endregion
+    }
+}
@@ -1,3 +1,5 @@
+using System;
+using System.Runtime.InteropServices;
 using UnityEngine;
 using UnityEngine.Playables;
 
@@ -25,6 +27,16 @@ public enum PathMode { StreamingAssets, LocalFileSystem }
         [SerializeField, Range(-10, 10)] float _speed = 1;
         [SerializeField] bool _loop = true;
 
+        public enum PreloadMode { None, WholeClip, Window }
+
+        [SerializeField] PreloadMode _preloadMode = PreloadMode.None;
+        [SerializeField, Min(1)] int _preloadWindowSize = 512; // in MB
+
+        public enum Resolution { Full, Half, Quarter }
+
+        [SerializeField] Resolution _resolution = Resolution.Full;
+        [SerializeField] bool _mipmaps = false;
+
         [SerializeField] RenderTexture _targetTexture = null;
         [SerializeField] Renderer _targetRenderer = null;
         [SerializeField] string _targetMaterialProperty = "_MainTex";
@@ -48,6 +60,76 @@ public enum PathMode { StreamingAssets, LocalFileSystem }
             set { _loop = value; }
         }
 
+        public PreloadMode preloadMode {
+            get { return _preloadMode; }
+            set { if (_preloadMode != value) { _preloadMode = value; ApplyPreloadMode(); RequeueNextClip(); } }
+        }
+
+        // Only used in the Window mode, where a change reloads the window.
+        public int preloadWindowSize {
+            get { return _preloadWindowSize; }
+            set {
+                if (_preloadWindowSize == value) return;
+                _preloadWindowSize = value;
+                if (_preloadMode != PreloadMode.Window) return;
+                ApplyPreloadMode();
+                RequeueNextClip();
+            }
+        }
+
+        // Proxy resolution for preview monitors and distant screens. The
+        // frames are reduced on the CPU, so the texture upload and the GPU
+        // memory shrink by 4x (Half) or 16x (Quarter).
+        public Resolution resolution {
+            get { return _resolution; }
+            set { if (_resolution != value) { _resolution = value; RecreateDecoder(); } }
+        }
+
+        // Generate a mip chain for each frame on the CPU, for minified
+        // playback (e.g. distant surfaces). The texture is updated on the
+        // main thread in this mode.
+        public bool mipmaps {
+            get { return _mipmaps; }
+            set { if (_mipmaps != value) { _mipmaps = value; RecreateDecoder(); } }
+        }
+
+        // Upper limit of the memory used for reading ahead (in bytes). The
+        // read-ahead depth is adjusted automatically within this limit.
+        public long readAheadLimit {
+            get { return _readAheadLimit; }
+            set { _readAheadLimit = value; _stream?.SetByteCap(value); }
+        }
+
+        // Number of frames kept around the playhead to make scrubbing and
+        // direction changes cheap. Shares the read-ahead memory limit.
+        public int scrubCacheSize {
+            get { return _scrubCacheSize; }
+            set { _scrubCacheSize = value; _stream?.SetCacheSize(value); }
+        }
+
+        // Priority in the global memory governor. Under memory pressure, the
+        // buffers of lower priority players are reclaimed first.
+        public int memoryPriority {
+            get { return _memoryPriority; }
+            set { _memoryPriority = value; ApplyMemoryPriority(); }
+        }
+
+        // Expand the decoded frames into RGBA8 pixels on the CPU (in the
+        // decoding thread), so that they can be read with ReadRGBAPixels().
+        public bool rgbaOutput {
+            get { return _rgbaOutput; }
+            set { _rgbaOutput = value; ApplyRGBAOutput(); }
+        }
+
+        // Decode the frames without validating the compressed data, which
+        // makes decompression a bit cheaper. Only enable it for files that
+        // were verified beforehand (e.g. with a stored checksum): A broken
+        // file can crash the player in this mode.
+        public bool trustedInput {
+            get { return _trustedInput; }
+            set { _trustedInput = value; _demuxer?.SetTrusted(value); }
+        }
+
         public RenderTexture targetTexture {
             get { return _targetTexture; }
             set { _targetTexture = value; }
@@ -78,14 +160,79 @@ public enum PathMode { StreamingAssets, LocalFileSystem }
         } }
 
         public string resolvedFilePath { get {
-            if (_pathMode == PathMode.StreamingAssets)
-                return System.IO.Path.Combine(Application.streamingAssetsPath, _filePath);
-            else
-                return _filePath;
+            return ResolveFilePath(_filePath, _pathMode);
         } }
 
         public Texture2D texture { get { return _texture; } }
 
+        public long preloadedBytes { get { return _demuxer?.PreloadSize ?? 0; } }
+
+        // True while the preloaded frames are evicted by the budget or the
+        // memory governor. They're reloaded when there is room again.
+        public bool isPreloadEvicted { get { return _demuxer?.PreloadEvicted ?? false; } }
+
+        public int readAheadDepth { get { return _stream?.Depth ?? 0; } }
+
+        // Frames skipped in background decoding because they were superseded
+        // or couldn't be decoded in time, and frames decoded too late
+        public long droppedFrameCount { get { return _decoder?.DroppedFrameCount ?? 0; } }
+        public long lateFrameCount { get { return _decoder?.LateFrameCount ?? 0; } }
+
+        #endregion
+
+        #region Global preload settings
+
+        // Memory budget shared by all the players in the preload mode. The
+        // least recently used clips are evicted when it's exceeded.
+        public static long preloadBudget {
+            get { return Demuxer.KlakHap_GetPreloadBudget(); }
+            set { Demuxer.KlakHap_SetPreloadBudget(value); }
+        }
+
+        public static long preloadUsage
+          => Demuxer.KlakHap_GetPreloadUsage();
+
+        #endregion
+
+        #region Global memory settings
+
+        public enum MemoryCategory { ReadAhead, Preload, FrameCache, Decoder, FramePool }
+
+        // Upper limit of the total memory used by the plugin (zero for no
+        // limit). When it's exceeded, the free frame buffers, the decoded frame
+        // cache, the preloaded frames and the read-ahead buffers are reclaimed
+        // in this order.
+        public static long memoryCap {
+            get { return Demuxer.KlakHap_GetMemoryCap(); }
+            set { Demuxer.KlakHap_SetMemoryCap(value); }
+        }
+
+        public static long memoryUsage
+          => Demuxer.KlakHap_GetMemoryUsage(-1);
+
+        public static long GetMemoryUsage(MemoryCategory category)
+          => Demuxer.KlakHap_GetMemoryUsage((int)category);
+
+        #endregion
+
+        #region Global frame cache settings
+
+        // Memory budget of the decoded frame cache shared by all the players
+        // (disabled with zero). Loops that fit in it are decoded only once.
+        public static long frameCacheBudget {
+            get { return Decoder.KlakHap_GetFrameCacheBudget(); }
+            set { Decoder.KlakHap_SetFrameCacheBudget(value); }
+        }
+
+        public static long frameCacheUsage
+          => Decoder.KlakHap_GetFrameCacheUsage();
+
+        public static long frameCacheHits
+          => Decoder.KlakHap_GetFrameCacheHits();
+
+        public static long frameCacheMisses
+          => Decoder.KlakHap_GetFrameCacheMisses();
+
         #endregion
 
         #region Public methods
@@ -104,15 +251,79 @@ public void Open(string filePath, PathMode pathMode = PathMode.StreamingAssets)
             OpenInternal();
         }
 
+        // Queue a clip to be played right after the current one. It's opened
+        // in the background and switched to at the end of the current clip
+        // (only in forward playback) without a gap.
+        public void OpenNext(string filePath, PathMode pathMode = PathMode.StreamingAssets)
+        {
+            if (_demuxer == null)
+            {
+                Open(filePath, pathMode);
+                return;
+            }
+
+            _nextClip?.Dispose();
+            _nextPath = (filePath, pathMode);
+            _nextClip = new ClipLoader
+              (ResolveFilePath(filePath, pathMode), 0, _speed / 60, _decoder,
+               PreloadWindow);
+        }
+
         public void UpdateNow()
           => LateUpdate();
 
+        // Copy the RGBA8 pixels of the current frame (the top row first) into
+        // the array. Needs the RGBA output. Returns false when the pixels
+        // aren't available.
+        public bool ReadRGBAPixels(byte[] destination)
+        {
+            if (_decoder == null) return false;
+
+            var size = _decoder.RGBABufferSize;
+            if (destination.Length < size) return false;
+
+            var pixels = _decoder.LockRGBABuffer();
+            if (pixels != IntPtr.Zero) Marshal.Copy(pixels, destination, 0, size);
+            _decoder.UnlockRGBABuffer();
+
+            return pixels != IntPtr.Zero;
+        }
+
+        // Convert the current frame into RGBA8 pixels in the given memory
+        // (e.g. the frame buffer of an LED mapper) with the given row pitch
+        // in bytes. It doesn't need the RGBA output.
+        public bool ReadRGBAPixels(IntPtr destination, int pitch)
+          => _decoder?.CopyPixels(destination, pitch) ?? false;
+
+        // Same as above but into separate R, G, B and A planes. Planes given
+        // as IntPtr.Zero are skipped.
+        public bool ReadPlanarPixels
+          (IntPtr r, IntPtr g, IntPtr b, IntPtr a, int pitch)
+          => _decoder?.CopyPlanes(r, g, b, a, pitch) ?? false;
+
+        // Rebuild the frame index of a movie file that has no usable index
+        // (e.g. a recording that crashed before finalizing the file) and save
+        // it as a sidecar file, so that the file can be opened normally.
+        public static bool RecoverIndex
+          (string fullPath, int width, int height, float frameRate)
+        {
+            var demuxer = new Demuxer(fullPath, width, height, frameRate);
+            var saved = demuxer.IsValid && demuxer.SaveIndex();
+            demuxer.Dispose();
+            return saved;
+        }
+
         #endregion
 
         #region Private members
 
         Demuxer _demuxer;
         StreamReader _stream;
+        long _readAheadLimit = 256L << 20;
+        int _scrubCacheSize = 16;
+        int _memoryPriority = 0;
+        bool _rgbaOutput;
+        bool _trustedInput;
         Decoder _decoder;
 
         Texture2D _texture;
@@ -121,6 +332,17 @@ public void UpdateNow()
         float _storedTime;
         float _storedSpeed;
 
+        ClipLoader _nextClip;
+        (string filePath, PathMode pathMode) _nextPath;
+
+        static string ResolveFilePath(string filePath, PathMode pathMode)
+        {
+            if (pathMode == PathMode.StreamingAssets)
+                return System.IO.Path.Combine(Application.streamingAssetsPath, filePath);
+            else
+                return filePath;
+        }
+
         void OpenInternal()
         {
             // Demuxer instantiation
@@ -140,19 +362,46 @@ void OpenInternal()
                 return;
             }
 
+            _demuxer.SetPriority(_memoryPriority);
+            _demuxer.SetTrusted(_trustedInput);
+            ApplyPreloadMode();
+
             // Stream reader instantiation
             _stream = new StreamReader(_demuxer, _time, _speed / 60);
+            ApplyStreamSettings();
             (_storedTime, _storedSpeed) = (_time, _speed);
 
-            // Decoder instantiation
+            CreateDecoder();
+        }
+
+        void ApplyStreamSettings()
+        {
+            _stream.SetByteCap(_readAheadLimit);
+            _stream.SetCacheSize(_scrubCacheSize);
+            _stream.SetPriority(_memoryPriority);
+        }
+
+        void CreateDecoder()
+        {
+            var format = Utility.DetermineTextureFormat(_demuxer.VideoType);
+            var supported = SystemInfo.SupportsTextureFormat(format);
+
+            // Decoder instantiation (the RGBA fallback has no mip chain)
             _decoder = new Decoder(
-                _stream, _demuxer.Width, _demuxer.Height, _demuxer.VideoType
+                _stream, _demuxer.Width, _demuxer.Height, _demuxer.VideoType,
+                (int)_resolution, _mipmaps && supported
             );
 
+            // Targets without BC texture support: Use an RGBA texture and
+            // expand the frames on the CPU.
+            if (!supported && _decoder.SetRGBAOutput(true))
+                format = TextureFormat.RGBA32;
+            else if (_rgbaOutput)
+                _decoder.SetRGBAOutput(true);
+
             // Texture initialization
             _texture = new Texture2D(
-                _demuxer.Width, _demuxer.Height,
-                Utility.DetermineTextureFormat(_demuxer.VideoType), false
+                _decoder.Width, _decoder.Height, format, _decoder.MipCount > 1
             );
             _texture.wrapMode = TextureWrapMode.Clamp;
             _texture.hideFlags = HideFlags.DontSave;
@@ -160,6 +409,119 @@ void OpenInternal()
             _updater = new TextureUpdater(_texture, _decoder);
         }
 
+        // Switch to the queued clip. Returns false when it can't be opened.
+        bool SwitchToNextClip(float time)
+        {
+            var predecoded = _nextClip.IsPredecoded;
+            var (demuxer, stream) = _nextClip.Detach();
+            _nextClip.Dispose();
+            _nextClip = null;
+
+            if (!demuxer.IsValid)
+            {
+                Debug.LogError("Failed to open stream (" +
+                  ResolveFilePath(_nextPath.filePath, _nextPath.pathMode) + ").");
+                demuxer.Dispose();
+                return false;
+            }
+
+            var reuse = predecoded ||
+              (demuxer.Width == _demuxer.Width &&
+               demuxer.Height == _demuxer.Height &&
+               (demuxer.VideoType & 0xf) == (_demuxer.VideoType & 0xf));
+
+            // The current stream can be closed after the decoder stops
+            // using it.
+            _decoder.Flush();
+            _stream.Dispose();
+            _demuxer.Dispose();
+
+            (_demuxer, _stream) = (demuxer, stream);
+            (_filePath, _pathMode) = _nextPath;
+
+            _demuxer.SetPriority(_memoryPriority);
+            _demuxer.SetTrusted(_trustedInput);
+            ApplyStreamSettings();
+
+            if (reuse)
+            {
+                // Same format: Keep the decoder buffer and the texture.
+                _decoder.Attach(_stream, predecoded);
+            }
+            else
+            {
+                DestroyDecoder();
+                CreateDecoder();
+            }
+
+            // The stream has been reading from the beginning, so it can
+            // continue from the overshoot without resync.
+            _time = _storedTime = time;
+            return true;
+        }
+
+        void DestroyDecoder()
+        {
+            _updater.Dispose();
+            _decoder.Dispose();
+            Utility.Destroy(_texture);
+            Utility.Destroy(_blitMaterial);
+            _blitMaterial = null;
+        }
+
+        void RecreateDecoder()
+        {
+            if (_decoder == null) return;
+
+            // The queued clip is reloaded, as the loader refers to the
+            // decoder.
+            var pending = _nextClip != null;
+            _nextClip?.Dispose();
+            _nextClip = null;
+
+            // The decoder and the texture are recreated at the new size.
+            _decoder.Flush();
+            DestroyDecoder();
+            CreateDecoder();
+
+            if (pending) OpenNext(_nextPath.filePath, _nextPath.pathMode);
+        }
+
+        // Preload window in bytes (0 = whole clip, -1 = disabled)
+        long PreloadWindow
+          => _preloadMode == PreloadMode.WholeClip ? 0 :
+             _preloadMode == PreloadMode.Window ? (long)_preloadWindowSize << 20 : -1;
+
+        void ApplyPreloadMode()
+        {
+            if (_demuxer == null) return;
+            var window = PreloadWindow;
+            if (window >= 0)
+                _demuxer.EnablePreload(window);
+            else
+                _demuxer.DisablePreload();
+        }
+
+        // The queued clip is preloaded by its loader. Reload it with the
+        // current preload settings.
+        void RequeueNextClip()
+        {
+            if (_nextClip != null) OpenNext(_nextPath.filePath, _nextPath.pathMode);
+        }
+
+        void ApplyRGBAOutput()
+        {
+            if (_decoder == null) return;
+            // The fallback texture needs it regardless of the setting.
+            _decoder.SetRGBAOutput(_rgbaOutput || _texture.format == TextureFormat.RGBA32);
+        }
+
+        void ApplyMemoryPriority()
+        {
+            _demuxer?.SetPriority(_memoryPriority);
+            _stream?.SetPriority(_memoryPriority);
+        }
+
         #endregion
 
         #region External object updaters
@@ -172,9 +534,12 @@ void UpdateTargetTexture()
             if (_targetTexture == null) return;
 
             // Material lazy initialization
+            // (The RGBA fallback texture is already in RGB.)
             if (_blitMaterial == null)
             {
-                _blitMaterial = new Material(Utility.DetermineBlitShader(_demuxer.VideoType));
+                var shader = _texture.format == TextureFormat.RGBA32 ?
+                  Shader.Find("Klak/HAP") : Utility.DetermineBlitShader(_demuxer.VideoType);
+                _blitMaterial = new Material(shader);
                 _blitMaterial.hideFlags = HideFlags.DontSave;
             }
 
@@ -241,6 +606,12 @@ public void GatherProperties(PlayableDirector director, IPropertyCollector drive
 
         void OnDestroy()
         {
+            if (_nextClip != null)
+            {
+                _nextClip.Dispose();
+                _nextClip = null;
+            }
+
             if (_updater != null)
             {
                 _updater.Dispose();
@@ -284,6 +655,16 @@ void LateUpdate()
             // Do nothing if the demuxer hasn't been instantiated.
             if (_demuxer == null) return;
 
+            // Switch to the queued clip at the end of the current one. Hold
+            // the last frame until it's ready.
+            if (_nextClip != null && _speed > 0 && _time >= _demuxer.Duration)
+            {
+                if (!_nextClip.IsDone)
+                    _time = _storedTime = (float)_demuxer.Duration - 1e-4f;
+                else if (!SwitchToNextClip(_time - (float)_demuxer.Duration))
+                    _time = 0;
+            }
+
             var duration = (float)_demuxer.Duration;
 
             // Check if _time is still in the same frame of _storedTime.
@@ -305,14 +686,15 @@ void LateUpdate()
             // Resync shouldn't happen. Not preferable in edit mode.
             var bgdec = !resync && Application.isPlaying;
 
-            // Restart the stream reader on resync.
-            if (resync) _stream.Restart(t, _speed / 60);
+            // Resync: Move the playhead when the frame is in the scrub cache.
+            // Restart the stream reader otherwise.
+            if (resync && !_decoder.Seek(t, _speed / 60)) _decoder.Restart(t, _speed / 60);
 
-            if (TextureUpdater.AsyncSupport)
+            if (_updater.IsAsync)
             {
                 // Asynchronous texture update supported:
                 // Decode a frame and request a texture update.
-                if (bgdec) _decoder.UpdateAsync(t); else _decoder.UpdateSync(t);
+                if (bgdec) _decoder.UpdateAsync(t, Time.unscaledDeltaTime); else _decoder.UpdateSync(t);
                 _updater.RequestAsyncUpdate();
             }
             #if !HAP_NO_DELAY
@@ -323,7 +705,7 @@ void LateUpdate()
                 // introduces a single frame delay but makes it possible to
                 // offload decoding load to a background thread.
                 _updater.UpdateNow();
-                _decoder.UpdateAsync(t);
+                _decoder.UpdateAsync(t, Time.unscaledDeltaTime);
             }
             #endif
             else
@@ -0,0 +1,77 @@
+using System;
+using System.Runtime.InteropServices;
+
+namespace Klak.Hap
+{
+    // Wrapper for the native clip loader: Opens the next clip in the
+    // background and decodes its first frame into the decoder's standby
+    // buffer when the formats match.
+    internal sealed class ClipLoader : IDisposable
+    {
+        #region Public methods
+
+        // preload: Preload window in bytes (0 = whole clip, -1 = disabled).
+        // It's applied before the clip starts reading ahead.
+        public ClipLoader
+          (string filePath, float time, float delta, Decoder decoder, long preload)
+          => _plugin = KlakHap_CreateClipLoader
+               (filePath, time, delta, decoder?.PluginPointer ?? IntPtr.Zero, preload);
+
+        public void Dispose()
+        {
+            if (_plugin != IntPtr.Zero)
+            {
+                KlakHap_DestroyClipLoader(_plugin);
+                _plugin = IntPtr.Zero;
+            }
+        }
+
+        public bool IsDone
+          => KlakHap_IsClipLoaderDone(_plugin) != 0;
+
+        // True when the first frame is waiting in the decoder's standby buffer
+        public bool IsPredecoded
+          => KlakHap_IsClipPredecoded(_plugin) != 0;
+
+        // Hand over the loaded demuxer and stream reader. The demuxer is
+        // invalid (and the stream reader is null) when the file couldn't be
+        // opened.
+        public (Demuxer demuxer, StreamReader stream) Detach()
+        {
+            var demuxer = new Demuxer(KlakHap_DetachClipDemuxer(_plugin));
+            var stream = KlakHap_DetachClipStreamReader(_plugin);
+            return (demuxer, stream != IntPtr.Zero ? new StreamReader(stream) : null);
+        }
+
+        #endregion
+
+        #region Private members
+
+        IntPtr _plugin;
+
+        #endregion
+
+        #region Native plugin entry points
+
+        [DllImport("KlakHap")]
+        internal static extern IntPtr KlakHap_CreateClipLoader
+          (string filePath, float time, float delta, IntPtr decoder, long preload);
+
+        [DllImport("KlakHap")]
+        internal static extern void KlakHap_DestroyClipLoader(IntPtr loader);
+
+        [DllImport("KlakHap")]
+        internal static extern int KlakHap_IsClipLoaderDone(IntPtr loader);
+
+        [DllImport("KlakHap")]
+        internal static extern int KlakHap_IsClipPredecoded(IntPtr loader);
+
+        [DllImport("KlakHap")]
+        internal static extern IntPtr KlakHap_DetachClipDemuxer(IntPtr loader);
+
+        [DllImport("KlakHap")]
+        internal static extern IntPtr KlakHap_DetachClipStreamReader(IntPtr loader);
+
+        #endregion
+    }
+}
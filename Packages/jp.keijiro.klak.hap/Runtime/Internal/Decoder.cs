@@ -1,6 +1,5 @@
 using System;
 using System.Runtime.InteropServices;
-using System.Threading;
 
 namespace Klak.Hap
 {
@@ -8,35 +7,24 @@ internal sealed class Decoder : IDisposable
     {
         #region Initialization/finalization
 
-        public Decoder(StreamReader stream, int width, int height, int videoType)
+        // A non-zero proxy level makes the decoder output 1/2 (level 1) or
+        // 1/4 (level 2) resolution frames. With mipmaps, the buffer holds the
+        // full mip chain of each frame.
+        public Decoder(StreamReader stream, int width, int height, int videoType,
+                       int proxyLevel = 0, bool mipmaps = false)
         {
             _stream = stream;
 
             // Plugin initialization
-            _plugin = KlakHap_CreateDecoder(width, height, videoType);
+            _plugin = KlakHap_CreateDecoderWithOptions
+              (width, height, videoType, proxyLevel, mipmaps ? 1 : 0);
             _id = ++_instantiationCount;
             KlakHap_AssignDecoder(_id, _plugin);
-
-            // By default, start from the first frame.
-            _time = 0;
-
-            // Decoder thread startup
-            _resume.req = new AutoResetEvent(true);
-            _resume.ack = new AutoResetEvent(false);
-            _thread = new Thread(DecoderThread);
-            _thread.Start();
         }
 
         public void Dispose()
         {
-            if (_thread != null)
-            {
-                _terminate = true;
-                _resume.req.Set();
-                _thread.Join();
-                _thread = null;
-            }
-
+            // The pending decode job is canceled on destruction.
             if (_plugin != IntPtr.Zero)
             {
                 KlakHap_AssignDecoder(_id, IntPtr.Zero);
@@ -50,26 +38,101 @@ public void Dispose()
         #region Public members
 
         public uint CallbackID { get { return _id; } }
+        public IntPtr PluginPointer { get { return _plugin; } }
 
         public int BufferSize { get {
             return KlakHap_GetDecoderBufferSize(_plugin);
         } }
 
+        // Output frame size (the proxy size with a proxy level)
+        public int Width => KlakHap_GetDecoderWidth(_plugin);
+        public int Height => KlakHap_GetDecoderHeight(_plugin);
+
+        // 1 without mipmaps (or when they're unavailable for the format)
+        public int MipCount => KlakHap_GetDecoderMipCount(_plugin);
+
+        // False when the buffer hasn't been changed since the last upload
+        // (e.g. on a hold frame).
+        public bool IsBufferUpdated { get {
+            return KlakHap_IsDecoderBufferUpdated(_plugin) != 0;
+        } }
+
+        // Frames skipped by the decode scheduler
+        public long DroppedFrameCount { get {
+            return KlakHap_GetDroppedFrameCount(_plugin);
+        } }
+
+        // Frames decoded after their presentation deadlines
+        public long LateFrameCount { get {
+            return KlakHap_GetLateFrameCount(_plugin);
+        } }
+
         public void UpdateSync(float time)
         {
-            _time = time;
-            var buffer = _stream.Advance(_time);
-            if (buffer != null)
-                KlakHap_DecodeFrame(_plugin, buffer.PluginPointer);
+            // The stream reader only accepts a single consumer at a time, so
+            // wait for the scheduled job to finish.
+            KlakHap_FlushDecoder(_plugin);
+
+            var buffer = _stream.Advance(time);
+            if (buffer != IntPtr.Zero) KlakHap_DecodeFrame(_plugin, buffer);
+        }
+
+        public void Restart(float time, float delta)
+        {
+            KlakHap_FlushDecoder(_plugin);
+            _stream.Restart(time, delta);
         }
 
-        public void UpdateAsync(float time)
+        // Move the playhead to a frame in the scrub cache. Returns false on
+        // a miss; Restart is needed then.
+        public bool Seek(float time, float delta)
         {
-            _time = time;
-            _resume.req.Set();
-            _resume.ack.WaitOne();
+            KlakHap_FlushDecoder(_plugin);
+            return _stream.Seek(time, delta);
+        }
+
+        // Switch to another stream (the next clip in a playlist). When the
+        // first frame was predecoded, it's shown from the standby buffer.
+        public void Attach(StreamReader stream, bool predecoded)
+        {
+            KlakHap_FlushDecoder(_plugin);
+            _stream = stream;
+            if (predecoded) KlakHap_ShowDecoderStandby(_plugin);
         }
 
+        // Wait for the background decoding job.
+        public void Flush()
+          => KlakHap_FlushDecoder(_plugin);
+
+        // Decode in the background. The deadline is the number of seconds
+        // until the frame is presented; the native scheduler drops the frame
+        // when it can't make it.
+        public void UpdateAsync(float time, float deadline)
+          => KlakHap_ScheduleDecode(_plugin, _stream.PluginPointer, time, deadline);
+
+        // Expand the decoded frames into RGBA8 pixels. Returns false when
+        // the format isn't supported.
+        public bool SetRGBAOutput(bool enable)
+          => KlakHap_SetDecoderRGBAOutput(_plugin, enable ? 1 : 0) != 0;
+
+        public int RGBABufferSize
+          => KlakHap_GetDecoderRGBABufferSize(_plugin);
+
+        // Returns IntPtr.Zero when the RGBA output is disabled. It must be
+        // unlocked anyway.
+        public IntPtr LockRGBABuffer()
+          => KlakHap_LockDecoderRGBABuffer(_plugin);
+
+        public void UnlockRGBABuffer()
+          => KlakHap_UnlockDecoderRGBABuffer(_plugin);
+
+        // Convert the current frame straight into the given memory.
+        public bool CopyPixels(IntPtr dest, int pitch)
+          => KlakHap_CopyDecoderPixels(_plugin, dest, pitch) != 0;
+
+        public bool CopyPlanes(IntPtr r, IntPtr g, IntPtr b, IntPtr a, int pitch)
+          => KlakHap_CopyDecoderPlanes(_plugin, r, g, b, a, pitch) != 0;
+
         public IntPtr LockBuffer()
         {
             return KlakHap_LockDecoderBuffer(_plugin);
@@ -89,32 +152,7 @@ public void UnlockBuffer()
         IntPtr _plugin;
         uint _id;
 
-        Thread _thread;
-        (AutoResetEvent req, AutoResetEvent ack) _resume;
-        bool _terminate;
-
         StreamReader _stream;
-        float _time;
-
-        #endregion
-
-        #region Thread function
-
-        void DecoderThread()
-        {
-            while (true)
-            {
-                _resume.req.WaitOne();
-                _resume.ack.Set();
-
-                if (_terminate) break;
-
-                var buffer = _stream.Advance(_time);
-                if (buffer == null) continue;
-
-                KlakHap_DecodeFrame(_plugin, buffer.PluginPointer);
-            }
-        }
 
         #endregion
 
@@ -123,6 +161,10 @@ void DecoderThread()
         [DllImport("KlakHap")]
         internal static extern IntPtr KlakHap_CreateDecoder(int width, int height, int typeID);
 
+        [DllImport("KlakHap")]
+        internal static extern IntPtr KlakHap_CreateDecoderWithOptions
+          (int width, int height, int typeID, int proxyLevel, int mipmaps);
+
         [DllImport("KlakHap")]
         internal static extern void KlakHap_DestroyDecoder(IntPtr decoder);
 
@@ -141,6 +183,69 @@ void DecoderThread()
         [DllImport("KlakHap")]
         internal static extern int KlakHap_GetDecoderBufferSize(IntPtr decoder);
 
+        [DllImport("KlakHap")]
+        internal static extern int KlakHap_GetDecoderWidth(IntPtr decoder);
+
+        [DllImport("KlakHap")]
+        internal static extern int KlakHap_GetDecoderHeight(IntPtr decoder);
+
+        [DllImport("KlakHap")]
+        internal static extern int KlakHap_GetDecoderMipCount(IntPtr decoder);
+
+        [DllImport("KlakHap")]
+        internal static extern int KlakHap_IsDecoderBufferUpdated(IntPtr decoder);
+
+        [DllImport("KlakHap")]
+        internal static extern int KlakHap_ShowDecoderStandby(IntPtr decoder);
+
+        [DllImport("KlakHap")]
+        internal static extern int KlakHap_SetDecoderRGBAOutput(IntPtr decoder, int enable);
+
+        [DllImport("KlakHap")]
+        internal static extern IntPtr KlakHap_LockDecoderRGBABuffer(IntPtr decoder);
+
+        [DllImport("KlakHap")]
+        internal static extern void KlakHap_UnlockDecoderRGBABuffer(IntPtr decoder);
+
+        [DllImport("KlakHap")]
+        internal static extern int KlakHap_GetDecoderRGBABufferSize(IntPtr decoder);
+
+        [DllImport("KlakHap")]
+        internal static extern int KlakHap_CopyDecoderPixels
+          (IntPtr decoder, IntPtr dest, int pitch);
+
+        [DllImport("KlakHap")]
+        internal static extern int KlakHap_CopyDecoderPlanes
+          (IntPtr decoder, IntPtr r, IntPtr g, IntPtr b, IntPtr a, int pitch);
+
+        [DllImport("KlakHap")]
+        internal static extern void KlakHap_ScheduleDecode
+          (IntPtr decoder, IntPtr reader, float time, float deadline);
+
+        [DllImport("KlakHap")]
+        internal static extern void KlakHap_FlushDecoder(IntPtr decoder);
+
+        [DllImport("KlakHap")]
+        internal static extern long KlakHap_GetDroppedFrameCount(IntPtr decoder);
+
+        [DllImport("KlakHap")]
+        internal static extern long KlakHap_GetLateFrameCount(IntPtr decoder);
+
+        [DllImport("KlakHap")]
+        internal static extern void KlakHap_SetFrameCacheBudget(long bytes);
+
+        [DllImport("KlakHap")]
+        internal static extern long KlakHap_GetFrameCacheBudget();
+
+        [DllImport("KlakHap")]
+        internal static extern long KlakHap_GetFrameCacheUsage();
+
+        [DllImport("KlakHap")]
+        internal static extern long KlakHap_GetFrameCacheHits();
+
+        [DllImport("KlakHap")]
+        internal static extern long KlakHap_GetFrameCacheMisses();
+
         #endregion
     }
 }
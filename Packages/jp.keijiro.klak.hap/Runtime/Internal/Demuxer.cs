@@ -8,19 +8,35 @@ internal sealed class Demuxer : IDisposable
         #region Public properties
 
         public bool IsValid { get { return _plugin != IntPtr.Zero; } }
+        public IntPtr PluginPointer { get { return _plugin; } }
         public int Width { get { return _width; } }
         public int Height { get { return _height; } }
         public int VideoType { get { return _videoType; } }
         public double Duration { get { return _duration; } }
         public int FrameCount { get { return _frameCount; } }
+        public long PreloadSize { get { return KlakHap_GetDemuxerPreloadSize(_plugin); } }
+        public bool PreloadEvicted { get { return KlakHap_IsDemuxerPreloadEvicted(_plugin) != 0; } }
 
         #endregion
 
         #region Initialization/finalization
 
         public Demuxer(string filePath)
+          => Initialize(KlakHap_OpenDemuxer(filePath));
+
+        // Recovery mode constructor: Rebuilds the frame index from the media
+        // data when the file has no usable index (e.g. a crashed recording).
+        public Demuxer(string filePath, int width, int height, double frameRate)
+          => Initialize(KlakHap_OpenDemuxerWithRecovery(filePath, width, height, frameRate));
+
+        // Takes the ownership of a demuxer opened in the plugin (e.g. by a
+        // clip loader).
+        public Demuxer(IntPtr plugin)
+          => Initialize(plugin);
+
+        void Initialize(IntPtr plugin)
         {
-            _plugin = KlakHap_OpenDemuxer(filePath);
+            _plugin = plugin;
 
             if (KlakHap_DemuxerIsValid(_plugin) == 0)
             {
@@ -51,12 +67,25 @@ public void Dispose()
 
         #region Public methods
 
-        public void ReadFrame(ReadBuffer buffer, int index, float time)
-        {
-            KlakHap_ReadFrame(_plugin, index, buffer.PluginPointer);
-            buffer.Index = index;
-            buffer.Time = time;
-        }
+        public bool SaveIndex()
+          => KlakHap_SaveDemuxerIndex(_plugin) != 0;
+
+        // Preload mode: Keeps the whole clip (window = 0) or a window around
+        // the playhead (window = byte budget) in memory.
+        public void EnablePreload(long window)
+          => KlakHap_EnableDemuxerPreload(_plugin, Math.Max(window, 0));
+
+        public void DisablePreload()
+          => KlakHap_EnableDemuxerPreload(_plugin, -1);
+
+        // Priority of the preloaded frames in the memory governor
+        public void SetPriority(int priority)
+          => KlakHap_SetDemuxerPriority(_plugin, priority);
+
+        // Trusted mode: Skips the validation of the compressed data. Only for
+        // files verified by the user (a broken file can crash the decoder).
+        public void SetTrusted(bool trusted)
+          => KlakHap_SetDemuxerTrusted(_plugin, trusted ? 1 : 0);
 
         #endregion
 
@@ -74,12 +103,19 @@ public void ReadFrame(ReadBuffer buffer, int index, float time)
         [DllImport("KlakHap")]
         internal static extern IntPtr KlakHap_OpenDemuxer(string filepath);
 
+        [DllImport("KlakHap")]
+        internal static extern IntPtr KlakHap_OpenDemuxerWithRecovery
+          (string filepath, int width, int height, double frameRate);
+
         [DllImport("KlakHap")]
         internal static extern void KlakHap_CloseDemuxer(IntPtr demuxer);
 
         [DllImport("KlakHap")]
         internal static extern int KlakHap_DemuxerIsValid(IntPtr demuxer);
 
+        [DllImport("KlakHap")]
+        internal static extern int KlakHap_SaveDemuxerIndex(IntPtr demuxer);
+
         [DllImport("KlakHap")]
         internal static extern int KlakHap_CountFrames(IntPtr demuxer);
 
@@ -96,7 +132,37 @@ public void ReadFrame(ReadBuffer buffer, int index, float time)
         internal static extern int KlakHap_AnalyzeVideoType(IntPtr demuxer);
 
         [DllImport("KlakHap")]
-        internal static extern void KlakHap_ReadFrame(IntPtr demuxer, int frameNumber, IntPtr buffer);
+        internal static extern void KlakHap_EnableDemuxerPreload(IntPtr demuxer, long window);
+
+        [DllImport("KlakHap")]
+        internal static extern void KlakHap_SetDemuxerPriority(IntPtr demuxer, int priority);
+
+        [DllImport("KlakHap")]
+        internal static extern void KlakHap_SetDemuxerTrusted(IntPtr demuxer, int trusted);
+
+        [DllImport("KlakHap")]
+        internal static extern long KlakHap_GetDemuxerPreloadSize(IntPtr demuxer);
+
+        [DllImport("KlakHap")]
+        internal static extern int KlakHap_IsDemuxerPreloadEvicted(IntPtr demuxer);
+
+        [DllImport("KlakHap")]
+        internal static extern void KlakHap_SetPreloadBudget(long bytes);
+
+        [DllImport("KlakHap")]
+        internal static extern long KlakHap_GetPreloadBudget();
+
+        [DllImport("KlakHap")]
+        internal static extern long KlakHap_GetPreloadUsage();
+
+        [DllImport("KlakHap")]
+        internal static extern void KlakHap_SetMemoryCap(long bytes);
+
+        [DllImport("KlakHap")]
+        internal static extern long KlakHap_GetMemoryCap();
+
+        [DllImport("KlakHap")]
+        internal static extern long KlakHap_GetMemoryUsage(int category);
 
         #endregion
     }
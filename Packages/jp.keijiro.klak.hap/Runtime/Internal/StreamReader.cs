@@ -1,265 +1,100 @@
 using System;
-using System.Collections.Generic;
 using System.Runtime.InteropServices;
-using System.Threading;
 
 namespace Klak.Hap
 {
+    // Wrapper for the native stream reader: Frames are read ahead on a
+    // background thread in the plugin.
     internal sealed class StreamReader : IDisposable
     {
         #region Public methods
 
         public StreamReader(Demuxer demuxer, float time, float delta)
-        {
-            _demuxer = demuxer;
-
-            _leadQueue = new Queue<ReadBuffer>();
-            _freeBuffers = new List<ReadBuffer>();
-
-            // Initial buffer entry allocation
-            _freeBuffers.Add(new ReadBuffer());
-            _freeBuffers.Add(new ReadBuffer());
-            _freeBuffers.Add(new ReadBuffer());
-            _freeBuffers.Add(new ReadBuffer());
+          => _plugin = KlakHap_CreateStreamReader(demuxer.PluginPointer, time, delta);
 
-            // Initial playback settings
-            _restart = (time, SafeDelta(delta));
+        // Takes the ownership of a stream reader created in the plugin.
+        public StreamReader(IntPtr plugin)
+          => _plugin = plugin;
 
-            // Reader thread startup
-            _updateEvent = new AutoResetEvent(true);
-            _readEvent = new AutoResetEvent(false);
-            _thread = new Thread(ReaderThread);
-            _thread.Start();
-        }
+        public IntPtr PluginPointer => _plugin;
 
         public void Dispose()
         {
-            if (_thread != null)
-            {
-                _terminate = true;
-                _updateEvent.Set();
-                _thread.Join();
-                _thread = null;
-            }
-
-            if (_updateEvent != null)
-            {
-                _updateEvent.Dispose();
-                _updateEvent = null;
-            }
-
-            if (_readEvent != null)
-            {
-                _readEvent.Dispose();
-                _readEvent = null;
-            }
-
-            if (_current != null)
-            {
-                _current.Dispose();
-                _current = null;
-            }
-
-            if (_leadQueue != null)
-            {
-                foreach (var rb in _leadQueue) rb.Dispose();
-                _leadQueue.Clear();
-                _leadQueue = null;
-            }
-
-            if (_freeBuffers != null)
+            if (_plugin != IntPtr.Zero)
             {
-                foreach (var rb in _freeBuffers) rb.Dispose();
-                _freeBuffers.Clear();
-                _freeBuffers = null;
+                KlakHap_DestroyStreamReader(_plugin);
+                _plugin = IntPtr.Zero;
             }
         }
 
         public void Restart(float time, float delta)
-        {
-            // Restart request
-            lock (_restartLock) _restart = (time, SafeDelta(delta));
+          => KlakHap_RestartStreamReader(_plugin, time, delta);
 
-            // Wait for reset/read on the reader thread.
-            _readEvent.Reset();
-            while (_restart != null)
-            {
-                _updateEvent.Set();
-                _readEvent.WaitOne();
-            }
-        }
+        // Move the read position without file I/O when the frame is the
+        // current one or in the scrub cache. Returns false on a miss
+        // (Restart is needed then).
+        public bool Seek(float time, float delta)
+          => KlakHap_SeekStreamReader(_plugin, time, delta) != 0;
 
-        public ReadBuffer Advance(float time)
-        {
-            // Add an epsilon-ish value to avoid rounding error.
-            time += 1e-6f;
+        // Number of read-ahead buffers (adjusted automatically)
+        public int Depth
+          => KlakHap_GetStreamReaderDepth(_plugin);
 
-            var changed = false;
+        // Upper limit of the total size of the read-ahead buffers
+        public void SetByteCap(long bytes)
+          => KlakHap_SetStreamReaderByteCap(_plugin, bytes);
 
-            // There is no slow path in this function, so we prefer holding
-            // the queue lock for the entire function block rather than
-            // acquiring/releasing it for each operation.
-            lock (_queueLock)
-            {
-                // Scan the lead queue.
-                while (_leadQueue.Count > 0)
-                {
-                    var peek = _leadQueue.Peek();
-
-                    if (_current != null)
-                    {
-                        if (_current.Time <= peek.Time)
-                        {
-                            // Forward playback case:
-                            // Break if it hasn't reached the next frame.
-                            if (time < peek.Time) break;
-                        }
-                        else
-                        {
-                            // Reverse playback case:
-                            // Break if it's still on the current frame.
-                            if (_current.Time < time) break;
-                        }
-
-                        // Free the current frame before replacing it.
-                        _freeBuffers.Add(_current);
-                    }
+        // Priority in the memory governor
+        public void SetPriority(int priority)
+          => KlakHap_SetStreamReaderPriority(_plugin, priority);
 
-                    _current = _leadQueue.Dequeue();
-                    changed = true;
-                }
-            }
-
-            // Poke the reader thread.
-            _updateEvent.Set();
+        // Number of frames kept around the playhead for scrubbing
+        public void SetCacheSize(int frames)
+          => KlakHap_SetStreamReaderCacheSize(_plugin, frames);
 
-            // Only returns a buffer object when the frame was changed.
-            return changed ? _current : null;
-        }
+        // Returns a read buffer only when the frame was changed.
+        public IntPtr Advance(float time)
+          => KlakHap_AdvanceStreamReader(_plugin, time);
 
         #endregion
 
         #region Private members
 
-        // Assigned demuxer
-        Demuxer _demuxer;
-
-        // Thread and synchronization objects
-        Thread _thread;
-        AutoResetEvent _updateEvent;
-        AutoResetEvent _readEvent;
-        bool _terminate;
-
-        // Read buffer objects
-        ReadBuffer _current;
-        Queue<ReadBuffer> _leadQueue;
-        List<ReadBuffer> _freeBuffers;
-        readonly object _queueLock = new object();
-
-        // Restart request
-        (float, float)? _restart;
-        readonly object _restartLock = new object();
-
-        // Used to avoid too small delta time values.
-        float SafeDelta(float delta)
-        {
-            var min = (float)(_demuxer.Duration / _demuxer.FrameCount);
-            return Math.Max(Math.Abs(delta), min) * (delta < 0 ? -1 : 1);
-        }
+        IntPtr _plugin;
 
         #endregion
 
-        #region Thread function
+        #region Native plugin entry points
 
-        void ReaderThread()
-        {
-            // Initial time settings from the restart request tuple
-            var (time, delta) = _restart.Value;
-            _restart = null;
-
-            // Stream attributes
-            var totalTime = _demuxer.Duration;
-            var totalFrames = _demuxer.FrameCount;
-
-            while (true)
-            {
-                // Synchronization with the parent thread
-                _updateEvent.WaitOne();
-                if (_terminate) break;
-
-                // Check if there is a restart request.
-                lock (_restartLock) if (_restart != null)
-                {
-                    // Flush out the current contents of the lead queue.
-                    lock (_queueLock) while (_leadQueue.Count > 0)
-                        _freeBuffers.Add(_leadQueue.Dequeue());
-
-                    // Apply the restart request.
-                    (time, delta) = _restart.Value;
-                    _restart = null;
-                }
+        [DllImport("KlakHap")]
+        internal static extern IntPtr KlakHap_CreateStreamReader
+          (IntPtr demuxer, float time, float delta);
 
-                // Time -> Frame count
-                // Rounding strategy: We don't prefer Math.Round because it can
-                // show a frame before the playhead reaches it (especially when
-                // using slow-mo). On the other hand, Math.Floor causes frame
-                // skipping due to rounding errors. To avoid these problems,
-                // we use the "adding a very-very small fractional frame"
-                // approach. 1/1000 might be safe and enough for all the cases.
-                var frameCount = (int)(time * totalFrames / totalTime + 1e-3f);
+        [DllImport("KlakHap")]
+        internal static extern void KlakHap_DestroyStreamReader(IntPtr reader);
 
-                // Frame count -> Frame snapped time
-                var snappedTime = (float)(frameCount * totalTime / totalFrames);
+        [DllImport("KlakHap")]
+        internal static extern void KlakHap_RestartStreamReader
+          (IntPtr reader, float time, float delta);
 
-                // Frame count -> Wrapped frame number
-                var frameNumber = frameCount % totalFrames;
-                if (frameNumber < 0) frameNumber += totalFrames;
+        [DllImport("KlakHap")]
+        internal static extern int KlakHap_SeekStreamReader
+          (IntPtr reader, float time, float delta);
 
-                lock (_queueLock)
-                {
-                    // Do nothing if there is no free buffer; It indicates that
-                    // the lead queue is fully filled.
-                    if (_freeBuffers.Count == 0) continue;
+        [DllImport("KlakHap")]
+        internal static extern int KlakHap_GetStreamReaderDepth(IntPtr reader);
 
-                    ReadBuffer buffer = null;
+        [DllImport("KlakHap")]
+        internal static extern void KlakHap_SetStreamReaderByteCap(IntPtr reader, long bytes);
 
-                    // Look for a free buffer that has the same frame number.
-                    foreach (var temp in _freeBuffers)
-                    {
-                        if (temp.Index == frameNumber)
-                        {
-                            buffer = temp;
-                            break;
-                        }
-                    }
+        [DllImport("KlakHap")]
+        internal static extern void KlakHap_SetStreamReaderPriority(IntPtr reader, int priority);
 
-                    if (buffer != null)
-                    {
-                        // Reuse the found buffer; Although we can use it
-                        // without reading frame data, the time field should
-                        // be updated to handle wrapping-around hits.
-                        _freeBuffers.Remove(buffer);
-                        buffer.Time = snappedTime;
-                    }
-                    else
-                    {
-                        // Allocate a buffer from the free buffer list.
-                        buffer = _freeBuffers[_freeBuffers.Count - 1];
-                        _freeBuffers.RemoveAt(_freeBuffers.Count - 1);
+        [DllImport("KlakHap")]
+        internal static extern void KlakHap_SetStreamReaderCacheSize(IntPtr reader, int frames);
 
-                        // Frame data read
-                        _demuxer.ReadFrame(buffer, frameNumber, snappedTime);
-                    }
-
-                    // Push the buffer to the lead queue.
-                    _leadQueue.Enqueue(buffer);
-                }
-
-                _readEvent.Set();
-
-                time += delta;
-            }
-        }
+        [DllImport("KlakHap")]
+        internal static extern IntPtr KlakHap_AdvanceStreamReader(IntPtr reader, float time);
 
         #endregion
     }
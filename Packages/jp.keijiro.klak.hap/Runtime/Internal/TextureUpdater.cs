@@ -13,6 +13,10 @@ internal sealed class TextureUpdater : IDisposable
             return SystemInfo.graphicsDeviceType == GraphicsDeviceType.Direct3D11;
         } }
 
+        // The native update callback only updates the top mip level, so
+        // mipmapped textures are always updated on the main thread.
+        public bool IsAsync => _command != null;
+
         #endregion
 
         #region Public methods
@@ -22,7 +26,7 @@ public TextureUpdater(Texture2D texture, Decoder decoder)
             _texture = texture;
             _decoder = decoder;
 
-            if (AsyncSupport)
+            if (AsyncSupport && texture.mipmapCount == 1)
             {
                 _command = new CommandBuffer();
                 _command.name = "Klak HAP";
@@ -44,17 +48,35 @@ public void Dispose()
 
         public void UpdateNow()
         {
+            // Skip the upload when the frame hasn't been changed.
+            if (!_decoder.IsBufferUpdated) return;
+
+            if (_texture.format == TextureFormat.RGBA32)
+            {
+                // Fallback texture for targets without BC support
+                var pixels = _decoder.LockRGBABuffer();
+                if (pixels != IntPtr.Zero)
+                {
+                    _texture.LoadRawTextureData(pixels, _decoder.RGBABufferSize);
+                    _texture.Apply();
+                }
+                _decoder.UnlockRGBABuffer();
+                return;
+            }
+
+            // The buffer holds the whole mip chain of mipmapped textures.
             _texture.LoadRawTextureData(
                 _decoder.LockBuffer(),
                 _decoder.BufferSize
             );
-            _texture.Apply();
+            _texture.Apply(false);
             _decoder.UnlockBuffer();
         }
 
         public void RequestAsyncUpdate()
         {
-            if (_command != null) Graphics.ExecuteCommandBuffer(_command);
+            if (_command != null && _decoder.IsBufferUpdated)
+                Graphics.ExecuteCommandBuffer(_command);
         }
 
         #endregion
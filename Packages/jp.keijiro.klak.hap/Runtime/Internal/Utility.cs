@@ -20,6 +20,8 @@ public static CodecType DetermineCodecType(int videoType)
                 case 0xb: return CodecType.Hap;
                 case 0xe: return CodecType.HapAlpha;
                 case 0xf: return CodecType.HapQ;
+                case 0xc: return CodecType.HapR;
+                case 0x2: return CodecType.HapHDR;
             }
             return CodecType.Unsupported;
         }
@@ -32,6 +34,7 @@ public static TextureFormat DetermineTextureFormat(int videoType)
                 case 0xe: return TextureFormat.DXT5;
                 case 0xf: return TextureFormat.DXT5;
                 case 0xc: return TextureFormat.BC7;
+                case 0x2: return TextureFormat.BC6H;
                 case 0x1: return TextureFormat.BC4;
             }
             return TextureFormat.DXT1;
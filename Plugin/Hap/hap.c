@@ -30,6 +30,20 @@
 #include <stdint.h>
 #include <string.h> // For memcpy for uncompressed frames
 #include "snappy-c.h"
+#if HAP_ENABLE_LZ4
+#include <lz4.h>
+#endif
+#if HAP_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+/*
+ Compression level for the Zstandard second-stage compressor. It only affects the encoding speed and the ratio;
+ decoding speed is about the same at every level.
+ */
+#ifndef HAP_ZSTD_LEVEL
+#define HAP_ZSTD_LEVEL 9
+#endif
 
 #define kHapUInt24Max 0x00FFFFFF
 
@@ -42,10 +56,24 @@
 #define kHapCompressorSnappy 0xB
 #define kHapCompressorComplex 0xC
 
+/*
+ Second-stage compressor extensions
+ These aren't part of the Hap specification, so frames using them can only be decoded by this library built with the
+ matching HAP_ENABLE_LZ4/HAP_ENABLE_ZSTD option. They're only stored in the Chunk Second-Stage Compressor Table, never
+ in the top four bits of a section type.
+ LZ4 chunks start with the uncompressed length (4 bytes, little-endian) followed by an LZ4 block.
+ Zstandard chunks are single Zstandard frames with the content size stored.
+ */
+#define kHapCompressorLZ4 0xD
+#define kHapCompressorZstd 0xE
+
 #define kHapFormatRGBDXT1 0xB
 #define kHapFormatRGBADXT5 0xE
 #define kHapFormatYCoCgDXT5 0xF
 #define kHapFormatARGTC1 0x1
+#define kHapFormatRGBABPTC 0xC
+#define kHapFormatRGBBPTCUF 0x2
+#define kHapFormatRGBBPTCSF 0x3
 
 /*
  Packed byte values for Hap
@@ -64,6 +92,15 @@
  A_RGTC1        None            0xA1
  A_RGTC1        Snappy          0xB1
  A_RGTC1        Complex         0xC1
+ RGBA_BPTC      None            0xAC
+ RGBA_BPTC      Snappy          0xBC
+ RGBA_BPTC      Complex         0xCC
+ RGB_BPTC_UF    None            0xA2
+ RGB_BPTC_UF    Snappy          0xB2
+ RGB_BPTC_UF    Complex         0xC2
+ RGB_BPTC_SF    None            0xA3
+ RGB_BPTC_SF    Snappy          0xB3
+ RGB_BPTC_SF    Complex         0xC3
  */
 
 /*
@@ -85,6 +122,18 @@ typedef struct HapChunkDecodeInfo {
     size_t compressed_chunk_size;
     char *uncompressed_chunk_data;
     size_t uncompressed_chunk_size;
+    /*
+     Strided output: when row_length is not zero, the chunk is stored at output_offset in rows of row_length bytes
+     which are output_pitch bytes apart, starting at output_base, instead of at uncompressed_chunk_data
+     */
+    char *output_base;
+    size_t output_offset;
+    size_t row_length;
+    size_t output_pitch;
+    /*
+     Trusted input: the compressed data isn't validated, and the uncompressed_chunk_size is used as is
+     */
+    int trusted;
 } HapChunkDecodeInfo;
 
 // TODO: rename the defines we use for codes used in stored frames
@@ -122,7 +171,7 @@ static void hap_write_4_byte_uint(const void *buffer, unsigned int value)
 
 #define hap_4_bit_packed_byte(top_bits, bottom_bits) (((top_bits) << 4) | ((bottom_bits) & 0x0F))
 
-static int hap_read_section_header(const void *buffer, uint32_t buffer_length, uint32_t *out_header_length, uint32_t *out_section_length, unsigned int *out_section_type)
+static int hap_parse_section_header(const void *buffer, uint32_t buffer_length, uint32_t *out_header_length, uint32_t *out_section_length, unsigned int *out_section_type)
 {
     /*
      Verify buffer is big enough to contain a four-byte header
@@ -162,7 +211,19 @@ static int hap_read_section_header(const void *buffer, uint32_t buffer_length, u
      The fourth byte stores the section type
      */
     *out_section_type = *(((uint8_t *)buffer) + 3U);
-    
+
+    return HapResult_No_Error;
+}
+
+static int hap_read_section_header(const void *buffer, uint32_t buffer_length, uint32_t *out_header_length, uint32_t *out_section_length, unsigned int *out_section_type)
+{
+    int result = hap_parse_section_header(buffer, buffer_length, out_header_length, out_section_length, out_section_type);
+
+    if (result != HapResult_No_Error)
+    {
+        return result;
+    }
+
     /*
      Verify the section does not extend beyond the buffer
      */
@@ -212,6 +273,12 @@ static unsigned int hap_texture_format_constant_for_format_identifier(unsigned i
             return HapTextureFormat_YCoCg_DXT5;
         case kHapFormatARGTC1:
             return HapTextureFormat_A_RGTC1;
+        case kHapFormatRGBABPTC:
+            return HapTextureFormat_RGBA_BPTC_UNORM;
+        case kHapFormatRGBBPTCUF:
+            return HapTextureFormat_RGB_BPTC_UNSIGNED_FLOAT;
+        case kHapFormatRGBBPTCSF:
+            return HapTextureFormat_RGB_BPTC_SIGNED_FLOAT;
         default:
             return 0;
             
@@ -231,6 +298,12 @@ static unsigned int hap_texture_format_identifier_for_format_constant(unsigned i
             return kHapFormatYCoCgDXT5;
         case HapTextureFormat_A_RGTC1:
             return kHapFormatARGTC1;
+        case HapTextureFormat_RGBA_BPTC_UNORM:
+            return kHapFormatRGBABPTC;
+        case HapTextureFormat_RGB_BPTC_UNSIGNED_FLOAT:
+            return kHapFormatRGBBPTCUF;
+        case HapTextureFormat_RGB_BPTC_SIGNED_FLOAT:
+            return kHapFormatRGBBPTCSF;
         default:
             return 0;
     }
@@ -328,6 +401,142 @@ unsigned long HapMaxEncodedLength(unsigned int count,
     return total_length;
 }
 
+static int hap_compressor_is_supported(unsigned int compressor)
+{
+    switch (compressor) {
+        case HapCompressorNone:
+        case HapCompressorSnappy:
+#if HAP_ENABLE_LZ4
+        case HapCompressorLZ4:
+#endif
+#if HAP_ENABLE_ZSTD
+        case HapCompressorZstd:
+#endif
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static unsigned int hap_stored_compressor(unsigned int compressor)
+{
+    switch (compressor) {
+        case HapCompressorSnappy:
+            return kHapCompressorSnappy;
+        case HapCompressorLZ4:
+            return kHapCompressorLZ4;
+        case HapCompressorZstd:
+            return kHapCompressorZstd;
+        default:
+            return kHapCompressorNone;
+    }
+}
+
+/*
+ Compresses a chunk with one of the extension compressors into at most output_length bytes
+ Returns the compressed length, or 0 if the chunk doesn't fit (it should be stored uncompressed)
+ */
+static size_t hap_compress_extension(unsigned int compressor, const char *input, size_t input_length, char *output, size_t output_length)
+{
+#if HAP_ENABLE_LZ4
+    if (compressor == HapCompressorLZ4)
+    {
+        int result;
+        if (output_length <= 4 || input_length > LZ4_MAX_INPUT_SIZE)
+        {
+            return 0;
+        }
+        result = LZ4_compress_default(input, output + 4, (int)input_length, (int)(output_length - 4 < LZ4_MAX_INPUT_SIZE ? output_length - 4 : LZ4_MAX_INPUT_SIZE));
+        if (result <= 0)
+        {
+            return 0;
+        }
+        hap_write_4_byte_uint(output, (unsigned int)input_length);
+        return (size_t)result + 4;
+    }
+#endif
+#if HAP_ENABLE_ZSTD
+    if (compressor == HapCompressorZstd)
+    {
+        size_t result = ZSTD_compress(output, output_length, input, input_length, HAP_ZSTD_LEVEL);
+        return ZSTD_isError(result) ? 0 : result;
+    }
+#endif
+    (void)compressor;
+    (void)input;
+    (void)input_length;
+    (void)output;
+    (void)output_length;
+    return 0;
+}
+
+/*
+ Reads the uncompressed length of a chunk compressed with one of the extension compressors
+ Returns 0 if the chunk is broken or its compressor isn't enabled
+ */
+static int hap_extension_uncompressed_length(unsigned int compressor, const char *input, size_t input_length, size_t *result)
+{
+#if HAP_ENABLE_LZ4
+    if (compressor == kHapCompressorLZ4)
+    {
+        if (input_length < 4)
+        {
+            return 0;
+        }
+        *result = hap_read_4_byte_uint(input);
+        return 1;
+    }
+#endif
+#if HAP_ENABLE_ZSTD
+    if (compressor == kHapCompressorZstd)
+    {
+        unsigned long long length = ZSTD_getFrameContentSize(input, input_length);
+        if (length == ZSTD_CONTENTSIZE_UNKNOWN || length == ZSTD_CONTENTSIZE_ERROR || length > 0xFFFFFFFFU)
+        {
+            return 0;
+        }
+        *result = (size_t)length;
+        return 1;
+    }
+#endif
+    (void)compressor;
+    (void)input;
+    (void)input_length;
+    (void)result;
+    return 0;
+}
+
+/*
+ Decompresses a chunk compressed with one of the extension compressors into exactly output_length bytes
+ Returns 0 on failure
+ */
+static int hap_decompress_extension(unsigned int compressor, const char *input, size_t input_length, char *output, size_t output_length)
+{
+#if HAP_ENABLE_LZ4
+    if (compressor == kHapCompressorLZ4)
+    {
+        if (input_length < 4 || input_length - 4 > LZ4_MAX_INPUT_SIZE || output_length > LZ4_MAX_INPUT_SIZE)
+        {
+            return 0;
+        }
+        return LZ4_decompress_safe(input + 4, output, (int)(input_length - 4), (int)output_length) == (int)output_length;
+    }
+#endif
+#if HAP_ENABLE_ZSTD
+    if (compressor == kHapCompressorZstd)
+    {
+        size_t result = ZSTD_decompress(output, output_length, input, input_length);
+        return !ZSTD_isError(result) && result == output_length;
+    }
+#endif
+    (void)compressor;
+    (void)input;
+    (void)input_length;
+    (void)output;
+    (void)output_length;
+    return 0;
+}
+
 static unsigned int hap_encode_texture(const void *inputBuffer, unsigned long inputBufferBytes, unsigned int textureFormat,
                                        unsigned int compressor, unsigned int chunkCount, void *outputBuffer,
                                        unsigned long outputBufferBytes, unsigned long *outputBufferBytesUsed)
@@ -346,10 +555,11 @@ static unsigned int hap_encode_texture(const void *inputBuffer, unsigned long in
             && textureFormat != HapTextureFormat_RGBA_DXT5
             && textureFormat != HapTextureFormat_YCoCg_DXT5
             && textureFormat != HapTextureFormat_A_RGTC1
+            && textureFormat != HapTextureFormat_RGBA_BPTC_UNORM
+            && textureFormat != HapTextureFormat_RGB_BPTC_UNSIGNED_FLOAT
+            && textureFormat != HapTextureFormat_RGB_BPTC_SIGNED_FLOAT
             )
-        || (compressor != HapCompressorNone
-            && compressor != HapCompressorSnappy
-            )
+        || !hap_compressor_is_supported(compressor)
         || outputBuffer == NULL
         || outputBufferBytesUsed == NULL
         )
@@ -377,7 +587,7 @@ static unsigned int hap_encode_texture(const void *inputBuffer, unsigned long in
         top_section_header_length = 4U;
     }
 
-    if (compressor == HapCompressorSnappy)
+    if (compressor != HapCompressorNone)
     {
         /*
          We attempt to chunk as requested, and if resulting frame is larger than it is uncompressed then
@@ -429,6 +639,18 @@ static unsigned int hap_encode_texture(const void *inputBuffer, unsigned long in
                     return HapResult_Internal_Error;
                 }
             }
+            else
+            {
+                /*
+                 The output is limited to the chunk size, as the chunk is stored uncompressed when it doesn't shrink
+                 (the frame length limit assumes snappy)
+                 */
+                chunk_packed_length = hap_compress_extension(compressor, chunk_input_start, chunk_size, compressed_data, chunk_size);
+                if (chunk_packed_length == 0)
+                {
+                    chunk_packed_length = chunk_size;
+                }
+            }
 
             if (compressor == HapCompressorNone || chunk_packed_length >= chunk_size)
             {
@@ -439,8 +661,8 @@ static unsigned int hap_encode_texture(const void *inputBuffer, unsigned long in
             }
             else
             {
-                // ie we used snappy and saved some space
-                second_stage_compressor_table[i] = kHapCompressorSnappy;
+                // ie we used the compressor and saved some space
+                second_stage_compressor_table[i] = hap_stored_compressor(compressor);
             }
             hap_write_4_byte_uint(((uint8_t *)chunk_size_table) + (i * 4), chunk_packed_length);
             compressed_data += chunk_packed_length;
@@ -450,7 +672,7 @@ static unsigned int hap_encode_texture(const void *inputBuffer, unsigned long in
 
         if (top_section_length < inputBufferBytes + top_section_header_length)
         {
-            // use the complex storage because snappy compression saved space
+            // use the complex storage because compression saved space
             storedCompressor = kHapCompressorComplex;
         }
         else
@@ -576,16 +798,67 @@ unsigned int HapEncode(unsigned int count,
     }
 }
 
+/*
+ Copies length bytes to offset in rows of row_length bytes which are pitch bytes apart
+ */
+static void hap_copy_strided(char *base, size_t offset, size_t row_length, size_t pitch, const char *source, size_t length)
+{
+    size_t row = offset / row_length;
+    size_t column = offset % row_length;
+
+    while (length > 0)
+    {
+        size_t count = row_length - column < length ? row_length - column : length;
+        memcpy(base + row * pitch + column, source, count);
+        source += count;
+        length -= count;
+        row++;
+        column = 0;
+    }
+}
+
 static void hap_decode_chunk(HapChunkDecodeInfo chunks[], unsigned int index)
 {
     if (chunks)
     {
         if (chunks[index].compressor == kHapCompressorSnappy)
         {
-            snappy_status snappy_result = snappy_uncompress(chunks[index].compressed_chunk_data,
-                                                            chunks[index].compressed_chunk_size,
-                                                            chunks[index].uncompressed_chunk_data,
-                                                            &chunks[index].uncompressed_chunk_size);
+            snappy_status snappy_result;
+
+            if (chunks[index].trusted && chunks[index].row_length != 0)
+            {
+                snappy_result = snappy_uncompress_strided_trusted(chunks[index].compressed_chunk_data,
+                                                                  chunks[index].compressed_chunk_size,
+                                                                  chunks[index].output_base,
+                                                                  chunks[index].output_offset,
+                                                                  chunks[index].row_length,
+                                                                  chunks[index].output_pitch,
+                                                                  chunks[index].uncompressed_chunk_size);
+            }
+            else if (chunks[index].trusted)
+            {
+                snappy_result = snappy_uncompress_trusted(chunks[index].compressed_chunk_data,
+                                                          chunks[index].compressed_chunk_size,
+                                                          chunks[index].uncompressed_chunk_data,
+                                                          chunks[index].uncompressed_chunk_size);
+            }
+            else if (chunks[index].row_length != 0)
+            {
+                snappy_result = snappy_uncompress_strided(chunks[index].compressed_chunk_data,
+                                                          chunks[index].compressed_chunk_size,
+                                                          chunks[index].output_base,
+                                                          chunks[index].output_offset,
+                                                          chunks[index].row_length,
+                                                          chunks[index].output_pitch,
+                                                          &chunks[index].uncompressed_chunk_size);
+            }
+            else
+            {
+                snappy_result = snappy_uncompress(chunks[index].compressed_chunk_data,
+                                                  chunks[index].compressed_chunk_size,
+                                                  chunks[index].uncompressed_chunk_data,
+                                                  &chunks[index].uncompressed_chunk_size);
+            }
 
             switch (snappy_result)
             {
@@ -600,11 +873,65 @@ static void hap_decode_chunk(HapChunkDecodeInfo chunks[], unsigned int index)
                     break;
             }
         }
+        else if (chunks[index].compressor == kHapCompressorLZ4 || chunks[index].compressor == kHapCompressorZstd)
+        {
+            /*
+             Strided output goes through a temporary buffer
+             */
+            char *output = chunks[index].uncompressed_chunk_data;
+            if (chunks[index].row_length != 0)
+            {
+                output = (char *)malloc(chunks[index].uncompressed_chunk_size);
+            }
+
+            if (output == NULL)
+            {
+                chunks[index].result = HapResult_Internal_Error;
+            }
+            else if (hap_decompress_extension(chunks[index].compressor,
+                                              chunks[index].compressed_chunk_data,
+                                              chunks[index].compressed_chunk_size,
+                                              output,
+                                              chunks[index].uncompressed_chunk_size))
+            {
+                if (chunks[index].row_length != 0)
+                {
+                    hap_copy_strided(chunks[index].output_base,
+                                     chunks[index].output_offset,
+                                     chunks[index].row_length,
+                                     chunks[index].output_pitch,
+                                     output,
+                                     chunks[index].uncompressed_chunk_size);
+                }
+                chunks[index].result = HapResult_No_Error;
+            }
+            else
+            {
+                chunks[index].result = HapResult_Bad_Frame;
+            }
+
+            if (chunks[index].row_length != 0)
+            {
+                free(output);
+            }
+        }
         else if (chunks[index].compressor == kHapCompressorNone)
         {
-            memcpy(chunks[index].uncompressed_chunk_data,
-                   chunks[index].compressed_chunk_data,
-                   chunks[index].compressed_chunk_size);
+            if (chunks[index].row_length != 0)
+            {
+                hap_copy_strided(chunks[index].output_base,
+                                 chunks[index].output_offset,
+                                 chunks[index].row_length,
+                                 chunks[index].output_pitch,
+                                 chunks[index].compressed_chunk_data,
+                                 chunks[index].compressed_chunk_size);
+            }
+            else
+            {
+                memcpy(chunks[index].uncompressed_chunk_data,
+                       chunks[index].compressed_chunk_data,
+                       chunks[index].compressed_chunk_size);
+            }
             chunks[index].result = HapResult_No_Error;
         }
         else
@@ -614,10 +941,16 @@ static void hap_decode_chunk(HapChunkDecodeInfo chunks[], unsigned int index)
     }
 }
 
+/*
+ rowBytes is zero for a tightly packed output
+ trusted skips the validation of snappy-compressed data (see HapDecodeTrusted)
+ */
 unsigned int hap_decode_single_texture(const void *texture_section, uint32_t texture_section_length,
                                        unsigned int texture_section_type,
                                        HapDecodeCallback callback, void *info,
                                        void *outputBuffer, unsigned long outputBufferBytes,
+                                       unsigned long rowBytes, unsigned long outputPitch,
+                                       int trusted,
                                        unsigned long *outputBufferBytesUsed,
                                        unsigned int *outputBufferTextureFormat)
 {
@@ -625,6 +958,19 @@ unsigned int hap_decode_single_texture(const void *texture_section, uint32_t tex
     unsigned int textureFormat;
     unsigned int compressor;
     size_t bytesUsed = 0;
+    size_t outputCapacity = outputBufferBytes;
+
+    /*
+     With a strided output, the capacity is the number of bytes in the rows which fit in the buffer
+     */
+    if (rowBytes != 0)
+    {
+        if (outputPitch < rowBytes)
+        {
+            return HapResult_Bad_Arguments;
+        }
+        outputCapacity = outputBufferBytes < rowBytes ? 0 : ((outputBufferBytes - rowBytes) / outputPitch + 1) * rowBytes;
+    }
 
     /*
      One top-level section type describes texture-format and second-stage compression
@@ -785,16 +1131,32 @@ unsigned int hap_decode_single_texture(const void *texture_section, uint32_t tex
                         break;
                     }
                 }
+                else if (chunk_info[i].compressor == kHapCompressorLZ4 || chunk_info[i].compressor == kHapCompressorZstd)
+                {
+                    if (!hap_extension_uncompressed_length(chunk_info[i].compressor,
+                                                           chunk_info[i].compressed_chunk_data,
+                                                           chunk_info[i].compressed_chunk_size,
+                                                           &(chunk_info[i].uncompressed_chunk_size)))
+                    {
+                        result = HapResult_Bad_Frame;
+                        break;
+                    }
+                }
                 else
                 {
                     chunk_info[i].uncompressed_chunk_size = chunk_info[i].compressed_chunk_size;
                 }
 
-                chunk_info[i].uncompressed_chunk_data = (char *)(((uint8_t *)outputBuffer) + running_uncompressed_chunk_size);
+                chunk_info[i].uncompressed_chunk_data = rowBytes != 0 ? NULL : (char *)(((uint8_t *)outputBuffer) + running_uncompressed_chunk_size);
+                chunk_info[i].output_base = (char *)outputBuffer;
+                chunk_info[i].output_offset = running_uncompressed_chunk_size;
+                chunk_info[i].row_length = rowBytes;
+                chunk_info[i].output_pitch = outputPitch;
+                chunk_info[i].trusted = trusted;
                 running_uncompressed_chunk_size += chunk_info[i].uncompressed_chunk_size;
             }
 
-            if (result == HapResult_No_Error && running_uncompressed_chunk_size > outputBufferBytes)
+            if (result == HapResult_No_Error && running_uncompressed_chunk_size > outputCapacity)
             {
                 result = HapResult_Buffer_Too_Small;
             }
@@ -849,11 +1211,26 @@ unsigned int hap_decode_single_texture(const void *texture_section, uint32_t tex
         {
             return HapResult_Internal_Error;
         }
-        if (bytesUsed > outputBufferBytes)
+        if (bytesUsed > outputCapacity)
         {
             return HapResult_Buffer_Too_Small;
         }
-        snappy_result = snappy_uncompress((const char *)texture_section, texture_section_length, (char *)outputBuffer, &bytesUsed);
+        if (trusted && rowBytes != 0)
+        {
+            snappy_result = snappy_uncompress_strided_trusted((const char *)texture_section, texture_section_length, (char *)outputBuffer, 0, rowBytes, outputPitch, bytesUsed);
+        }
+        else if (trusted)
+        {
+            snappy_result = snappy_uncompress_trusted((const char *)texture_section, texture_section_length, (char *)outputBuffer, bytesUsed);
+        }
+        else if (rowBytes != 0)
+        {
+            snappy_result = snappy_uncompress_strided((const char *)texture_section, texture_section_length, (char *)outputBuffer, 0, rowBytes, outputPitch, &bytesUsed);
+        }
+        else
+        {
+            snappy_result = snappy_uncompress((const char *)texture_section, texture_section_length, (char *)outputBuffer, &bytesUsed);
+        }
         if (snappy_result != SNAPPY_OK)
         {
             return HapResult_Internal_Error;
@@ -865,11 +1242,18 @@ unsigned int hap_decode_single_texture(const void *texture_section, uint32_t tex
          Only one section is present containing a single block of uncompressed texture data
          */
         bytesUsed = texture_section_length;
-        if (texture_section_length > outputBufferBytes)
+        if (texture_section_length > outputCapacity)
         {
             return HapResult_Buffer_Too_Small;
         }
-        memcpy(outputBuffer, texture_section, texture_section_length);
+        if (rowBytes != 0)
+        {
+            hap_copy_strided((char *)outputBuffer, 0, rowBytes, outputPitch, (const char *)texture_section, texture_section_length);
+        }
+        else
+        {
+            memcpy(outputBuffer, texture_section, texture_section_length);
+        }
     }
     else
     {
@@ -947,12 +1331,14 @@ int hap_get_section_at_index(const void *input_buffer, uint32_t input_buffer_byt
     }
 }
 
-unsigned int HapDecode(const void *inputBuffer, unsigned long inputBufferBytes,
-                       unsigned int index,
-                       HapDecodeCallback callback, void *info,
-                       void *outputBuffer, unsigned long outputBufferBytes,
-                       unsigned long *outputBufferBytesUsed,
-                       unsigned int *outputBufferTextureFormat)
+static unsigned int hap_decode(const void *inputBuffer, unsigned long inputBufferBytes,
+                               unsigned int index,
+                               HapDecodeCallback callback, void *info,
+                               void *outputBuffer, unsigned long outputBufferBytes,
+                               unsigned long rowBytes, unsigned long outputPitch,
+                               int trusted,
+                               unsigned long *outputBufferBytesUsed,
+                               unsigned int *outputBufferTextureFormat)
 {
     int result = HapResult_No_Error;
     const void *section;
@@ -989,6 +1375,9 @@ unsigned int HapDecode(const void *inputBuffer, unsigned long inputBufferBytes,
                                            callback, info,
                                            outputBuffer,
                                            outputBufferBytes,
+                                           rowBytes,
+                                           outputPitch,
+                                           trusted,
                                            outputBufferBytesUsed,
                                            outputBufferTextureFormat);
     }
@@ -996,6 +1385,194 @@ unsigned int HapDecode(const void *inputBuffer, unsigned long inputBufferBytes,
     return result;
 }
 
+unsigned int HapDecode(const void *inputBuffer, unsigned long inputBufferBytes,
+                       unsigned int index,
+                       HapDecodeCallback callback, void *info,
+                       void *outputBuffer, unsigned long outputBufferBytes,
+                       unsigned long *outputBufferBytesUsed,
+                       unsigned int *outputBufferTextureFormat)
+{
+    return hap_decode(inputBuffer, inputBufferBytes, index, callback, info,
+                      outputBuffer, outputBufferBytes, 0, 0, 0,
+                      outputBufferBytesUsed, outputBufferTextureFormat);
+}
+
+unsigned int HapDecodeStrided(const void *inputBuffer, unsigned long inputBufferBytes,
+                              unsigned int index,
+                              HapDecodeCallback callback, void *info,
+                              void *outputBuffer, unsigned long outputBufferBytes,
+                              unsigned long rowBytes, unsigned long outputPitch,
+                              unsigned long *outputBufferBytesUsed,
+                              unsigned int *outputBufferTextureFormat)
+{
+    if (rowBytes == 0)
+    {
+        return HapResult_Bad_Arguments;
+    }
+    return hap_decode(inputBuffer, inputBufferBytes, index, callback, info,
+                      outputBuffer, outputBufferBytes, rowBytes, outputPitch, 0,
+                      outputBufferBytesUsed, outputBufferTextureFormat);
+}
+
+unsigned int HapDecodeTrusted(const void *inputBuffer, unsigned long inputBufferBytes,
+                              unsigned int index,
+                              HapDecodeCallback callback, void *info,
+                              void *outputBuffer, unsigned long outputBufferBytes,
+                              unsigned long rowBytes, unsigned long outputPitch,
+                              unsigned long *outputBufferBytesUsed,
+                              unsigned int *outputBufferTextureFormat)
+{
+    return hap_decode(inputBuffer, inputBufferBytes, index, callback, info,
+                      outputBuffer, outputBufferBytes, rowBytes, outputPitch, 1,
+                      outputBufferBytesUsed, outputBufferTextureFormat);
+}
+
+// Checks a texture section header and, when present in the buffer, its Decode Instructions Container
+static unsigned int hap_check_texture_section(const void *section, uint32_t available_length, uint32_t section_length, unsigned int section_type)
+{
+    uint32_t header_length;
+    uint32_t instructions_length;
+    unsigned int instructions_type;
+
+    if (hap_texture_format_constant_for_format_identifier(hap_bottom_4_bits(section_type)) == 0)
+    {
+        return HapResult_Bad_Frame;
+    }
+
+    switch (hap_top_4_bits(section_type))
+    {
+        case kHapCompressorNone:
+        case kHapCompressorSnappy:
+            return HapResult_No_Error;
+        case kHapCompressorComplex:
+            break;
+        default:
+            return HapResult_Bad_Frame;
+    }
+
+    /*
+     Without the Decode Instructions Container there is nothing more we can check
+     */
+    if (hap_parse_section_header(section, available_length, &header_length, &instructions_length, &instructions_type) != HapResult_No_Error)
+    {
+        return HapResult_No_Error;
+    }
+
+    if (instructions_type != kHapSectionDecodeInstructionsContainer
+        || header_length + instructions_length > section_length)
+    {
+        return HapResult_Bad_Frame;
+    }
+
+    if (header_length + instructions_length <= available_length)
+    {
+        /*
+         The chunk sizes must account for exactly the frame data following the instructions
+         */
+        const uint8_t *child = ((const uint8_t *)section) + header_length;
+        uint32_t remaining = instructions_length;
+        uint64_t chunk_total = 0;
+        int has_sizes = 0;
+        int has_offsets = 0;
+
+        while (remaining > 0)
+        {
+            uint32_t child_header_length;
+            uint32_t child_length;
+            unsigned int child_type;
+
+            if (hap_read_section_header(child, remaining, &child_header_length, &child_length, &child_type) != HapResult_No_Error)
+            {
+                return HapResult_Bad_Frame;
+            }
+
+            if (child_type == kHapSectionChunkSizeTable)
+            {
+                uint32_t i;
+                for (i = 0; i + 4 <= child_length; i += 4)
+                {
+                    chunk_total += hap_read_4_byte_uint(child + child_header_length + i);
+                }
+                has_sizes = 1;
+            }
+            else if (child_type == kHapSectionChunkOffsetTable)
+            {
+                has_offsets = 1;
+            }
+
+            child += child_header_length + child_length;
+            remaining -= child_header_length + child_length;
+        }
+
+        if (!has_sizes
+            || (!has_offsets && chunk_total != section_length - header_length - instructions_length))
+        {
+            return HapResult_Bad_Frame;
+        }
+    }
+
+    return HapResult_No_Error;
+}
+
+unsigned int HapGetFrameLength(const void *inputBuffer, unsigned long inputBufferBytes, unsigned long *outputFrameBytes)
+{
+    uint32_t header_length;
+    uint32_t section_length;
+    unsigned int section_type;
+    uint32_t available;
+    const uint8_t *section;
+    unsigned int result;
+
+    if (inputBuffer == NULL || outputFrameBytes == NULL)
+    {
+        return HapResult_Bad_Arguments;
+    }
+
+    available = inputBufferBytes > 0xFFFFFFFFUL ? 0xFFFFFFFFU : (uint32_t)inputBufferBytes;
+
+    result = hap_parse_section_header(inputBuffer, available, &header_length, &section_length, &section_type);
+    if (result != HapResult_No_Error)
+    {
+        return result;
+    }
+
+    section = ((const uint8_t *)inputBuffer) + header_length;
+    available = available > header_length ? available - header_length : 0;
+
+    if (section_type == kHapSectionMultipleImages)
+    {
+        /*
+         Check the first texture in the frame
+         */
+        uint32_t child_header_length;
+        uint32_t child_length;
+        unsigned int child_type;
+
+        if (hap_parse_section_header(section, available, &child_header_length, &child_length, &child_type) == HapResult_No_Error)
+        {
+            if (child_header_length + child_length > section_length)
+            {
+                return HapResult_Bad_Frame;
+            }
+            available -= child_header_length;
+            result = hap_check_texture_section(section + child_header_length,
+                                               available < child_length ? available : child_length,
+                                               child_length, child_type);
+        }
+    }
+    else
+    {
+        result = hap_check_texture_section(section, available < section_length ? available : section_length, section_length, section_type);
+    }
+
+    if (result == HapResult_No_Error)
+    {
+        *outputFrameBytes = (unsigned long)header_length + section_length;
+    }
+
+    return result;
+}
+
 unsigned int HapGetFrameTextureCount(const void *inputBuffer, unsigned long inputBufferBytes, unsigned int *outputTextureCount)
 {
     int result;
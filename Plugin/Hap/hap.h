@@ -41,12 +41,21 @@ enum HapTextureFormat {
     HapTextureFormat_RGB_DXT1 = 0x83F0,
     HapTextureFormat_RGBA_DXT5 = 0x83F3,
     HapTextureFormat_YCoCg_DXT5 = 0x01,
-    HapTextureFormat_A_RGTC1 = 0x8DBB
+    HapTextureFormat_A_RGTC1 = 0x8DBB,
+    HapTextureFormat_RGBA_BPTC_UNORM = 0x8E8C,
+    HapTextureFormat_RGB_BPTC_UNSIGNED_FLOAT = 0x8E8F,
+    HapTextureFormat_RGB_BPTC_SIGNED_FLOAT = 0x8E8E
 };
 
+/*
+ HapCompressorLZ4 and HapCompressorZstd are extensions to the Hap specification, only available when the library is
+ built with HAP_ENABLE_LZ4 or HAP_ENABLE_ZSTD. Frames encoded with them can't be decoded by other Hap decoders.
+ */
 enum HapCompressor {
     HapCompressorNone,
-    HapCompressorSnappy
+    HapCompressorSnappy,
+    HapCompressorLZ4,
+    HapCompressorZstd
 };
 
 enum HapResult {
@@ -133,6 +142,37 @@ unsigned int HapDecode(const void *inputBuffer, unsigned long inputBufferBytes,
                        unsigned long *outputBufferBytesUsed,
                        unsigned int *outputBufferTextureFormat);
 
+/*
+ Decodes a texture in the same way as HapDecode, but stores it in rows of rowBytes bytes (one row of blocks, ie four
+ lines of pixels), each outputPitch bytes apart from the previous one, starting at outputBuffer. Use this to decode
+ straight into mapped texture memory or a region of a larger texture.
+ outputBufferBytes is the size of the memory from outputBuffer, so (outputBufferBytes - rowBytes) / outputPitch + 1 rows
+ are available.
+ If outputBufferBytesUsed is not NULL then it will be set to the decoded length in the tightly packed layout.
+ */
+unsigned int HapDecodeStrided(const void *inputBuffer, unsigned long inputBufferBytes,
+                              unsigned int index,
+                              HapDecodeCallback callback, void *info,
+                              void *outputBuffer, unsigned long outputBufferBytes,
+                              unsigned long rowBytes, unsigned long outputPitch,
+                              unsigned long *outputBufferBytesUsed,
+                              unsigned int *outputBufferTextureFormat);
+
+/*
+ Decodes a texture in the same way as HapDecode (rowBytes zero) or HapDecodeStrided (rowBytes non-zero), but skips the
+ validation of snappy-compressed data. The length of each chunk is read once and used as is, and the copies inside a
+ chunk aren't checked against the bounds of the output. The frame structure and the total length are still checked.
+ Only use this for frames which are known to be intact (for example verified against a stored checksum): a corrupted
+ frame can make it write out of the output buffer.
+ */
+unsigned int HapDecodeTrusted(const void *inputBuffer, unsigned long inputBufferBytes,
+                              unsigned int index,
+                              HapDecodeCallback callback, void *info,
+                              void *outputBuffer, unsigned long outputBufferBytes,
+                              unsigned long rowBytes, unsigned long outputPitch,
+                              unsigned long *outputBufferBytesUsed,
+                              unsigned int *outputBufferTextureFormat);
+
 /*
  If this returns HapResult_No_Error then outputTextureCount is set to the count of textures in the frame.
  */
@@ -143,6 +183,15 @@ unsigned int HapGetFrameTextureCount(const void *inputBuffer, unsigned long inpu
  */
 unsigned int HapGetFrameTextureFormat(const void *inputBuffer, unsigned long inputBufferBytes, unsigned int index, unsigned int *outputBufferTextureFormat);
 
+/*
+ Checks the header of a Hap frame without requiring the whole frame to be present in inputBuffer, and on success sets
+ outputFrameBytes to the total length of the frame including its header.
+ inputBuffer should hold at least the first eight bytes of the frame. Any further bytes present are used to validate the
+ frame's decode instructions, which makes it possible to locate frames in a stream that has lost its container index.
+ Returns HapResult_Bad_Frame if the data does not look like the start of a Hap frame.
+ */
+unsigned int HapGetFrameLength(const void *inputBuffer, unsigned long inputBufferBytes, unsigned long *outputFrameBytes);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,5 +1,12 @@
+# Optional second-stage compressors (non-standard Hap extension), enabled with
+# HAP_LZ4=1 and/or HAP_ZSTD=1 in the environment. They need liblz4/libzstd.
+EXT_FLAGS=""
+EXT_LIBS=""
+if [ -n "$HAP_LZ4" ]; then EXT_FLAGS="$EXT_FLAGS -DHAP_ENABLE_LZ4=1"; EXT_LIBS="$EXT_LIBS -llz4"; fi
+if [ -n "$HAP_ZSTD" ]; then EXT_FLAGS="$EXT_FLAGS -DHAP_ENABLE_ZSTD=1"; EXT_LIBS="$EXT_LIBS -lzstd"; fi
+
 gcc -Wall -Wno-switch -Wno-unknown-pragmas -Wno-unused-result \
-    -O2 -fPIC -Wl,--gc-sections \
+    -O2 -fPIC -Wl,--gc-sections $EXT_FLAGS \
     -I../Hap \
     -I../MP4 \
     -I../Snappy \
@@ -12,5 +19,5 @@ gcc -Wall -Wno-switch -Wno-unknown-pragmas -Wno-unused-result \
     ../Snappy/snappy-stubs-internal.cc \
     ../Snappy/snappy.cc \
     ../Source/KlakHap.cpp \
-    -lstdc++ \
+    -lstdc++ $EXT_LIBS \
     -shared -o libKlakHap.so
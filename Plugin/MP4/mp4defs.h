@@ -222,7 +222,9 @@ enum
     BOX_Hap5    = FOUR_CHAR_INT( 'H', 'a', 'p', '5' ),
     BOX_HapY    = FOUR_CHAR_INT( 'H', 'a', 'p', 'Y' ),
     BOX_HapM    = FOUR_CHAR_INT( 'H', 'a', 'p', 'M' ),
-    BOX_HapA    = FOUR_CHAR_INT( 'H', 'a', 'p', 'A' )
+    BOX_HapA    = FOUR_CHAR_INT( 'H', 'a', 'p', 'A' ),
+    BOX_Hap7    = FOUR_CHAR_INT( 'H', 'a', 'p', '7' ),
+    BOX_HapH    = FOUR_CHAR_INT( 'H', 'a', 'p', 'H' )
 };
 
 #endif //mp4defs_H_INCLUDED
@@ -137,10 +137,38 @@ static void mp4d_skip_bytes(FILE * f, mp4d_size_t skip, int * eof_flag)
 /*      Exported API functions                                          */
 /************************************************************************/
 
+/**
+*   Check if given sample entry type is one of the Hap subtypes
+*/
+static int mp4d_is_hap_entry(unsigned type)
+{
+    return type == BOX_Hap1 || type == BOX_Hap5 || type == BOX_HapY ||
+           type == BOX_HapM || type == BOX_HapA || type == BOX_Hap7 ||
+           type == BOX_HapH;
+}
+
+/**
+*   Check if given box is a sample table box, which allocates memory
+*/
+static int mp4d_is_sample_table(uint32_t box_name)
+{
+    return box_name == BOX_stsz || box_name == BOX_stz2 || box_name == BOX_stsc ||
+           box_name == BOX_stts || box_name == BOX_ctts ||
+           box_name == BOX_stco || box_name == BOX_co64;
+}
+
 /**
 *   Parse given file as MP4 file.  Allocate and store data indexes.
 */
 int MP4D__open(MP4D_demux_t * mp4, FILE * f)
+{
+    return MP4D__open_ex(mp4, f, 0);
+}
+
+/**
+*   Parse given file as MP4 file with parsing options.
+*/
+int MP4D__open_ex(MP4D_demux_t * mp4, FILE * f, unsigned flags)
 {
     int depth = 0;              // box stack size
 
@@ -160,6 +188,8 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
     unsigned i;
     MP4D_track_t * tr = NULL;
     int read_hdlr = 0;
+    int read_entry = 0;         // next box is a sample entry in 'stsd'
+    int video_track = -1;       // selected track in MP4D_OPEN_HAP_VIDEO_ONLY mode
 
 #if MP4D_DEBUG_TRACE
     // path of current element: List0/List1/... etc
@@ -351,6 +381,40 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
             stack[depth].bytes -= box_bytes;
         }
 
+        // The first box in 'stsd' is the sample entry
+        if (read_entry)
+        {
+            if (tr)
+            {
+                tr->sample_entry_type = box_name;
+            }
+            read_entry = 0;
+        }
+
+        // Video-only mode: the sample tables of tracks other than the first
+        // Hap video track, and the user data box are skipped as unknown boxes
+        if (flags & MP4D_OPEN_HAP_VIDEO_ONLY)
+        {
+            if (tr && mp4d_is_sample_table(box_name))
+            {
+                int ntrack = (int)(tr - mp4->track);
+                if (video_track < 0 &&
+                    tr->handler_type == MP4_HANDLER_TYPE_VIDE &&
+                    mp4d_is_hap_entry(tr->sample_entry_type))
+                {
+                    video_track = ntrack;
+                }
+                if (video_track != ntrack)
+                {
+                    box_name = 0;
+                }
+            }
+            else if (box_name == BOX_udta)
+            {
+                box_name = 0;
+            }
+        }
+
         // Read box header
         switch(box_name)
         {
@@ -430,6 +494,7 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
                         ts += d;
                     }
                 }
+                tr->timestamp_count = k;
             }
             break;
 
@@ -524,6 +589,7 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
 
         case BOX_stsd:
             SKIP(4); // entry_count, BOX_mp4a & BOX_mp4v boxes follows immediately
+            read_entry = 1;
             break;
 
         case BOX_mp4s:  // private stream
@@ -551,6 +617,8 @@ int MP4D__open(MP4D_demux_t * mp4, FILE * f)
         case BOX_HapY:
         case BOX_HapM:
         case BOX_HapA:
+        case BOX_Hap7:
+        case BOX_HapH:
 
         // vvvvvvvvvvvvv AVC support vvvvvvvvvvvvv
         case BOX_avc1:  // AVCSampleEntry extends VisualSampleEntry 
@@ -144,6 +144,9 @@ typedef struct
     // case 0x09: return "MPEGJStream";
     unsigned stream_type;
 
+    // Four-character code of the sample entry in 'stsd' ('avc1', 'Hap1', etc.)
+    unsigned sample_entry_type;
+
     union
     {
         // for handler_type == 'soun' tracks
@@ -167,6 +170,7 @@ typedef struct
     unsigned *entry_size;   // [sample_count]
     unsigned *timestamp;    // [sample_count]
     unsigned *duration;     // [sample_count]
+    unsigned timestamp_count;   // number of entries in timestamp/duration (from stts)
 
     unsigned sample_to_chunk_count;
     MP4D_sample_to_chunk_t * sample_to_chunk;    // [sample_to_chunk_count]
@@ -225,6 +229,23 @@ typedef struct MP4D_demux_tag
 int MP4D__open(MP4D_demux_t * mp4, FILE * f);
 
 
+/**
+*   Flags for MP4D__open_ex()
+*
+*   MP4D_OPEN_HAP_VIDEO_ONLY - Only allocate and parse the sample tables of
+*   the first video track with a Hap sample entry. The other tracks are still
+*   listed in mp4->track, but their sample_count is zero. Metadata tags
+*   ('udta' box) are skipped.
+*/
+#define MP4D_OPEN_HAP_VIDEO_ONLY    1
+
+
+/**
+*   Same as MP4D__open(), with parsing options given by flags.
+*/
+int MP4D__open_ex(MP4D_demux_t * mp4, FILE * f, unsigned flags);
+
+
 /**
 *   Return position and size for given sample from given track. The 'sample' is a
 *   MP4 term for 'frame'
@@ -29,6 +29,37 @@
 #include "snappy.h"
 #include "snappy-c.h"
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Scratch buffer for the strided variants
+char* strided_scratch(size_t length) {
+  static thread_local std::vector<char> scratch;
+  if (scratch.size() < length) {
+    scratch.resize(length);
+  }
+  return scratch.data();
+}
+
+// Stores "length" bytes from "source" into rows of "row_length" bytes, each
+// "pitch" bytes apart, as if they started "offset" bytes into a packed image.
+void scatter_rows(const char* source, size_t length, char* uncompressed,
+                  size_t offset, size_t row_length, size_t pitch) {
+  size_t row = offset / row_length;
+  size_t column = offset % row_length;
+  for (size_t left = length; left > 0; row++, column = 0) {
+    size_t count = std::min(row_length - column, left);
+    std::memcpy(uncompressed + row * pitch + column, source, count);
+    source += count;
+    left -= count;
+  }
+}
+
+}  // namespace
+
 extern "C" {
 
 snappy_status snappy_compress(const char* input,
@@ -62,6 +93,65 @@ snappy_status snappy_uncompress(const char* compressed,
   return SNAPPY_OK;
 }
 
+snappy_status snappy_uncompress_strided(const char* compressed,
+                                        size_t compressed_length,
+                                        char* uncompressed,
+                                        size_t offset,
+                                        size_t row_length,
+                                        size_t pitch,
+                                        size_t* uncompressed_length) {
+  size_t real_uncompressed_length;
+  if (!snappy::GetUncompressedLength(compressed,
+                                     compressed_length,
+                                     &real_uncompressed_length)) {
+    return SNAPPY_INVALID_INPUT;
+  }
+  if (*uncompressed_length < real_uncompressed_length || row_length == 0) {
+    return SNAPPY_BUFFER_TOO_SMALL;
+  }
+
+  // Uncompress into a scratch buffer, then scatter it into the rows.
+  char* scratch = strided_scratch(real_uncompressed_length);
+  if (!snappy::RawUncompress(compressed, compressed_length, scratch)) {
+    return SNAPPY_INVALID_INPUT;
+  }
+  scatter_rows(scratch, real_uncompressed_length,
+               uncompressed, offset, row_length, pitch);
+  *uncompressed_length = real_uncompressed_length;
+  return SNAPPY_OK;
+}
+
+snappy_status snappy_uncompress_trusted(const char* compressed,
+                                        size_t compressed_length,
+                                        char* uncompressed,
+                                        size_t uncompressed_length) {
+  if (!snappy::RawUncompressTrusted(compressed, compressed_length,
+                                    uncompressed, uncompressed_length)) {
+    return SNAPPY_INVALID_INPUT;
+  }
+  return SNAPPY_OK;
+}
+
+snappy_status snappy_uncompress_strided_trusted(const char* compressed,
+                                                size_t compressed_length,
+                                                char* uncompressed,
+                                                size_t offset,
+                                                size_t row_length,
+                                                size_t pitch,
+                                                size_t uncompressed_length) {
+  if (row_length == 0) {
+    return SNAPPY_BUFFER_TOO_SMALL;
+  }
+  char* scratch = strided_scratch(uncompressed_length);
+  if (!snappy::RawUncompressTrusted(compressed, compressed_length,
+                                    scratch, uncompressed_length)) {
+    return SNAPPY_INVALID_INPUT;
+  }
+  scatter_rows(scratch, uncompressed_length,
+               uncompressed, offset, row_length, pitch);
+  return SNAPPY_OK;
+}
+
 size_t snappy_max_compressed_length(size_t source_length) {
   return snappy::MaxCompressedLength(source_length);
 }
@@ -105,6 +105,51 @@ snappy_status snappy_uncompress(const char* compressed,
                                 char* uncompressed,
                                 size_t* uncompressed_length);
 
+/*
+ * Same as snappy_uncompress, but stores the uncompressed data into rows of
+ * "row_length" bytes, each "pitch" bytes apart from the previous one, with
+ * "uncompressed" pointing to the first row. The data is placed as if it
+ * started "offset" bytes into a tightly packed image, so that a stream
+ * holding a part of an image can be stored at its position in the rows.
+ *
+ * <uncompressed_length> signals the space available from "offset" (in the
+ * packed byte count). After successful decompression, it contains the true
+ * length of the decompressed output.
+ */
+snappy_status snappy_uncompress_strided(const char* compressed,
+                                        size_t compressed_length,
+                                        char* uncompressed,
+                                        size_t offset,
+                                        size_t row_length,
+                                        size_t pitch,
+                                        size_t* uncompressed_length);
+
+/*
+ * Same as snappy_uncompress, but skips the validation of the compressed
+ * data. For data that is known to be intact (e.g. verified against a stored
+ * checksum) only: The uncompressed length is given by the caller (usually
+ * from snappy_uncompressed_length), and the output buffer must hold
+ * "uncompressed_length" bytes. Corrupted input can make it write out of the
+ * buffer. Returns SNAPPY_INVALID_INPUT when the length doesn't match the
+ * decompressed data (detected after the fact).
+ */
+snappy_status snappy_uncompress_trusted(const char* compressed,
+                                        size_t compressed_length,
+                                        char* uncompressed,
+                                        size_t uncompressed_length);
+
+/*
+ * Strided version of snappy_uncompress_trusted (see
+ * snappy_uncompress_strided)
+ */
+snappy_status snappy_uncompress_strided_trusted(const char* compressed,
+                                                size_t compressed_length,
+                                                char* uncompressed,
+                                                size_t offset,
+                                                size_t row_length,
+                                                size_t pitch,
+                                                size_t uncompressed_length);
+
 /*
  * Returns the maximal size of the compressed representation of
  * input data that is "source_length" bytes in length.
@@ -225,6 +225,67 @@ static const uint16 char_table[256] = {
   0x1801, 0x0f0a, 0x103f, 0x203f, 0x2001, 0x0f0b, 0x1040, 0x2040
 };
 
+// Length minus offset for each tag byte, used by the branchless
+// decompression loop. Literals get a fake offset of 256, so that the value is
+// always negative for them. Long literals and copies with a 4-byte offset
+// are flagged with 0xff; the branchless loop leaves them to the regular one.
+//
+//   literal:  length - 256
+//   copy-1:   length - (offset / 256) * 256
+//   copy-2:   length
+static const int16 length_minus_offset_table[256] = {
+   -255,     4,     1,   255,  -254,     5,     2,   255,
+   -253,     6,     3,   255,  -252,     7,     4,   255,
+   -251,     8,     5,   255,  -250,     9,     6,   255,
+   -249,    10,     7,   255,  -248,    11,     8,   255,
+   -247,  -252,     9,   255,  -246,  -251,    10,   255,
+   -245,  -250,    11,   255,  -244,  -249,    12,   255,
+   -243,  -248,    13,   255,  -242,  -247,    14,   255,
+   -241,  -246,    15,   255,  -240,  -245,    16,   255,
+   -239,  -508,    17,   255,  -238,  -507,    18,   255,
+   -237,  -506,    19,   255,  -236,  -505,    20,   255,
+   -235,  -504,    21,   255,  -234,  -503,    22,   255,
+   -233,  -502,    23,   255,  -232,  -501,    24,   255,
+   -231,  -764,    25,   255,  -230,  -763,    26,   255,
+   -229,  -762,    27,   255,  -228,  -761,    28,   255,
+   -227,  -760,    29,   255,  -226,  -759,    30,   255,
+   -225,  -758,    31,   255,  -224,  -757,    32,   255,
+   -223, -1020,    33,   255,  -222, -1019,    34,   255,
+   -221, -1018,    35,   255,  -220, -1017,    36,   255,
+   -219, -1016,    37,   255,  -218, -1015,    38,   255,
+   -217, -1014,    39,   255,  -216, -1013,    40,   255,
+   -215, -1276,    41,   255,  -214, -1275,    42,   255,
+   -213, -1274,    43,   255,  -212, -1273,    44,   255,
+   -211, -1272,    45,   255,  -210, -1271,    46,   255,
+   -209, -1270,    47,   255,  -208, -1269,    48,   255,
+   -207, -1532,    49,   255,  -206, -1531,    50,   255,
+   -205, -1530,    51,   255,  -204, -1529,    52,   255,
+   -203, -1528,    53,   255,  -202, -1527,    54,   255,
+   -201, -1526,    55,   255,  -200, -1525,    56,   255,
+   -199, -1788,    57,   255,  -198, -1787,    58,   255,
+   -197, -1786,    59,   255,  -196, -1785,    60,   255,
+    255, -1784,    61,   255,   255, -1783,    62,   255,
+    255, -1782,    63,   255,   255, -1781,    64,   255
+};
+
+// Decompression kernels. The fastest one supported by the CPU is selected at
+// startup; The others can be forced for benchmarking and for validating the
+// SIMD kernels against the reference loop.
+enum DecompressionKernel {
+  kDecompressReference,  // Original tag-by-tag loop
+  kDecompressScalar,     // Branchless loop, portable code
+  kDecompressSSSE3,      // Branchless loop, PSHUFB pattern expansion
+  kDecompressAVX2,       // SSSE3 + 32-byte copies
+  kDecompressNEON,       // Branchless loop, TBL pattern expansion
+};
+
+DecompressionKernel GetDecompressionKernel();
+
+// Returns false (and keeps the current kernel) when the kernel isn't
+// supported by the build or the CPU. Not thread-safe; Only call it while no
+// decompression is running.
+bool SetDecompressionKernel(DecompressionKernel kernel);
+
 }  // end namespace internal
 }  // end namespace snappy
 
@@ -68,6 +68,44 @@
 #include <immintrin.h>
 #endif
 
+// Decompression kernels selected at runtime. GCC and Clang compile them with
+// function-level target attributes, so the build doesn't need -mssse3 or
+// -mavx2. MSVC allows SSSE3 intrinsics anywhere, but can't generate AVX2 code
+// for a single function, so the AVX2 kernel isn't available there.
+#if !defined(SNAPPY_DISPATCH_X86)
+#if defined(__x86_64__) || defined(_M_X64)
+#define SNAPPY_DISPATCH_X86 1
+#else
+#define SNAPPY_DISPATCH_X86 0
+#endif
+#endif  // !defined(SNAPPY_DISPATCH_X86)
+
+#if SNAPPY_DISPATCH_X86 && (defined(__GNUC__) || defined(__clang__))
+#define SNAPPY_DISPATCH_AVX2 1
+#define SNAPPY_TARGET(isa) __attribute__((target(isa)))
+#define SNAPPY_TARGET_FLATTEN(isa) __attribute__((target(isa), flatten))
+#else
+#define SNAPPY_DISPATCH_AVX2 0
+#define SNAPPY_TARGET(isa)
+#define SNAPPY_TARGET_FLATTEN(isa)
+#endif
+
+#if SNAPPY_DISPATCH_X86 && !SNAPPY_HAVE_SSSE3
+#include <tmmintrin.h>
+#endif
+
+#if !defined(SNAPPY_HAVE_NEON)
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define SNAPPY_HAVE_NEON 1
+#else
+#define SNAPPY_HAVE_NEON 0
+#endif
+#endif  // !defined(SNAPPY_HAVE_NEON)
+
+#if SNAPPY_HAVE_NEON
+#include <arm_neon.h>
+#endif
+
 #include <stdio.h>
 
 #include <algorithm>
@@ -81,6 +119,7 @@ using internal::COPY_1_BYTE_OFFSET;
 using internal::COPY_2_BYTE_OFFSET;
 using internal::LITERAL;
 using internal::char_table;
+using internal::length_minus_offset_table;
 using internal::kMaximumTagLength;
 
 // Any hash function will produce a valid compressed bitstream, but a good
@@ -332,8 +371,389 @@ inline char* IncrementalCopy(const char* src, char* op, char* const op_limit,
   return IncrementalCopySlow(src, op, op_limit);
 }
 
+// -----------------------------------------------------------------------
+// Branchless decompression loop
+// -----------------------------------------------------------------------
+//
+// The tag-by-tag loop in SnappyDecompressor::DecompressAllTags() branches on
+// the type and length of every element, which is poorly predictable on real
+// data. This loop handles literals, copy-1 and copy-2 elements with a single
+// code path: The length and the offset are looked up from
+// length_minus_offset_table, and every element is moved with fixed-size 32-
+// or 64-byte copies of which only the first <length> bytes are kept. The next
+// tag is loaded before the current element is copied.
+//
+// That needs kSlopBytes of readable input and kElementSlopBytes of writable
+// output past the current element, so the loop only runs on the bulk of the
+// data. Long literals, copy-4 elements, invalid copies and the tail of the
+// input are left to the tag-by-tag loop.
+//
+// The loop is compiled for several instruction sets and the fastest one
+// supported by the CPU is selected at startup (see SetDecompressionKernel).
+
+const ptrdiff_t kSlopBytes = 64;
+
+// A pattern expansion writes up to 16 bytes more than a copy.
+const ptrdiff_t kElementSlopBytes = kSlopBytes + 16;
+
+// Moves ip past the next tag and loads it into *tag. ip points just past the
+// current tag on entry. Returns the type of the current tag.
+inline size_t AdvanceToNextTag(const uint8** ip_p, size_t* tag) {
+  const uint8*& ip = *ip_p;
+  const size_t literal_len = *tag >> 2;
+  const size_t tag_type = *tag & 3;
+  // Both candidates are loaded before the selection, which shortens the
+  // dependency chain on ip. volatile keeps the compiler from turning this
+  // back into a select followed by a load. The loads are in the slop.
+  const size_t tag_literal =
+      static_cast<const volatile uint8*>(ip)[1 + literal_len];
+  const size_t tag_copy = static_cast<const volatile uint8*>(ip)[tag_type];
+  // The selection is done with a mask, as compilers tend to turn a
+  // conditional into a (poorly predictable) branch here.
+  const size_t literal_mask = static_cast<size_t>(0) - (tag_type == 0);
+  *tag = tag_copy ^ ((tag_copy ^ tag_literal) & literal_mask);
+  ip += 1 + tag_type + ((literal_len + 1) & literal_mask);
+  return tag_type;
+}
+
+// Offset bytes stored after the tag (zero for literals)
+inline uint32 ExtractOffset(uint32 val, size_t tag_type) {
+  static const uint32 kExtractMasks[4] = {0, 0xff, 0xffff, 0};
+  return val & kExtractMasks[tag_type];
+}
+
+// Copies 32 bytes. The source may overlap the destination; It's read
+// completely before the destination is written.
+inline void UnalignedMove256(const char* src, char* dst) {
+  // Separate temporaries, so that they're kept in registers.
+  char a[16], b[16];
+  memcpy(a, src, 16);
+  memcpy(b, src + 16, 16);
+  memcpy(dst, a, 16);
+  memcpy(dst + 16, b, 16);
+}
+
+// Copies an element of up to 64 bytes, overwriting the output up to 64
+// bytes past dst. The source has to be at least <len> bytes before dst
+// (or in the input). Most elements are short, so the second half is only
+// copied when needed.
+inline void CopyElement(const char* src, char* dst, size_t len) {
+  UnalignedMove256(src, dst);
+  if (SNAPPY_PREDICT_FALSE(len > 32)) UnalignedMove256(src + 32, dst + 32);
+}
+
+// Shuffle masks that repeat the first <index> bytes of a vector, and the
+// largest multiple of <index> that fits in a vector. Used by the SIMD
+// pattern expansions.
+alignas(16) const uint8 pattern_shuffle_masks[16][16] = {
+  {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1},
+  {0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0},
+  {0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3},
+  {0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0},
+  {0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3},
+  {0, 1, 2, 3, 4, 5, 6, 0, 1, 2, 3, 4, 5, 6, 0, 1},
+  {0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 0, 1, 2, 3, 4, 5, 6},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 0, 1, 2, 3, 4},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0, 1, 2, 3},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 0, 1, 2},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 0, 1},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 0},
+};
+
+const uint8 pattern_vector_sizes[16] = {
+  0, 16, 16, 15, 16, 15, 12, 14, 16, 9, 10, 11, 12, 13, 14, 15
+};
+
+// Pattern expansion for copies that overlap their own output
+// (0 < offset < length <= 64). Writes up to kElementSlopBytes from dst.
+struct PatternCopyScalar {
+  static inline void Copy(char* dst, size_t offset) {
+    if (SNAPPY_PREDICT_TRUE(offset < 16)) {
+      // Smallest multiple of the pattern that's larger than 16
+      static const uint8 kPatternSizes[16] = {
+        0, 17, 18, 18, 20, 20, 18, 21, 24, 18, 20, 22, 24, 26, 28, 30
+      };
+      for (int i = 0; i < 16; i++) dst[i] = dst[i - offset];
+      offset = kPatternSizes[offset];
+      for (int i = 16; i < 64; i += 16)
+        UnalignedCopy128(dst + i - offset, dst + i);
+      return;
+    }
+    for (int i = 0; i < 64; i += 16)
+      UnalignedCopy128(dst + i - offset, dst + i);
+  }
+};
+
+#if SNAPPY_DISPATCH_X86
+
+struct PatternCopySSSE3 {
+  SNAPPY_TARGET("ssse3")
+  static inline void Copy(char* dst, size_t offset) {
+    if (SNAPPY_PREDICT_TRUE(offset < 16)) {
+      // The bytes after the pattern are masked out by the shuffle mask.
+      const __m128i mask = _mm_load_si128(
+          reinterpret_cast<const __m128i*>(pattern_shuffle_masks[offset]));
+      const __m128i pattern = _mm_shuffle_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst - offset)),
+          mask);
+      SNAPPY_ANNOTATE_MEMORY_IS_INITIALIZED(&pattern, sizeof(pattern));
+      const size_t step = pattern_vector_sizes[offset];
+      for (size_t i = 0; i < 64; i += step)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), pattern);
+      return;
+    }
+    for (int i = 0; i < 64; i += 16)
+      UnalignedCopy128(dst + i - offset, dst + i);
+  }
+};
+
+#endif  // SNAPPY_DISPATCH_X86
+
+#if SNAPPY_HAVE_NEON
+
+struct PatternCopyNEON {
+  static inline void Copy(char* dst, size_t offset) {
+    if (SNAPPY_PREDICT_TRUE(offset < 16)) {
+      const uint8x16_t pattern = vqtbl1q_u8(
+          vld1q_u8(reinterpret_cast<const uint8*>(dst - offset)),
+          vld1q_u8(pattern_shuffle_masks[offset]));
+      const size_t step = pattern_vector_sizes[offset];
+      for (size_t i = 0; i < 64; i += step)
+        vst1q_u8(reinterpret_cast<uint8*>(dst + i), pattern);
+      return;
+    }
+    for (int i = 0; i < 64; i += 16)
+      UnalignedCopy128(dst + i - offset, dst + i);
+  }
+};
+
+#endif  // SNAPPY_HAVE_NEON
+
+// Decompresses [ip, ip_limit) into base + *op_p while there's enough slop
+// before ip_limit in the input and before op_limit in the output. Returns
+// the position of the first tag that's left to the tag-by-tag loop, and
+// stores the new output position in *op_p.
+template <class PatternCopy>
+inline const char* DecompressBranchless(const char* ip_start,
+                                        const char* ip_limit, char* base,
+                                        ptrdiff_t* op_p, ptrdiff_t op_limit) {
+  const uint8* ip = reinterpret_cast<const uint8*>(ip_start) + 1;
+  const uint8* const ip_limit_min_slop =
+      reinterpret_cast<const uint8*>(ip_limit) - kSlopBytes - 1;
+  const ptrdiff_t op_limit_min_slop = op_limit - kElementSlopBytes;
+  ptrdiff_t op = *op_p;
+
+  // ip points just past the tag of the current element.
+  size_t tag = ip[-1];
+  while (ip < ip_limit_min_slop && op < op_limit_min_slop) {
+    const uint8* old_ip = ip;
+    ptrdiff_t len_min_offset = length_minus_offset_table[tag];
+    const size_t tag_type = AdvanceToNextTag(&ip, &tag);
+    const uint32 next = LittleEndian::Load32(old_ip);
+    const size_t len = len_min_offset & 0xff;
+    len_min_offset -= ExtractOffset(next, tag_type);
+
+    if (SNAPPY_PREDICT_FALSE(len_min_offset > 0)) {
+      // Long literal or copy-4: Leave it to the tag-by-tag loop.
+      if (SNAPPY_PREDICT_FALSE(len & 0x80)) {
+        ip = old_ip;
+        break;
+      }
+
+      // Copy-1/2 that overlaps its own output. A zero offset or a copy from
+      // before the start of the output is invalid.
+      const ptrdiff_t offset = len - len_min_offset;
+      if (SNAPPY_PREDICT_FALSE(offset == 0 || op < offset)) {
+        ip = old_ip;
+        break;
+      }
+      PatternCopy::Copy(base + op, offset);
+      op += len;
+      continue;
+    }
+
+    // For literals, this is negative at the start of the output (the fake
+    // offset is 256).
+    const ptrdiff_t delta = op + len_min_offset - len;
+    if (SNAPPY_PREDICT_FALSE(delta < 0)) {
+      if (tag_type != 0) {
+        ip = old_ip;
+        break;
+      }
+      CopyElement(reinterpret_cast<const char*>(old_ip), base + op, len);
+      op += len;
+      continue;
+    }
+
+    // Copies are read from the output, literals from the input.
+    const char* from = tag_type ? base + delta
+                                : reinterpret_cast<const char*>(old_ip);
+    CopyElement(from, base + op, len);
+    op += len;
+  }
+
+  *op_p = op;
+  return reinterpret_cast<const char*>(ip - 1);
+}
+
+typedef const char* (*DecompressBranchlessFunction)(
+    const char* ip, const char* ip_limit, char* base, ptrdiff_t* op_p,
+    ptrdiff_t op_limit);
+
+const char* DecompressBranchlessScalar(const char* ip, const char* ip_limit,
+                                       char* base, ptrdiff_t* op_p,
+                                       ptrdiff_t op_limit) {
+  return DecompressBranchless<PatternCopyScalar>(ip, ip_limit, base, op_p,
+                                                 op_limit);
+}
+
+#if SNAPPY_DISPATCH_X86
+
+SNAPPY_TARGET_FLATTEN("ssse3")
+const char* DecompressBranchlessSSSE3(const char* ip, const char* ip_limit,
+                                      char* base, ptrdiff_t* op_p,
+                                      ptrdiff_t op_limit) {
+  return DecompressBranchless<PatternCopySSSE3>(ip, ip_limit, base, op_p,
+                                                op_limit);
+}
+
+#if SNAPPY_DISPATCH_AVX2
+
+// Same as SSSE3; The compiler uses 32-byte moves for the 64-byte copies.
+SNAPPY_TARGET_FLATTEN("avx2")
+const char* DecompressBranchlessAVX2(const char* ip, const char* ip_limit,
+                                     char* base, ptrdiff_t* op_p,
+                                     ptrdiff_t op_limit) {
+  return DecompressBranchless<PatternCopySSSE3>(ip, ip_limit, base, op_p,
+                                                op_limit);
+}
+
+#endif  // SNAPPY_DISPATCH_AVX2
+
+#endif  // SNAPPY_DISPATCH_X86
+
+#if SNAPPY_HAVE_NEON
+
+const char* DecompressBranchlessNEON(const char* ip, const char* ip_limit,
+                                     char* base, ptrdiff_t* op_p,
+                                     ptrdiff_t op_limit) {
+  return DecompressBranchless<PatternCopyNEON>(ip, ip_limit, base, op_p,
+                                               op_limit);
+}
+
+#endif  // SNAPPY_HAVE_NEON
+
+#if SNAPPY_DISPATCH_X86
+
+bool CpuSupportsSSSE3() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 9)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+bool CpuSupportsAVX2() {
+#if defined(_MSC_VER)
+  // The OS also has to save the YMM registers.
+  int info[4];
+  __cpuid(info, 1);
+  if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6) return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif  // SNAPPY_DISPATCH_X86
+
+bool IsDecompressionKernelSupported(internal::DecompressionKernel kernel) {
+  switch (kernel) {
+    case internal::kDecompressReference:
+    case internal::kDecompressScalar:
+      return true;
+#if SNAPPY_DISPATCH_X86
+    case internal::kDecompressSSSE3:
+      return CpuSupportsSSSE3();
+#if SNAPPY_DISPATCH_AVX2
+    case internal::kDecompressAVX2:
+      return CpuSupportsAVX2();
+#endif
+#endif  // SNAPPY_DISPATCH_X86
+#if SNAPPY_HAVE_NEON
+    case internal::kDecompressNEON:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+DecompressBranchlessFunction GetDecompressionFunction(
+    internal::DecompressionKernel kernel) {
+  switch (kernel) {
+    case internal::kDecompressScalar:
+      return DecompressBranchlessScalar;
+#if SNAPPY_DISPATCH_X86
+    case internal::kDecompressSSSE3:
+      return DecompressBranchlessSSSE3;
+#if SNAPPY_DISPATCH_AVX2
+    case internal::kDecompressAVX2:
+      return DecompressBranchlessAVX2;
+#endif
+#endif
+#if SNAPPY_HAVE_NEON
+    case internal::kDecompressNEON:
+      return DecompressBranchlessNEON;
+#endif
+    default:
+      return NULL;
+  }
+}
+
+// The fastest kernel supported by the CPU
+internal::DecompressionKernel DetectDecompressionKernel() {
+  static const internal::DecompressionKernel kCandidates[] = {
+    internal::kDecompressAVX2, internal::kDecompressSSSE3,
+    internal::kDecompressNEON
+  };
+  for (size_t i = 0; i < sizeof(kCandidates) / sizeof(kCandidates[0]); i++)
+    if (IsDecompressionKernelSupported(kCandidates[i])) return kCandidates[i];
+  return internal::kDecompressScalar;
+}
+
+internal::DecompressionKernel decompression_kernel =
+    DetectDecompressionKernel();
+
+DecompressBranchlessFunction decompress_branchless =
+    GetDecompressionFunction(decompression_kernel);
+
 }  // namespace
 
+namespace internal {
+
+DecompressionKernel GetDecompressionKernel() {
+  return decompression_kernel;
+}
+
+bool SetDecompressionKernel(DecompressionKernel kernel) {
+  if (!IsDecompressionKernelSupported(kernel)) return false;
+  decompression_kernel = kernel;
+  decompress_branchless = GetDecompressionFunction(kernel);
+  return true;
+}
+
+}  // end namespace internal
+
 template <bool allow_fast_path>
 static inline char* EmitLiteral(char* op,
                                 const char* literal,
@@ -715,6 +1135,11 @@ static inline void Report(const char *algorithm, size_t compressed_size,
 //   //    this much data.
 //   //
 //   bool TryFastAppend(const char* ip, size_t available, size_t length);
+//
+//   // Runs the branchless loop on the bulk of the input when the writer
+//   // supports it. Returns the position of the next tag for the regular
+//   // loop (ip itself when it's not supported).
+//   const char* DecompressBranchless(const char* ip, const char* ip_limit);
 // };
 
 static inline uint32 ExtractLowBytes(uint32 v, int n) {
@@ -841,6 +1266,10 @@ class SnappyDecompressor {
 
     MAYBE_REFILL();
     for ( ;; ) {
+      // The branchless loop stops with more than kMaximumTagLength bytes
+      // left in the buffer, so there's no need for a refill after it.
+      ip = writer->DecompressBranchless(ip, ip_limit_);
+
       const unsigned char c = *(reinterpret_cast<const unsigned char*>(ip++));
 
       // Ratio of iterations that have LITERAL vs non-LITERAL for different
@@ -1248,6 +1677,10 @@ class SnappyIOVecWriter {
     return true;
   }
 
+  inline const char* DecompressBranchless(const char* ip, const char*) {
+    return ip;
+  }
+
   inline void Flush() {}
 };
 
@@ -1330,6 +1763,19 @@ class SnappyArrayWriter {
 
     return true;
   }
+  inline const char* DecompressBranchless(const char* ip,
+                                         const char* ip_limit) {
+    // Skip the call for the tail of the input and output.
+    if (decompress_branchless == NULL || ip_limit - ip <= kSlopBytes + 2 ||
+        op_limit_ - op_ <= kElementSlopBytes) {
+      return ip;
+    }
+    ptrdiff_t op = op_ - base_;
+    ip = decompress_branchless(ip, ip_limit, base_, &op, op_limit_ - base_);
+    op_ = base_ + op;
+    return ip;
+  }
+
   inline size_t Produced() const {
     assert(op_ >= base_);
     return op_ - base_;
@@ -1347,6 +1793,87 @@ bool RawUncompress(Source* compressed, char* uncompressed) {
   return InternalUncompress(compressed, &output);
 }
 
+// A SnappyArrayWriter without the per-element checks: The output length is
+// taken from the caller, and copies are never checked against the start and
+// the end of the buffer. Only for trusted input (see RawUncompressTrusted).
+class SnappyTrustedArrayWriter {
+ private:
+  char* base_;
+  char* op_;
+  char* op_limit_;
+
+ public:
+  inline explicit SnappyTrustedArrayWriter(char* dst)
+      : base_(dst),
+        op_(dst),
+        op_limit_(dst) {
+  }
+
+  inline void SetExpectedLength(size_t len) {
+    op_limit_ = op_ + len;
+  }
+
+  inline bool CheckLength() const {
+    return op_ == op_limit_;
+  }
+
+  inline bool Append(const char* ip, size_t len) {
+    memcpy(op_, ip, len);
+    op_ += len;
+    return true;
+  }
+
+  inline bool TryFastAppend(const char* ip, size_t available, size_t len) {
+    // The space check is for the 16-byte copy, which may run over the end of
+    // the literal.
+    char* op = op_;
+    if (len <= 16 && available >= 16 + kMaximumTagLength &&
+        op_limit_ - op >= 16) {
+      UnalignedCopy128(ip, op);
+      op_ = op + len;
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  inline bool AppendFromSelf(size_t offset, size_t len) {
+    op_ = IncrementalCopy(op_ - offset, op_, op_ + len, op_limit_);
+    return true;
+  }
+
+  inline const char* DecompressBranchless(const char* ip,
+                                         const char* ip_limit) {
+    if (decompress_branchless == NULL || ip_limit - ip <= kSlopBytes + 2 ||
+        op_limit_ - op_ <= kElementSlopBytes) {
+      return ip;
+    }
+    ptrdiff_t op = op_ - base_;
+    ip = decompress_branchless(ip, ip_limit, base_, &op, op_limit_ - base_);
+    op_ = base_ + op;
+    return ip;
+  }
+
+  inline void Flush() {}
+};
+
+bool RawUncompressTrusted(const char* compressed, size_t n,
+                          char* uncompressed, size_t uncompressed_length) {
+  // Step over the length preamble without decoding it.
+  size_t skip = 0;
+  while (skip < n && skip < static_cast<size_t>(Varint::kMax32) &&
+         (static_cast<unsigned char>(compressed[skip]) & 0x80) != 0) {
+    skip++;
+  }
+  if (++skip > n) return false;
+
+  ByteArraySource reader(compressed + skip, n - skip);
+  SnappyDecompressor decompressor(&reader);
+  SnappyTrustedArrayWriter output(uncompressed);
+  return InternalUncompressAllTags(&decompressor, &output, n - skip,
+                                   uncompressed_length);
+}
+
 bool Uncompress(const char* compressed, size_t n, string* uncompressed) {
   size_t ulength;
   if (!GetUncompressedLength(compressed, n, &ulength)) {
@@ -1389,6 +1916,10 @@ class SnappyDecompressionValidator {
     produced_ += len;
     return produced_ <= expected_;
   }
+  inline const char* DecompressBranchless(const char* ip, const char*) {
+    return ip;
+  }
+
   inline void Flush() {}
 };
 
@@ -1520,6 +2051,10 @@ class SnappyScatteredWriter {
     return SlowAppendFromSelf(offset, len);
   }
 
+  inline const char* DecompressBranchless(const char* ip, const char*) {
+    return ip;
+  }
+
   // Called at the end of the decompress. We ask the allocator
   // write all blocks to the sink.
   inline void Flush() { allocator_.Flush(Produced()); }
@@ -136,6 +136,14 @@ namespace snappy {
   // returns false if the message is corrupted and could not be decrypted
   bool RawUncompress(Source* compressed, char* uncompressed);
 
+  // Same as RawUncompress, but for input that is known to be intact (e.g.
+  // verified against a checksum): The uncompressed length is given by the
+  // caller instead of being read from the preamble, and the elements aren't
+  // checked against the bounds of the output. Corrupted input can make it
+  // write out of "uncompressed[0..uncompressed_length-1]".
+  bool RawUncompressTrusted(const char* compressed, size_t compressed_length,
+                            char* uncompressed, size_t uncompressed_length);
+
   // Given data in "compressed[0..compressed_length-1]" generated by
   // calling the Snappy::Compress routine, this routine
   // stores the uncompressed data to the iovec "iov". The number of physical
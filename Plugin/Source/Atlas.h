@@ -0,0 +1,310 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "BlockDecoder.h"
+#include "Demuxer.h"
+#include "FrameBuffer.h"
+#include "MemoryGovernor.h"
+#include "ReadBuffer.h"
+#include "TaskPool.h"
+#include "hap.h"
+
+namespace KlakHap
+{
+    //
+    // Atlas decoder
+    //
+    // Plays many small clips of the same format in the tiles of a single
+    // texture. The frames are decoded straight into the tiles of a shared
+    // buffer (strided decode), so a clip doesn't need its own decoder,
+    // texture or texture update; It only costs a demuxer with the whole clip
+    // preloaded. There's no reader thread: Changed frames are read from the
+    // preloaded memory and decoded in Update(), in parallel across slots.
+    //
+    // Slots decoded since the last upload are tracked, so that the upload
+    // can be skipped when nothing was changed, and the range of changed
+    // block rows can be queried.
+    //
+    class Atlas
+    {
+    public:
+
+        #pragma region Constructor/destructor
+
+        // Tile size in pixels (rounded up to the block size) and grid size
+        // in tiles
+        Atlas(int tileWidth, int tileHeight, int columns, int rows, int typeID)
+          : tileWidth_((std::max(tileWidth, 4) + 3) / 4 * 4),
+            tileHeight_((std::max(tileHeight, 4) + 3) / 4 * 4),
+            columns_(std::max(columns, 1)), rows_(std::max(rows, 1)),
+            typeID_(typeID), blockSize_(BlockDecoder::GetBlockSize(typeID)),
+            slots_(columns_ * rows_)
+        {
+            size_ = GetRowBytes() * (rows_ * tileHeight_ / 4);
+            buffer_.resize(size_);
+            std::memset(buffer_.data(), 0, size_);
+            MemoryGovernor::Get().Add(MemoryGovernor::Decoder, static_cast<int64_t>(size_));
+        }
+
+        ~Atlas()
+        {
+            MemoryGovernor::Get().Add(MemoryGovernor::Decoder, -static_cast<int64_t>(size_));
+        }
+
+        #pragma endregion
+
+        #pragma region Public accessors
+
+        bool IsValid() const
+        {
+            return blockSize_ != 0;
+        }
+
+        int GetWidth() const { return tileWidth_ * columns_; }
+        int GetHeight() const { return tileHeight_ * rows_; }
+        int GetSlotCount() const { return static_cast<int>(slots_.size()); }
+
+        // Clip frame size in the slot (zero when the slot is empty)
+        int GetClipWidth(int slot) const
+        {
+            return IsOccupied(slot) ? slots_[slot].demuxer->GetWidth() : 0;
+        }
+
+        int GetClipHeight(int slot) const
+        {
+            return IsOccupied(slot) ? slots_[slot].demuxer->GetHeight() : 0;
+        }
+
+        double GetClipDuration(int slot) const
+        {
+            return IsOccupied(slot) ? slots_[slot].demuxer->GetDuration() : 0;
+        }
+
+        #pragma endregion
+
+        #pragma region Slot management
+
+        // Open a clip in a free slot. Returns the slot index, or -1 when the
+        // file is invalid, its format doesn't match, it doesn't fit in a tile
+        // or there's no free slot.
+        int AddClip(const char* path)
+        {
+            auto it = std::find_if(slots_.begin(), slots_.end(),
+                [](const Slot& s) { return !s.demuxer; });
+            if (it == slots_.end()) return -1;
+
+            std::unique_ptr<Demuxer> demuxer(new Demuxer(path));
+            if (!demuxer->IsValid() ||
+                demuxer->GetWidth() > tileWidth_ || demuxer->GetHeight() > tileHeight_ ||
+                (demuxer->ReadVideoTypeField() & 0xf) != (typeID_ & 0xf)) return -1;
+
+            // Whole-clip preload: Frames are read without file access.
+            demuxer->EnablePreload(0);
+
+            it->demuxer = std::move(demuxer);
+            it->frame = 0;
+            it->resident = -1;
+            return static_cast<int>(it - slots_.begin());
+        }
+
+        // Close the clip and clear the tile.
+        void RemoveClip(int slot)
+        {
+            if (!IsOccupied(slot)) return;
+
+            auto& s = slots_[slot];
+            s.demuxer.reset();
+            s.input = ReadBuffer();
+            s.resident = -1;
+
+            std::lock_guard<std::mutex> lock(bufferLock_);
+            auto rowBytes = static_cast<size_t>(tileWidth_ / 4) * blockSize_;
+            for (auto row = 0; row < tileHeight_ / 4; row++)
+                std::memset(GetTile(slot) + GetRowBytes() * row, 0, rowBytes);
+            MarkDirty(slot);
+        }
+
+        // Select the frame to show in the slot. The time is wrapped around
+        // the clip duration. Clips without a valid duration show frame 0.
+        void SetTime(int slot, float time)
+        {
+            if (!IsOccupied(slot)) return;
+            auto& demuxer = *slots_[slot].demuxer;
+            auto total = demuxer.GetFrameCount();
+            auto duration = demuxer.GetDuration();
+            if (total <= 0 || !(duration > 0)) { slots_[slot].frame = 0; return; }
+            auto frame = static_cast<int>(time * total / duration + 1e-3f) % total;
+            slots_[slot].frame = frame < 0 ? frame + total : frame;
+        }
+
+        #pragma endregion
+
+        #pragma region Decoding
+
+        // Decode the frames that were changed with SetTime().
+        void Update()
+        {
+            std::vector<int> pending;
+            for (auto i = 0; i < GetSlotCount(); i++)
+                if (IsOccupied(i) && slots_[i].frame != slots_[i].resident) pending.push_back(i);
+            if (pending.empty()) return;
+
+            auto count = static_cast<int>(pending.size());
+            std::vector<char> results(count, 0);
+
+            // Split the slots into contiguous parts, one per hardware thread.
+            auto threads = TaskPool::GetConcurrency();
+            auto parts = std::max(1, std::min(threads, count / kMinSlotsPerThread));
+            parts = std::min(parts, kMaxThreads);
+
+            std::lock_guard<std::mutex> lock(bufferLock_);
+
+            auto work = [&](int p)
+            {
+                for (auto i = count * p / parts; i < count * (p + 1) / parts; i++)
+                    results[i] = DecodeSlot(pending[i]);
+            };
+
+            TaskPool::Get().Run(parts, work);
+
+            for (auto i = 0; i < count; i++) if (results[i]) MarkDirty(pending[i]);
+        }
+
+        #pragma endregion
+
+        #pragma region Buffer access
+
+        const void* LockBuffer()
+        {
+            bufferLock_.lock();
+            dirtyFirst_ = dirtyLast_ = -1;
+            return buffer_.data();
+        }
+
+        void UnlockBuffer()
+        {
+            bufferLock_.unlock();
+        }
+
+        size_t GetBufferSize() const
+        {
+            return size_;
+        }
+
+        bool IsBufferUpdated()
+        {
+            std::lock_guard<std::mutex> lock(bufferLock_);
+            return dirtyFirst_ >= 0;
+        }
+
+        // Range of block rows changed since the last lock. Returns false when
+        // nothing was changed.
+        bool GetDirtyRows(int& first, int& count)
+        {
+            std::lock_guard<std::mutex> lock(bufferLock_);
+            if (dirtyFirst_ < 0) return false;
+            first = dirtyFirst_;
+            count = dirtyLast_ - dirtyFirst_ + 1;
+            return true;
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        static const int kMinSlotsPerThread = 8;
+        static const int kMaxThreads = 8;
+
+        struct Slot
+        {
+            std::unique_ptr<Demuxer> demuxer;
+            ReadBuffer input;
+            int frame = 0;
+            int resident = -1;
+        };
+
+        int tileWidth_, tileHeight_, columns_, rows_, typeID_;
+        size_t blockSize_, size_;
+        std::vector<Slot> slots_;
+        FrameBuffer buffer_;
+        std::mutex bufferLock_;
+
+        // Changed block rows (inclusive, -1 when clean)
+        int dirtyFirst_ = -1, dirtyLast_ = -1;
+
+        bool IsOccupied(int slot) const
+        {
+            return slot >= 0 && slot < GetSlotCount() && slots_[slot].demuxer;
+        }
+
+        size_t GetRowBytes() const
+        {
+            return static_cast<size_t>(columns_ * tileWidth_ / 4) * blockSize_;
+        }
+
+        uint8_t* GetTile(int slot)
+        {
+            auto x = slot % columns_, y = slot / columns_;
+            return buffer_.data() + GetRowBytes() * (y * tileHeight_ / 4) +
+                   static_cast<size_t>(x * tileWidth_ / 4) * blockSize_;
+        }
+
+        // Called with the buffer lock held.
+        void MarkDirty(int slot)
+        {
+            auto first = slot / columns_ * tileHeight_ / 4;
+            auto last = first + tileHeight_ / 4 - 1;
+            dirtyFirst_ = dirtyFirst_ < 0 ? first : std::min(dirtyFirst_, first);
+            dirtyLast_ = std::max(dirtyLast_, last);
+        }
+
+        // Called from the worker threads. Each slot is touched by only one
+        // of them.
+        bool DecodeSlot(int slot)
+        {
+            auto& s = slots_[slot];
+            s.demuxer->ReadFrame(s.frame, s.input);
+
+            auto width = s.demuxer->GetWidth(), height = s.demuxer->GetHeight();
+            auto rowBytes = static_cast<size_t>((width + 3) / 4) * blockSize_;
+            auto pitch = GetRowBytes();
+            auto size = pitch * ((height + 3) / 4 - 1) + rowBytes;
+            unsigned int format;
+
+            auto result = HapDecodeStrided(
+                s.input.GetData(),
+                static_cast<unsigned long>(s.input.GetSize()),
+                0, hap_callback, nullptr,
+                GetTile(slot), static_cast<unsigned long>(size),
+                static_cast<unsigned long>(rowBytes),
+                static_cast<unsigned long>(pitch),
+                nullptr, &format
+            );
+
+            // The frame isn't retried when it's broken.
+            s.resident = s.frame;
+            return result == HapResult_No_Error;
+        }
+
+        #pragma endregion
+
+        #pragma region HAP callback implementation
+
+        static void hap_callback(
+            HapDecodeWorkFunction work, void* p,
+            unsigned int count, void* info
+        )
+        {
+            for (auto i = 0u; i < count; i++) work(p, i);
+        }
+
+        #pragma endregion
+    };
+}
@@ -0,0 +1,684 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "TaskPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define KLAKHAP_BLOCK_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define KLAKHAP_BLOCK_NEON
+#include <arm_neon.h>
+#endif
+
+namespace KlakHap
+{
+    //
+    // Block decoder
+    //
+    // Expands BCn-compressed frames (DXT1, DXT5 and BC4) into RGBA8 pixels on
+    // the CPU, for targets without BC texture support and for CPU-side
+    // consumers. The palettes are built per block; the index lookup is done
+    // with SSE2 or NEON when available. Large frames are split into bands of
+    // block rows that are converted in parallel.
+    //
+    // Rows are written in the order of the block data (the top row first).
+    // Hap Q (scaled YCoCg in DXT5) is converted to RGB in the same pass, in
+    // the same way as the HAP Q shader. BC4 values are replicated to the RGB
+    // channels with opaque alpha.
+    //
+    // The output is either interleaved RGBA or planar (a plane per channel),
+    // with an arbitrary row pitch, so that it can be written straight into
+    // the frame buffers of the consumers.
+    //
+    class BlockDecoder
+    {
+    public:
+
+        #pragma region Public methods
+
+        // Formats that can be converted (DXT1, DXT5 and BC4)
+        static bool IsSupported(int typeID)
+        {
+            switch (typeID & 0xf)
+            {
+            case 0xb: case 0xe: case 0xf: case 0x1: return true;
+            }
+            return false;
+        }
+
+        // Convert a frame into interleaved RGBA with the given row pitch (in
+        // bytes). Returns false when the format is unsupported or the source
+        // is too small.
+        static bool Convert(
+            int typeID, const uint8_t* source, size_t sourceSize,
+            int width, int height, uint8_t* dest, size_t pitch
+        )
+        {
+            uint8_t* planes[4] = { nullptr, nullptr, nullptr, nullptr };
+            return Run(typeID, source, sourceSize, width, height, dest, planes, pitch);
+        }
+
+        // Convert a frame into R, G, B and A planes with the given row pitch.
+        // Null planes are skipped.
+        static bool ConvertPlanar(
+            int typeID, const uint8_t* source, size_t sourceSize,
+            int width, int height, uint8_t* const* planes, size_t pitch
+        )
+        {
+            return Run(typeID, source, sourceSize, width, height, nullptr, planes, pitch);
+        }
+
+        // Expand a single block into 4x4 RGBA pixels as stored (Hap Q isn't
+        // converted to RGB).
+        static void DecodeBlock(int typeID, const uint8_t* block, uint8_t* dest, size_t pitch)
+        {
+            switch (typeID & 0xf)
+            {
+            case 0xb: DecodeDXT1(block, dest, pitch); break;
+            case 0xe:
+            case 0xf: DecodeDXT5(block, dest, pitch); break;
+            case 0x1: DecodeBC4(block, dest, pitch); break;
+            }
+        }
+
+        // Bytes per 4x4 block of a texture format, including the formats
+        // that can't be converted
+        static size_t GetBlockSize(int typeID)
+        {
+            switch (typeID & 0xf)
+            {
+            case 0xb: return 8;  // DXT1
+            case 0xe: return 16; // DXT5
+            case 0xf: return 16; // DXT5 (YCoCg)
+            case 0xc: return 16; // BC7
+            case 0x2: return 16; // BC6H (unsigned)
+            case 0x3: return 16; // BC6H (signed)
+            case 0x1: return 8;  // BC4
+            }
+            return 0;
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Frame conversion
+
+        static const int kMinRowsPerBand = 32;
+        static const int kMaxBands = 8;
+
+        struct Frame
+        {
+            int format;
+            const uint8_t* source;
+            int width, height;
+            uint8_t* dest;       // Interleaved output
+            uint8_t* planes[4];  // Planar output (when dest is null)
+            size_t pitch;
+            int columns;
+            size_t blockSize;
+        };
+
+        static bool Run(
+            int typeID, const uint8_t* source, size_t sourceSize,
+            int width, int height, uint8_t* dest, uint8_t* const* planes, size_t pitch
+        )
+        {
+            if (!IsSupported(typeID) || width <= 0 || height <= 0) return false;
+            auto blockSize = GetBlockSize(typeID);
+
+            auto columns = (width + 3) / 4;
+            auto rows = (height + 3) / 4;
+            if (static_cast<size_t>(columns) * rows * blockSize > sourceSize) return false;
+
+            Frame frame = {
+                typeID & 0xf, source, width, height,
+                dest, { planes[0], planes[1], planes[2], planes[3] },
+                pitch, columns, blockSize
+            };
+
+            // Split the rows into bands, one per hardware thread.
+            auto threads = TaskPool::GetConcurrency();
+            auto bands = std::max(1, std::min(threads, rows / kMinRowsPerBand));
+            bands = std::min(bands, kMaxBands);
+
+            TaskPool::Get().Run(bands, [&](int b) {
+                ConvertRows(frame, rows * b / bands, rows * (b + 1) / bands);
+            });
+
+            return true;
+        }
+
+        #pragma endregion
+
+        #pragma region Row conversion
+
+        static void ConvertRows(const Frame& frame, int begin, int end)
+        {
+            auto planar = frame.dest == nullptr;
+
+            for (auto row = begin; row < end; row++)
+            {
+                auto src = frame.source + frame.blockSize * frame.columns * row;
+                auto offset = frame.pitch * row * 4;
+                auto lines = std::min(4, frame.height - row * 4);
+
+                for (auto col = 0; col < frame.columns; col++, src += frame.blockSize)
+                {
+                    auto pixels = std::min(4, frame.width - col * 4);
+
+                    // Edge blocks and planar output go through a temporary
+                    // block.
+                    uint8_t temp[64];
+                    auto direct = !planar && pixels == 4 && lines == 4;
+                    auto out = planar ? nullptr : frame.dest + offset + col * 16;
+                    auto target = direct ? out : temp;
+                    auto pitch = direct ? frame.pitch : 16;
+
+                    switch (frame.format)
+                    {
+                    case 0xb: DecodeDXT1(src, target, pitch); break;
+                    case 0xe: DecodeDXT5(src, target, pitch); break;
+                    case 0xf: DecodeYCoCg(src, target, pitch); break;
+                    case 0x1: DecodeBC4(src, target, pitch); break;
+                    }
+
+                    if (direct) continue;
+
+                    for (auto y = 0; y < lines; y++)
+                    {
+                        if (planar)
+                            SplitRow(temp + 16 * y, frame.planes, offset + frame.pitch * y + col * 4, pixels);
+                        else
+                            std::memcpy(out + frame.pitch * y, temp + 16 * y, pixels * 4);
+                    }
+                }
+            }
+        }
+
+        #pragma endregion
+
+        #pragma region Block decoders
+
+        static void DecodeDXT1(const uint8_t* block, uint8_t* dest, size_t pitch)
+        {
+            uint32_t palette[4];
+            MakeColorPalette(block, false, palette);
+            WriteColors(block + 4, palette, dest, pitch);
+        }
+
+        static void DecodeDXT5(const uint8_t* block, uint8_t* dest, size_t pitch)
+        {
+            uint32_t palette[4];
+            uint32_t alpha[4];
+            MakeColorPalette(block + 8, true, palette);
+            ExpandAlpha(block, alpha);
+            WriteColors(block + 12, palette, dest, pitch);
+            WriteAlpha(alpha, dest, pitch);
+        }
+
+        static void DecodeYCoCg(const uint8_t* block, uint8_t* dest, size_t pitch)
+        {
+            DecodeDXT5(block, dest, pitch);
+            for (auto y = 0; y < 4; y++) YCoCgToRGB(dest + pitch * y);
+        }
+
+        static void DecodeBC4(const uint8_t* block, uint8_t* dest, size_t pitch)
+        {
+            uint32_t values[4];
+            ExpandAlpha(block, values);
+            WriteGray(values, dest, pitch);
+        }
+
+        #pragma endregion
+
+        #pragma region Palette generation
+
+        // DXT5 color blocks are always in the four-color mode. The palette
+        // entries are packed in the RGBA byte order.
+
+    #if defined(KLAKHAP_BLOCK_SSE2)
+
+        // Interpolation in 16-bit lanes. The divisions are done with
+        // fixed-point reciprocals, which are exact in the value ranges.
+        static void MakeColorPalette(const uint8_t* block, bool opaque, uint32_t* palette)
+        {
+            uint32_t c0 = block[0] | (block[1] << 8);
+            uint32_t c1 = block[2] | (block[3] << 8);
+
+            // 565 -> 888 of both the endpoints: [r0 g0 b0 255 r1 g1 b1 255]
+            auto e = _mm_setr_epi16(
+                static_cast<short>(c0 >> 11), static_cast<short>((c0 >> 5) & 63), static_cast<short>(c0 & 31), 255,
+                static_cast<short>(c1 >> 11), static_cast<short>((c1 >> 5) & 63), static_cast<short>(c1 & 31), 255);
+            auto rb = _mm_setr_epi16(8, 4, 8, 1, 8, 4, 8, 1);
+            auto rs = _mm_setr_epi16(1 << 14, 1 << 12, 1 << 14, 0, 1 << 14, 1 << 12, 1 << 14, 0);
+            e = _mm_or_si128(_mm_mullo_epi16(e, rb), _mm_mulhi_epu16(e, rs));
+
+            // [p1 p0]
+            auto swapped = _mm_shuffle_epi32(e, _MM_SHUFFLE(1, 0, 3, 2));
+            auto sum = _mm_add_epi16(e, swapped);
+
+            // Four-color mode: [(2 * p0 + p1) / 3, (p0 + 2 * p1) / 3]
+            auto thirds = _mm_mulhi_epu16(_mm_add_epi16(e, sum), _mm_set1_epi16(0x5556));
+
+            // Three-color mode: [(p0 + p1) / 2, transparent black]
+            auto half = _mm_srli_epi16(sum, 1);
+            half = _mm_and_si128(half, _mm_setr_epi32(-1, -1, 0, 0));
+
+            auto mask = _mm_set1_epi32(opaque || c0 > c1 ? -1 : 0);
+            auto mid = _mm_or_si128(_mm_and_si128(mask, thirds), _mm_andnot_si128(mask, half));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(palette), _mm_packus_epi16(e, mid));
+        }
+
+        // Expand a DXT5 alpha/BC4 block into 16 values (packed per row).
+        static void ExpandAlpha(const uint8_t* block, uint32_t* values)
+        {
+            uint32_t a0 = block[0], a1 = block[1];
+
+            auto v0 = _mm_set1_epi16(static_cast<short>(a0));
+            auto v1 = _mm_set1_epi16(static_cast<short>(a1));
+
+            // Eight-value mode: [a0 a1 (6a0 + a1) / 7 ... (a0 + 6a1) / 7]
+            auto x7 = _mm_add_epi16(
+                _mm_mullo_epi16(v0, _mm_setr_epi16(7, 0, 6, 5, 4, 3, 2, 1)),
+                _mm_mullo_epi16(v1, _mm_setr_epi16(0, 7, 1, 2, 3, 4, 5, 6)));
+            x7 = _mm_mulhi_epu16(x7, _mm_set1_epi16(0x2493));
+
+            // Six-value mode: [a0 a1 (4a0 + a1) / 5 ... (a0 + 4a1) / 5 0 255]
+            auto x5 = _mm_add_epi16(
+                _mm_mullo_epi16(v0, _mm_setr_epi16(5, 0, 4, 3, 2, 1, 0, 0)),
+                _mm_mullo_epi16(v1, _mm_setr_epi16(0, 5, 1, 2, 3, 4, 0, 0)));
+            x5 = _mm_mulhi_epu16(x5, _mm_set1_epi16(0x3334));
+            x5 = _mm_or_si128(x5, _mm_setr_epi16(0, 0, 0, 0, 0, 0, 0, 255));
+
+            auto mask = _mm_set1_epi16(a0 > a1 ? -1 : 0);
+            auto x = _mm_or_si128(_mm_and_si128(mask, x7), _mm_andnot_si128(mask, x5));
+
+            alignas(16) uint8_t palette[16];
+            _mm_store_si128(reinterpret_cast<__m128i*>(palette), _mm_packus_epi16(x, x));
+
+            LookUpAlpha(block + 2, palette, values);
+        }
+
+    #else
+
+        static uint32_t Pack(uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+        {
+            return r | (g << 8) | (b << 16) | (a << 24);
+        }
+
+        static void MakeColorPalette(const uint8_t* block, bool opaque, uint32_t* palette)
+        {
+            uint32_t c0 = block[0] | (block[1] << 8);
+            uint32_t c1 = block[2] | (block[3] << 8);
+
+            uint32_t r0 = (c0 >> 11) & 31, g0 = (c0 >> 5) & 63, b0 = c0 & 31;
+            uint32_t r1 = (c1 >> 11) & 31, g1 = (c1 >> 5) & 63, b1 = c1 & 31;
+            r0 = (r0 << 3) | (r0 >> 2); g0 = (g0 << 2) | (g0 >> 4); b0 = (b0 << 3) | (b0 >> 2);
+            r1 = (r1 << 3) | (r1 >> 2); g1 = (g1 << 2) | (g1 >> 4); b1 = (b1 << 3) | (b1 >> 2);
+
+            palette[0] = Pack(r0, g0, b0, 255);
+            palette[1] = Pack(r1, g1, b1, 255);
+
+            if (opaque || c0 > c1)
+            {
+                palette[2] = Pack((2 * r0 + r1) / 3, (2 * g0 + g1) / 3, (2 * b0 + b1) / 3, 255);
+                palette[3] = Pack((r0 + 2 * r1) / 3, (g0 + 2 * g1) / 3, (b0 + 2 * b1) / 3, 255);
+            }
+            else
+            {
+                palette[2] = Pack((r0 + r1) / 2, (g0 + g1) / 2, (b0 + b1) / 2, 255);
+                palette[3] = 0; // Transparent black
+            }
+        }
+
+        static void ExpandAlpha(const uint8_t* block, uint32_t* values)
+        {
+            uint32_t a0 = block[0], a1 = block[1];
+            uint8_t palette[8];
+
+            palette[0] = static_cast<uint8_t>(a0);
+            palette[1] = static_cast<uint8_t>(a1);
+
+            if (a0 > a1)
+            {
+                for (uint32_t i = 1; i < 7; i++)
+                    palette[i + 1] = static_cast<uint8_t>(((7 - i) * a0 + i * a1) / 7);
+            }
+            else
+            {
+                for (uint32_t i = 1; i < 5; i++)
+                    palette[i + 1] = static_cast<uint8_t>(((5 - i) * a0 + i * a1) / 5);
+                palette[6] = 0;
+                palette[7] = 255;
+            }
+
+            LookUpAlpha(block + 2, palette, values);
+        }
+
+    #endif
+
+        // 3-bit indices (two groups of 24 bits) -> values packed per row
+        static void LookUpAlpha(const uint8_t* indices, const uint8_t* palette, uint32_t* rows)
+        {
+            for (auto half = 0; half < 2; half++, indices += 3)
+            {
+                uint32_t bits = indices[0] | (indices[1] << 8) | (indices[2] << 16);
+                for (auto y = 0; y < 2; y++, bits >>= 12)
+                {
+                    *rows++ = palette[bits & 7] |
+                             (palette[(bits >> 3) & 7] << 8) |
+                             (palette[(bits >> 6) & 7] << 16) |
+                             (static_cast<uint32_t>(palette[(bits >> 9) & 7]) << 24);
+                }
+            }
+        }
+
+        // 2-bit index byte -> four 32-bit indices
+        struct IndexTable
+        {
+            alignas(16) uint32_t entries[256][4];
+
+            IndexTable()
+            {
+                for (auto b = 0; b < 256; b++)
+                    for (auto i = 0; i < 4; i++)
+                        entries[b][i] = (b >> (2 * i)) & 3;
+            }
+        };
+
+        static const IndexTable& GetIndexTable()
+        {
+            static const IndexTable table;
+            return table;
+        }
+
+        #pragma endregion
+
+        #pragma region Pixel writers
+
+    #if defined(KLAKHAP_BLOCK_SSE2)
+
+        static void WriteColors(const uint8_t* indices, const uint32_t* palette, uint8_t* dest, size_t pitch)
+        {
+            const auto& table = GetIndexTable();
+            auto p0 = _mm_set1_epi32(static_cast<int>(palette[0]));
+            auto p1 = _mm_set1_epi32(static_cast<int>(palette[1]));
+            auto p2 = _mm_set1_epi32(static_cast<int>(palette[2]));
+            auto p3 = _mm_set1_epi32(static_cast<int>(palette[3]));
+            auto one = _mm_set1_epi32(1), two = _mm_set1_epi32(2), three = _mm_set1_epi32(3);
+
+            for (auto y = 0; y < 4; y++)
+            {
+                auto idx = _mm_load_si128(reinterpret_cast<const __m128i*>(table.entries[indices[y]]));
+                auto c = _mm_andnot_si128(_mm_cmpgt_epi32(idx, _mm_setzero_si128()), p0);
+                c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi32(idx, one), p1));
+                c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi32(idx, two), p2));
+                c = _mm_or_si128(c, _mm_and_si128(_mm_cmpeq_epi32(idx, three), p3));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + pitch * y), c);
+            }
+        }
+
+        // Four values -> four 32-bit lanes (value in the lowest byte)
+        static __m128i Widen(uint32_t packed)
+        {
+            auto zero = _mm_setzero_si128();
+            auto v = _mm_cvtsi32_si128(static_cast<int>(packed));
+            return _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+        }
+
+        static void WriteAlpha(const uint32_t* alpha, uint8_t* dest, size_t pitch)
+        {
+            auto mask = _mm_set1_epi32(0x00ffffff);
+            for (auto y = 0; y < 4; y++)
+            {
+                auto p = reinterpret_cast<__m128i*>(dest + pitch * y);
+                auto c = _mm_and_si128(_mm_loadu_si128(p), mask);
+                _mm_storeu_si128(p, _mm_or_si128(c, _mm_slli_epi32(Widen(alpha[y]), 24)));
+            }
+        }
+
+        static void WriteGray(const uint32_t* values, uint8_t* dest, size_t pitch)
+        {
+            auto opaque = _mm_set1_epi32(static_cast<int>(0xff000000u));
+            for (auto y = 0; y < 4; y++)
+            {
+                auto v = Widen(values[y]);
+                v = _mm_or_si128(v, _mm_slli_epi32(v, 8));
+                v = _mm_or_si128(v, _mm_slli_epi32(v, 8));
+                v = _mm_or_si128(v, opaque);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + pitch * y), v);
+            }
+        }
+
+        // Scaled CoCg and Y -> RGB of a row (four pixels) in place
+        static void YCoCgToRGB(uint8_t* row)
+        {
+            auto p = reinterpret_cast<__m128i*>(row);
+            auto v = _mm_loadu_si128(p);
+            auto mask = _mm_set1_epi32(0xff);
+            auto bias = _mm_set1_epi32(128);
+
+            auto co = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_and_si128(v, mask), bias));
+            auto cg = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(v, 8), mask), bias));
+            auto sc = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 16), mask));
+            auto y = _mm_cvtepi32_ps(_mm_srli_epi32(v, 24));
+
+            auto s = _mm_div_ps(_mm_set1_ps(8), _mm_add_ps(sc, _mm_set1_ps(8)));
+            co = _mm_mul_ps(co, s);
+            cg = _mm_mul_ps(cg, s);
+
+            auto r = _mm_add_ps(y, _mm_sub_ps(co, cg));
+            auto g = _mm_add_ps(y, cg);
+            auto b = _mm_sub_ps(y, _mm_add_ps(co, cg));
+
+            // Round half up. The upper bound is clamped by the packing.
+            auto zero = _mm_setzero_ps(), half = _mm_set1_ps(0.5f);
+            auto ri = _mm_cvttps_epi32(_mm_add_ps(_mm_max_ps(r, zero), half));
+            auto gi = _mm_cvttps_epi32(_mm_add_ps(_mm_max_ps(g, zero), half));
+            auto bi = _mm_cvttps_epi32(_mm_add_ps(_mm_max_ps(b, zero), half));
+
+            // [r0-3 b0-3 g0-3 a0-3] -> [r0 g0 b0 a0 ...]
+            auto rb = _mm_packs_epi32(ri, bi);
+            auto ga = _mm_packs_epi32(gi, mask);
+            auto t = _mm_packus_epi16(rb, ga);
+            t = _mm_unpacklo_epi8(t, _mm_srli_si128(t, 8));
+            t = _mm_unpacklo_epi16(t, _mm_srli_si128(t, 8));
+            _mm_storeu_si128(p, t);
+        }
+
+        // Interleaved row -> [r0-3 g0-3 b0-3 a0-3]
+        static void Deinterleave(const uint8_t* row, uint32_t* channels)
+        {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row));
+            v = _mm_unpacklo_epi8(v, _mm_srli_si128(v, 8));
+            v = _mm_unpacklo_epi8(v, _mm_srli_si128(v, 8));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(channels), v);
+        }
+
+    #elif defined(KLAKHAP_BLOCK_NEON)
+
+        static void WriteColors(const uint8_t* indices, const uint32_t* palette, uint8_t* dest, size_t pitch)
+        {
+            const auto& table = GetIndexTable();
+            auto p0 = vdupq_n_u32(palette[0]);
+            auto p1 = vdupq_n_u32(palette[1]);
+            auto p2 = vdupq_n_u32(palette[2]);
+            auto p3 = vdupq_n_u32(palette[3]);
+
+            for (auto y = 0; y < 4; y++)
+            {
+                auto idx = vld1q_u32(table.entries[indices[y]]);
+                auto c = vbslq_u32(vceqq_u32(idx, vdupq_n_u32(1)), p1, p0);
+                c = vbslq_u32(vceqq_u32(idx, vdupq_n_u32(2)), p2, c);
+                c = vbslq_u32(vceqq_u32(idx, vdupq_n_u32(3)), p3, c);
+                vst1q_u32(reinterpret_cast<uint32_t*>(dest + pitch * y), c);
+            }
+        }
+
+        // Four values -> four 32-bit lanes (value in the lowest byte)
+        static uint32x4_t Widen(uint32_t packed)
+        {
+            auto v = vreinterpret_u8_u32(vdup_n_u32(packed));
+            return vmovl_u16(vget_low_u16(vmovl_u8(v)));
+        }
+
+        static void WriteAlpha(const uint32_t* alpha, uint8_t* dest, size_t pitch)
+        {
+            auto mask = vdupq_n_u32(0x00ffffff);
+            for (auto y = 0; y < 4; y++)
+            {
+                auto p = reinterpret_cast<uint32_t*>(dest + pitch * y);
+                auto c = vandq_u32(vld1q_u32(p), mask);
+                vst1q_u32(p, vorrq_u32(c, vshlq_n_u32(Widen(alpha[y]), 24)));
+            }
+        }
+
+        static void WriteGray(const uint32_t* values, uint8_t* dest, size_t pitch)
+        {
+            for (auto y = 0; y < 4; y++)
+            {
+                auto v = Widen(values[y]);
+                v = vmulq_n_u32(v, 0x010101);
+                v = vorrq_u32(v, vdupq_n_u32(0xff000000u));
+                vst1q_u32(reinterpret_cast<uint32_t*>(dest + pitch * y), v);
+            }
+        }
+
+        // Scaled CoCg and Y -> RGB of a row (four pixels) in place
+        static void YCoCgToRGB(uint8_t* row)
+        {
+            auto p = reinterpret_cast<uint32_t*>(row);
+            auto v = vld1q_u32(p);
+            auto mask = vdupq_n_u32(0xff);
+            auto bias = vdupq_n_f32(128);
+
+            auto co = vsubq_f32(vcvtq_f32_u32(vandq_u32(v, mask)), bias);
+            auto cg = vsubq_f32(vcvtq_f32_u32(vandq_u32(vshrq_n_u32(v, 8), mask)), bias);
+            auto sc = vcvtq_f32_u32(vandq_u32(vshrq_n_u32(v, 16), mask));
+            auto y = vcvtq_f32_u32(vshrq_n_u32(v, 24));
+
+            auto d = vaddq_f32(sc, vdupq_n_f32(8));
+        #if defined(__aarch64__) || defined(_M_ARM64)
+            auto s = vdivq_f32(vdupq_n_f32(8), d);
+        #else
+            auto s = vrecpeq_f32(d);
+            s = vmulq_f32(s, vrecpsq_f32(d, s));
+            s = vmulq_f32(s, vrecpsq_f32(d, s));
+            s = vmulq_f32(s, vdupq_n_f32(8));
+        #endif
+            co = vmulq_f32(co, s);
+            cg = vmulq_f32(cg, s);
+
+            auto r = vaddq_f32(y, vsubq_f32(co, cg));
+            auto g = vaddq_f32(y, cg);
+            auto b = vsubq_f32(y, vaddq_f32(co, cg));
+
+            // Round half up with clamping
+            auto zero = vdupq_n_f32(0), half = vdupq_n_f32(0.5f), top = vdupq_n_u32(255);
+            auto ri = vminq_u32(vcvtq_u32_f32(vaddq_f32(vmaxq_f32(r, zero), half)), top);
+            auto gi = vminq_u32(vcvtq_u32_f32(vaddq_f32(vmaxq_f32(g, zero), half)), top);
+            auto bi = vminq_u32(vcvtq_u32_f32(vaddq_f32(vmaxq_f32(b, zero), half)), top);
+
+            auto c = vorrq_u32(ri, vshlq_n_u32(gi, 8));
+            c = vorrq_u32(c, vshlq_n_u32(bi, 16));
+            vst1q_u32(p, vorrq_u32(c, vdupq_n_u32(0xff000000u)));
+        }
+
+        // Interleaved row -> [r0-3 g0-3 b0-3 a0-3]
+        static void Deinterleave(const uint8_t* row, uint32_t* channels)
+        {
+            auto v = vld1q_u8(row);
+            auto t = vzip_u8(vget_low_u8(v), vget_high_u8(v));
+            t = vzip_u8(t.val[0], t.val[1]);
+            vst1q_u8(reinterpret_cast<uint8_t*>(channels), vcombine_u8(t.val[0], t.val[1]));
+        }
+
+    #else
+
+        static void WriteColors(const uint8_t* indices, const uint32_t* palette, uint8_t* dest, size_t pitch)
+        {
+            for (auto y = 0; y < 4; y++)
+            {
+                uint32_t row[4];
+                for (auto x = 0; x < 4; x++) row[x] = palette[(indices[y] >> (2 * x)) & 3];
+                std::memcpy(dest + pitch * y, row, 16);
+            }
+        }
+
+        static void WriteAlpha(const uint32_t* alpha, uint8_t* dest, size_t pitch)
+        {
+            for (auto y = 0; y < 4; y++)
+                for (auto x = 0; x < 4; x++)
+                    dest[pitch * y + x * 4 + 3] = static_cast<uint8_t>(alpha[y] >> (8 * x));
+        }
+
+        static void WriteGray(const uint32_t* values, uint8_t* dest, size_t pitch)
+        {
+            for (auto y = 0; y < 4; y++)
+            {
+                for (auto x = 0; x < 4; x++)
+                {
+                    auto v = static_cast<uint8_t>(values[y] >> (8 * x));
+                    auto p = dest + pitch * y + x * 4;
+                    p[0] = p[1] = p[2] = v;
+                    p[3] = 255;
+                }
+            }
+        }
+
+        // Scaled CoCg and Y -> RGB of a row (four pixels) in place
+        static void YCoCgToRGB(uint8_t* row)
+        {
+            for (auto x = 0; x < 4; x++, row += 4)
+            {
+                auto co = static_cast<float>(row[0] - 128);
+                auto cg = static_cast<float>(row[1] - 128);
+                auto s = 8.0f / (static_cast<float>(row[2]) + 8.0f);
+                auto y = static_cast<float>(row[3]);
+                co *= s;
+                cg *= s;
+                row[0] = ToByte(y + (co - cg));
+                row[1] = ToByte(y + cg);
+                row[2] = ToByte(y - (co + cg));
+                row[3] = 255;
+            }
+        }
+
+        // Round half up with clamping
+        static uint8_t ToByte(float x)
+        {
+            return static_cast<uint8_t>(std::min(static_cast<int>(std::max(x, 0.0f) + 0.5f), 255));
+        }
+
+        // Interleaved row -> [r0-3 g0-3 b0-3 a0-3]
+        static void Deinterleave(const uint8_t* row, uint32_t* channels)
+        {
+            auto out = reinterpret_cast<uint8_t*>(channels);
+            for (auto c = 0; c < 4; c++)
+                for (auto x = 0; x < 4; x++)
+                    out[c * 4 + x] = row[x * 4 + c];
+        }
+
+    #endif
+
+        #pragma endregion
+
+        #pragma region Planar output
+
+        static void SplitRow(const uint8_t* row, uint8_t* const* planes, size_t offset, int pixels)
+        {
+            uint32_t channels[4];
+            Deinterleave(row, channels);
+            for (auto c = 0; c < 4; c++)
+                if (planes[c] != nullptr) std::memcpy(planes[c] + offset, &channels[c], pixels);
+        }
+
+        #pragma endregion
+    };
+}
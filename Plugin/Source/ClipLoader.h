@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include "Decoder.h"
+#include "Demuxer.h"
+#include "StreamReader.h"
+
+namespace KlakHap
+{
+    //
+    // Background clip loader
+    //
+    // Opens the next clip of a playlist in the background: Opens the file
+    // and parses its index, starts reading ahead from the given time, and
+    // decodes the first frame into the standby buffer of the current decoder
+    // when the formats match. The demuxer and the stream reader are handed
+    // over to the player when it switches clips.
+    //
+    // The preload mode is applied in the loader thread before the stream
+    // reader starts, so that the switch doesn't have to touch the demuxer.
+    //
+    class ClipLoader
+    {
+    public:
+
+        #pragma region Constructor/destructor
+
+        // The decoder is optional. It must outlive the loader.
+        // preload: Preload window in bytes (zero for the whole clip, negative
+        //          to disable preloading, see Demuxer::EnablePreload)
+        ClipLoader(const char* path, float time, float delta, Decoder* decoder, int64_t preload = -1)
+          : path_(path), time_(time), delta_(delta), decoder_(decoder), preload_(preload)
+        {
+            thread_ = std::thread(&ClipLoader::LoadThread, this);
+        }
+
+        ~ClipLoader()
+        {
+            thread_.join();
+            reader_.reset();
+            demuxer_.reset();
+        }
+
+        #pragma endregion
+
+        #pragma region Public accessors
+
+        bool IsDone() const
+        {
+            return done_.load();
+        }
+
+        // True when the first frame is waiting in the decoder's standby
+        // buffer. Only valid after done.
+        bool IsPredecoded() const
+        {
+            return predecoded_;
+        }
+
+        #pragma endregion
+
+        #pragma region Ownership transfer
+
+        // Only valid after done. The stream reader must be destroyed before
+        // the demuxer.
+        Demuxer* DetachDemuxer()
+        {
+            return demuxer_.release();
+        }
+
+        StreamReader* DetachStreamReader()
+        {
+            return reader_.release();
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        std::string path_;
+        float time_, delta_;
+        Decoder* decoder_;
+        int64_t preload_;
+
+        std::unique_ptr<Demuxer> demuxer_;
+        std::unique_ptr<StreamReader> reader_;
+        bool predecoded_ = false;
+        std::atomic<bool> done_{false};
+        std::thread thread_;
+
+        void LoadThread()
+        {
+            demuxer_.reset(new Demuxer(path_.c_str()));
+
+            if (demuxer_->IsValid())
+            {
+                if (preload_ >= 0) demuxer_->EnablePreload(static_cast<uint64_t>(preload_));
+
+                reader_.reset(new StreamReader(*demuxer_, time_, delta_));
+
+                if (decoder_ != nullptr && decoder_->IsCompatible(
+                    demuxer_->GetWidth(), demuxer_->GetHeight(), demuxer_->ReadVideoTypeField()))
+                {
+                    // Wait for the first frame, then decode it. The frame
+                    // stays current in the reader, so the player doesn't
+                    // decode it again after switching.
+                    reader_->Restart(time_, delta_);
+                    auto input = reader_->Advance(time_);
+                    if (input != nullptr) predecoded_ = decoder_->Predecode(*input);
+                }
+            }
+
+            done_.store(true);
+        }
+
+        #pragma endregion
+    };
+}
@@ -1,9 +1,17 @@
 #pragma once
 
 #include <stdint.h>
+#include <atomic>
+#include <cstring>
+#include <memory>
 #include <mutex>
-#include <vector>
+#include "BlockDecoder.h"
+#include "FrameCache.h"
+#include "MemoryGovernor.h"
+#include "MipChain.h"
+#include "ProxyEncoder.h"
 #include "ReadBuffer.h"
+#include "SharedDecode.h"
 #include "hap.h"
 
 namespace KlakHap
@@ -14,9 +22,32 @@ namespace KlakHap
 
         #pragma region Constructor/destructor
 
-        Decoder(int width, int height, int typeID)
+        // A non-zero proxy level makes the decoder output 1/2 (level 1) or
+        // 1/4 (level 2) resolution frames in the same format. With mipmaps,
+        // the buffer holds the full mip chain of each frame (see MipChain).
+        Decoder(int width, int height, int typeID, int proxyLevel = 0, bool mipmaps = false)
+          : proxyLevel_(ProxyEncoder::IsSupported(typeID) ? std::min(std::max(proxyLevel, 0), 2) : 0),
+            mipmaps_(mipmaps && MipChain::IsSupported(typeID)),
+            sourceWidth_(width), sourceHeight_(height),
+            width_(ProxyEncoder::GetProxySize(width, proxyLevel_)),
+            height_(ProxyEncoder::GetProxySize(height, proxyLevel_)),
+            typeID_(typeID)
         {
-            buffer_.resize(width * height * GetBppFromTypeID(typeID) / 8);
+            imageSize_ = static_cast<size_t>(width_) * height_ * GetBppFromTypeID(typeID) / 8;
+            size_ = mipmaps_ ? MipChain::GetChainSize(typeID, width_, height_) : imageSize_;
+            buffer_ = std::make_shared<FrameBuffer>(size_);
+
+            // Pooled memory isn't cleared. Start with a black frame.
+            std::memset(buffer_->data(), 0, size_);
+
+            MemoryGovernor::Get().Add(MemoryGovernor::Decoder, static_cast<int64_t>(size_));
+            MemoryGovernor::Get().Enforce();
+        }
+
+        ~Decoder()
+        {
+            SetRGBAOutput(false);
+            MemoryGovernor::Get().Add(MemoryGovernor::Decoder, -static_cast<int64_t>(size_));
         }
 
         #pragma endregion
@@ -26,7 +57,8 @@ namespace KlakHap
         const void* LockBuffer()
         {
             bufferLock_.lock();
-            return buffer_.data();
+            uploaded_.store(version_.load());
+            return buffer_->data();
         }
 
         void UnlockBuffer()
@@ -36,38 +68,436 @@ namespace KlakHap
 
         size_t GetBufferSize() const
         {
-            return buffer_.size();
+            return size_;
+        }
+
+        // Check if frames of the given format can be decoded into the buffer
+        // (and uploaded to the same texture).
+        bool IsCompatible(int width, int height, int typeID) const
+        {
+            return width == sourceWidth_ && height == sourceHeight_ &&
+                   (typeID & 0xf) == (typeID_ & 0xf);
+        }
+
+        // Check if the buffer was changed since it was locked last time.
+        // Texture uploads can be skipped when it returns false.
+        bool IsBufferUpdated() const
+        {
+            return version_.load() != uploaded_.load();
+        }
+
+        // Output frame size (smaller than the clip with a proxy level)
+        int GetWidth() const { return width_; }
+        int GetHeight() const { return height_; }
+        int GetProxyLevel() const { return proxyLevel_; }
+
+        int GetMipCount() const
+        {
+            return mipmaps_ ? MipChain::GetLevelCount(width_, height_) : 1;
         }
 
         #pragma endregion
 
         #pragma region Decoding operations
 
+        // Check if the input is identical to the frame in the buffer. Only
+        // valid on the decoding thread.
+        bool IsResident(const ReadBuffer& input) const
+        {
+            if (input.source != 0 && input.source == residentSource_ &&
+                input.frame == residentFrame_) return true;
+            return input.hash != 0 && input.hash == residentHash_ &&
+                   input.GetSize() == residentSize_;
+        }
+
         void DecodeFrame(const ReadBuffer& input)
         {
-            std::lock_guard<std::mutex> lock(bufferLock_);
+            // Skip decoding when the input is identical to the resident frame
+            // (a hold frame or a repeated delivery of the same frame).
+            if (IsResident(input)) return;
 
-            unsigned int format;
+            UpdateImage(input);
+            if (rgbaOutput_.load()) UpdateRGBA();
+        }
+
+        // Decode a frame straight into the given memory (e.g. mapped staging
+        // memory or a region of a larger texture) without going through the
+        // buffer. The pitch is the distance between rows of blocks (four
+        // lines of pixels), and the size is the size of the memory from dest.
+        // Only the top mip level is stored. It doesn't change the current
+        // frame.
+        bool DecodeInto(const ReadBuffer& input, uint8_t* dest, size_t size, size_t pitch) const
+        {
+            auto rowBytes = GetRowBytes();
+            auto rows = static_cast<size_t>((height_ + 3) / 4);
+            if (pitch < rowBytes || size < pitch * (rows - 1) + rowBytes) return false;
+
+            if (proxyLevel_ == 0)
+            {
+                return Decode(input, dest, size, rowBytes, pitch);
+            }
+
+            // Proxies are encoded into a temporary buffer first.
+            FrameBuffer image(imageSize_);
+            if (!DecodeImage(input, image)) return false;
+            for (size_t row = 0; row < rows; row++)
+                std::memcpy(dest + pitch * row, image.data() + rowBytes * row, rowBytes);
+            return true;
+        }
+
+        // Bytes in a row of blocks
+        size_t GetRowBytes() const
+        {
+            return static_cast<size_t>((width_ + 3) / 4) * GetBppFromTypeID(typeID_) * 2;
+        }
+
+        #pragma endregion
+
+        #pragma region Pixel output
 
-            HapDecode(
-                input.storage.data(),
-                static_cast<unsigned long>(input.storage.size()),
-                0, hap_callback, nullptr,
-                buffer_.data(),
-                static_cast<unsigned long>(buffer_.size()),
-                nullptr, &format
-            );
+        // Expand every decoded frame into RGBA8 pixels (in the decoding
+        // thread) for targets without BC texture support and for CPU-side
+        // consumers. Only available for DXT1, DXT5 (Hap Q included) and BC4.
+        bool SetRGBAOutput(bool enable)
+        {
+            if (enable && !BlockDecoder::IsSupported(typeID_)) return false;
+
+            std::lock_guard<std::mutex> convert(convertLock_);
+            if (enable == rgbaOutput_.load()) return true;
+
+            auto bytes = static_cast<int64_t>(GetRGBABufferSize() * 2);
+
+            if (enable)
+            {
+                MemoryGovernor::Get().Add(MemoryGovernor::Decoder, bytes);
+                rgbaOutput_.store(true);
+                ConvertCurrent();
+            }
+            else
+            {
+                rgbaOutput_.store(false);
+                rgbaSpare_ = FrameBuffer();
+                std::lock_guard<std::mutex> lock(rgbaLock_);
+                rgba_ = FrameBuffer();
+                rgbaVersion_ = 0;
+                MemoryGovernor::Get().Add(MemoryGovernor::Decoder, -bytes);
+            }
+
+            return true;
+        }
+
+        bool IsRGBAOutputEnabled() const
+        {
+            return rgbaOutput_.load();
+        }
+
+        // Same contract as LockBuffer(). Returns nullptr when the RGBA output
+        // is disabled. Rows are tightly packed, the top row first.
+        const void* LockRGBABuffer()
+        {
+            rgbaLock_.lock();
+            if (rgba_.data() == nullptr) return nullptr;
+            uploaded_.store(rgbaVersion_);
+            return rgba_.data();
+        }
+
+        void UnlockRGBABuffer()
+        {
+            rgbaLock_.unlock();
+        }
+
+        size_t GetRGBABufferSize() const
+        {
+            return static_cast<size_t>(width_) * height_ * 4;
+        }
+
+        // Convert the current frame straight into the given memory (e.g. the
+        // frame buffers of a CPU-side consumer) with the given row pitch.
+        // They don't need the RGBA output.
+        bool CopyPixels(uint8_t* dest, size_t pitch)
+        {
+            auto image = GetImage();
+            return BlockDecoder::Convert(typeID_, image->data(), image->size(),
+                                         width_, height_, dest, pitch);
+        }
+
+        // R, G, B and A planes. Null planes are skipped.
+        bool CopyPlanes(uint8_t* const* planes, size_t pitch)
+        {
+            auto image = GetImage();
+            return BlockDecoder::ConvertPlanar(typeID_, image->data(), image->size(),
+                                               width_, height_, planes, pitch);
+        }
+
+        #pragma endregion
+
+        #pragma region Standby buffer
+
+        // Decode a frame into the standby buffer without changing the
+        // current one. Used to prepare the first frame of the next clip.
+        bool Predecode(const ReadBuffer& input)
+        {
+            auto image = std::make_shared<FrameBuffer>(size_);
+            if (!Decode(input, *image)) return false;
+
+            std::lock_guard<std::mutex> lock(standbyLock_);
+            standby_ = image;
+            standbySource_ = input.source;
+            standbyFrame_ = input.frame;
+            standbyHash_ = input.hash;
+            standbySize_ = input.GetSize();
+            return true;
+        }
+
+        // Make the standby buffer current. Must be called on the decoding
+        // thread (or while no decoding is in progress).
+        bool ShowStandby()
+        {
+            {
+                std::lock_guard<std::mutex> lock(bufferLock_);
+                std::lock_guard<std::mutex> standbyLock(standbyLock_);
+                if (!standby_) return false;
+                buffer_ = std::move(standby_);
+                residentSource_ = standbySource_;
+                residentFrame_ = standbyFrame_;
+                residentHash_ = standbyHash_;
+                residentSize_ = standbySize_;
+                version_++;
+            }
+
+            if (rgbaOutput_.load()) UpdateRGBA();
+            return true;
         }
 
         #pragma endregion
 
     private:
 
+        #pragma region Image update
+
+        void UpdateImage(const ReadBuffer& input)
+        {
+            auto& cache = FrameCache::Get();
+            auto& shared = SharedDecode::Get();
+            // Proxy images can't be shared with full resolution decoders.
+            auto shareable = input.source != 0 && proxyLevel_ == 0;
+            auto cacheable = shareable && cache.IsEnabled();
+
+            // Cache hit: Share the cached image without decoding.
+            if (cacheable)
+            {
+                auto image = cache.Find(input.source, input.frame);
+                if (image && image->size() == size_)
+                {
+                    std::lock_guard<std::mutex> lock(bufferLock_);
+                    buffer_ = image;
+                    SetResident(input);
+                    return;
+                }
+            }
+
+            // Another decoder (a player showing the same clip in sync) has
+            // decoded or is decoding the frame: Share its image.
+            auto leader = false;
+            if (shareable)
+            {
+                auto image = shared.Join(input.source, input.frame);
+                leader = !image;
+                if (image && image->size() == size_)
+                {
+                    std::lock_guard<std::mutex> lock(bufferLock_);
+                    buffer_ = image;
+                    SetResident(input);
+                    return;
+                }
+            }
+
+            FrameCache::Image image;
+
+            {
+                std::lock_guard<std::mutex> lock(bufferLock_);
+
+                // The current image may be shared with the cache or other
+                // decoders. Stop sharing it before checking the owners.
+                if (residentSource_ != 0)
+                    shared.Retract(residentSource_, residentFrame_, buffer_);
+                if (buffer_.use_count() > 1)
+                    buffer_ = std::make_shared<FrameBuffer>(size_);
+
+                if (Decode(input, *buffer_))
+                {
+                    SetResident(input);
+                    image = buffer_;
+                }
+                else
+                {
+                    SetResident(ReadBuffer());
+                }
+            }
+
+            // Hand the image over without the lock, as the cache may run the
+            // memory governor's reclaimers.
+            if (image && cacheable) cache.Insert(input.source, input.frame, image);
+            if (leader) shared.Publish(input.source, input.frame, image);
+        }
+
+        #pragma endregion
+
         #pragma region Internal-use members
 
-        std::vector<uint8_t> buffer_;
+        int proxyLevel_;
+        bool mipmaps_;
+        int sourceWidth_, sourceHeight_;
+        int width_, height_, typeID_;
+        size_t imageSize_, size_;
+        FrameCache::Image buffer_;
         std::mutex bufferLock_;
 
+        // Standby buffer for the first frame of the next clip
+        FrameCache::Image standby_;
+        std::mutex standbyLock_;
+        uint32_t standbySource_ = 0;
+        int standbyFrame_ = -1;
+        uint64_t standbyHash_ = 0;
+        size_t standbySize_ = 0;
+
+        // RGBA output (double-buffered, so that the conversion doesn't block
+        // the lock)
+        std::atomic<bool> rgbaOutput_{false};
+        FrameBuffer rgba_, rgbaSpare_;
+        uint32_t rgbaVersion_ = 0;
+        std::mutex rgbaLock_;
+        std::mutex convertLock_;
+
+        // Identity of the resident frame (only touched by the decoding thread)
+        uint32_t residentSource_ = 0;
+        int residentFrame_ = -1;
+        uint64_t residentHash_ = 0;
+        size_t residentSize_ = 0;
+
+        // Buffer change counters for skipping redundant uploads
+        std::atomic<uint32_t> version_{1};
+        std::atomic<uint32_t> uploaded_{0};
+
+        // Called with the buffer lock held.
+        void SetResident(const ReadBuffer& input)
+        {
+            residentSource_ = input.source;
+            residentFrame_ = input.frame;
+            residentHash_ = input.hash;
+            residentSize_ = input.GetSize();
+            version_++;
+        }
+
+        // Take a reference to the current image, so that it isn't
+        // overwritten by the decoding thread while reading it.
+        FrameCache::Image GetImage()
+        {
+            std::lock_guard<std::mutex> lock(bufferLock_);
+            return buffer_;
+        }
+
+        // Convert the current image into the RGBA buffer.
+        void UpdateRGBA()
+        {
+            std::lock_guard<std::mutex> convert(convertLock_);
+            if (rgbaOutput_.load()) ConvertCurrent();
+        }
+
+        // Called with the convert lock held.
+        void ConvertCurrent()
+        {
+            // Hold a reference, so that the image isn't overwritten by the
+            // decoding thread during the conversion.
+            FrameCache::Image image;
+            uint32_t version;
+            {
+                std::lock_guard<std::mutex> lock(bufferLock_);
+                image = buffer_;
+                version = version_.load();
+            }
+
+            if (version == rgbaVersion_) return;
+
+            rgbaSpare_.resize(GetRGBABufferSize());
+            if (!BlockDecoder::Convert(typeID_, image->data(), image->size(),
+                                       width_, height_, rgbaSpare_.data(), width_ * 4)) return;
+
+            std::lock_guard<std::mutex> lock(rgbaLock_);
+            std::swap(rgba_, rgbaSpare_);
+            rgbaVersion_ = version;
+        }
+
+        bool Decode(const ReadBuffer& input, FrameBuffer& output) const
+        {
+            if (!DecodeImage(input, output)) return false;
+            return !mipmaps_ || MipChain::Build(typeID_, output.data(), size_, width_, height_);
+        }
+
+        // Level 0 at the head of the output
+        bool DecodeImage(const ReadBuffer& input, FrameBuffer& output) const
+        {
+            if (proxyLevel_ == 0) return Decode(input, output.data(), imageSize_);
+
+            // Full resolution frame in a temporary (pooled) buffer, then
+            // reduced into the output
+            auto fullSize = static_cast<size_t>((sourceWidth_ + 3) / 4) *
+                            ((sourceHeight_ + 3) / 4) * GetBppFromTypeID(typeID_) * 2;
+            FrameBuffer full(fullSize);
+            if (!Decode(input, full.data(), fullSize)) return false;
+
+            return ProxyEncoder::Encode(typeID_, full.data(), fullSize,
+                                        sourceWidth_, sourceHeight_, proxyLevel_,
+                                        output.data(), imageSize_);
+        }
+
+        // A non-zero row size selects the strided output. Trusted input is
+        // decoded without validation.
+        static bool Decode(const ReadBuffer& input, void* output, size_t size,
+                           size_t rowBytes = 0, size_t pitch = 0)
+        {
+            unsigned int format;
+            unsigned int result;
+
+            if (input.trusted)
+            {
+                result = HapDecodeTrusted(
+                    input.GetData(),
+                    static_cast<unsigned long>(input.GetSize()),
+                    0, hap_callback, nullptr,
+                    output, static_cast<unsigned long>(size),
+                    static_cast<unsigned long>(rowBytes),
+                    static_cast<unsigned long>(pitch),
+                    nullptr, &format
+                );
+            }
+            else if (rowBytes != 0)
+            {
+                result = HapDecodeStrided(
+                    input.GetData(),
+                    static_cast<unsigned long>(input.GetSize()),
+                    0, hap_callback, nullptr,
+                    output, static_cast<unsigned long>(size),
+                    static_cast<unsigned long>(rowBytes),
+                    static_cast<unsigned long>(pitch),
+                    nullptr, &format
+                );
+            }
+            else
+            {
+                result = HapDecode(
+                    input.GetData(),
+                    static_cast<unsigned long>(input.GetSize()),
+                    0, hap_callback, nullptr,
+                    output,
+                    static_cast<unsigned long>(size),
+                    nullptr, &format
+                );
+            }
+
+            return result == HapResult_No_Error;
+        }
+
         static size_t GetBppFromTypeID(int typeID)
         {
             switch (typeID & 0xf)
@@ -76,6 +506,8 @@ namespace KlakHap
             case 0xe: return 8; // DXT5
             case 0xf: return 8; // DXT5
             case 0xc: return 8; // BC7
+            case 0x2: return 8; // BC6H (unsigned)
+            case 0x3: return 8; // BC6H (signed)
             case 0x1: return 4; // BC4
             }
             return 0;
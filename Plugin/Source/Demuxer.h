@@ -1,9 +1,19 @@
 #pragma once
 
 #include <stdint.h>
+#include <atomic>
 #include <cstring>
+#include <memory>
+#include <string>
 #include "mp4demux.h"
+#include "File.h"
+#include "FrameCache.h"
+#include "FrameIndex.h"
+#include "FrameStore.h"
+#include "IndexFile.h"
+#include "Preloader.h"
 #include "ReadBuffer.h"
+#include "Recovery.h"
 
 namespace KlakHap
 {
@@ -14,27 +24,42 @@ namespace KlakHap
         #pragma region Constructor/destructor
 
         Demuxer(const char* path)
+          : path_(path)
         {
-            std::memset(&demux_, 0, sizeof(MP4D_demux_t));
-
-        #ifdef _MSC_VER
-            if (fopen_s(&file_, path, "rb") != 0) return;
-        #else
-            file_ = fopen(path, "rb");
+            file_ = OpenFile(path, "rb");
             if (file_ == nullptr) return;
-        #endif
 
-            if (MP4D__open(&demux_, file_) == 0)
+            // Frame store, then the container index, then the sidecar index
+            if (FrameStore::IsFrameStore(file_))
+            {
+                if (!FrameStore::Read(file_, index_)) Close();
+            }
+            else if (!ReadMovieIndex() && !IndexFile::Read(IndexFile::GetPath(path), index_))
             {
-                fclose(file_);
-                file_ = nullptr;
+                Close();
             }
+
+            if (IsValid()) Initialize();
+        }
+
+        // Constructor with the recovery mode: Rebuild the frame index by
+        // scanning the media data when no index is available.
+        Demuxer(const char* path, int width, int height, double frameRate)
+          : Demuxer(path)
+        {
+            if (IsValid()) return;
+
+            file_ = OpenFile(path, "rb");
+            if (file_ == nullptr) return;
+
+            if (!Recovery::Scan(path, width, height, frameRate, index_)) Close();
+
+            if (IsValid()) Initialize();
         }
 
         ~Demuxer()
         {
-            MP4D__close(&demux_);
-            if (file_ != nullptr) fclose(file_);
+            Close();
         }
 
         #pragma endregion
@@ -46,43 +71,162 @@ namespace KlakHap
             return file_ != nullptr;
         }
 
-        const MP4D_track_t& GetVideoTrack() const
+        const FrameIndex& GetIndex() const
+        {
+            return index_;
+        }
+
+        int GetFrameCount() const
+        {
+            return static_cast<int>(index_.frames.size());
+        }
+
+        double GetDuration() const
+        {
+            return index_.duration;
+        }
+
+        int GetWidth() const
         {
-            return demux_.track[0];
+            return index_.width;
+        }
+
+        int GetHeight() const
+        {
+            return index_.height;
         }
 
         #pragma endregion
 
-        #pragma region Read methods
+        #pragma region Index methods
+
+        // Save the frame index as a sidecar file next to the movie file.
+        bool SaveIndex() const
+        {
+            return IsValid() && IndexFile::Write(IndexFile::GetPath(path_.c_str()), index_);
+        }
 
-        uint8_t ReadVideoTypeField()
+        #pragma endregion
+
+        #pragma region Preload methods
+
+        // Enable the preload mode: Frames are read from a memory arena that
+        // holds the whole clip (window = 0) or a window around the playhead
+        // that fits in the given byte budget.
+        //
+        // These can be called while a stream reader is running. The
+        // preloader is swapped atomically, and a reader keeps the old one
+        // alive until its current lookup is done.
+        void EnablePreload(uint64_t window)
+        {
+            if (!IsValid()) return;
+            // Release the old arena before loading the new one.
+            std::atomic_store(&preloader_, std::shared_ptr<Preloader>());
+            std::shared_ptr<Preloader> preloader(new Preloader(path_, index_, window, priority_));
+            std::atomic_store(&preloader_, preloader);
+        }
+
+        void DisablePreload()
+        {
+            std::atomic_store(&preloader_, std::shared_ptr<Preloader>());
+        }
+
+        uint64_t GetPreloadSize() const
+        {
+            auto preloader = std::atomic_load(&preloader_);
+            return preloader ? preloader->GetResidentSize() : 0;
+        }
+
+        // True while the preload arena is evicted (frames are read from the
+        // file until it's reloaded)
+        bool IsPreloadEvicted() const
+        {
+            auto preloader = std::atomic_load(&preloader_);
+            return preloader && preloader->IsEvicted();
+        }
+
+        // Priority of the preload arena in the memory governor
+        void SetPriority(int priority)
+        {
+            priority_ = priority;
+            auto preloader = std::atomic_load(&preloader_);
+            if (preloader) preloader->SetPriority(priority);
+        }
+
+        #pragma endregion
+
+        #pragma region Trusted input
+
+        // Mark the file as verified (e.g. against a checksum stored in a
+        // sidecar index). The frames read from it are decoded without
+        // validating the compressed data, which saves the per-element bounds
+        // checks and the duplicate length parsing in snappy. A corrupted
+        // file can crash the decoder in this mode, so it's opt-in.
+        void SetTrusted(bool trusted)
         {
-            // Data offset for the first frame
-            unsigned int size;
-            auto offs = MP4D__frame_offset(&demux_, 0, 0, &size, nullptr, nullptr);
+            trusted_.store(trusted);
+        }
+
+        bool IsTrusted() const
+        {
+            return trusted_.load();
+        }
 
-            // Read to a temporary buffer.
-            uint8_t temp;
-            fseek(file_, (long)offs + 3, SEEK_SET);
-            fread(&temp, 1, 1, file_);
+        #pragma endregion
+
+        #pragma region Read methods
 
-            return temp;
+        // Section type field of the first frame. It's read in the
+        // constructor, so that it doesn't move the file position under a
+        // stream reader.
+        uint8_t ReadVideoTypeField() const
+        {
+            return videoType_;
         }
 
         void ReadFrame(int index, ReadBuffer& buffer)
         {
-            // Frame data offset
-            unsigned int inSize, timestamp, duration;
-            auto inOffs = MP4D__frame_offset(&demux_, 0, index, &inSize, &timestamp, &duration);
+            ReadFrame(index, buffer, file_);
+        }
+
+        // Read a frame through a separate file handle. This can be called
+        // from multiple threads, each with its own handle.
+        void ReadFrame(int index, ReadBuffer& buffer, FILE* file)
+        {
+            buffer.ClearView();
+
+            if (index < 0 || index >= GetFrameCount())
+            {
+                buffer.storage.clear();
+                buffer.source = 0;
+                buffer.frame = -1;
+                buffer.hash = 0;
+                buffer.trusted = false;
+                return;
+            }
 
-            // Frame data read
-        #if defined(_WIN32)
-            _fseeki64(file_, inOffs, SEEK_SET);
-        #else
-            fseek(file_, inOffs, SEEK_SET);
-        #endif
-            buffer.storage.resize(inSize);
-            fread(buffer.storage.data(), inSize, 1, file_);
+            buffer.source = source_;
+            buffer.frame = index;
+            buffer.trusted = trusted_.load();
+
+            // Preloaded frame: No copy needed.
+            auto preloader = std::atomic_load(&preloader_);
+            if (!preloader || !preloader->Lookup(index, buffer))
+            {
+                // Frame data read
+                const auto& frame = index_.frames[index];
+                SeekFile(file, frame.offset);
+                buffer.storage.resize(frame.size);
+                fread(buffer.storage.data(), frame.size, 1, file);
+            }
+
+            buffer.hash = GetFrameHash(index, buffer);
+        }
+
+        // Open an extra file handle for ReadFrame. Should be closed with fclose.
+        FILE* OpenReadHandle() const
+        {
+            return OpenFile(path_.c_str(), "rb");
         }
 
         #pragma endregion
@@ -91,8 +235,128 @@ namespace KlakHap
 
         #pragma region Private members
 
+        std::string path_;
         FILE* file_ = nullptr;
-        MP4D_demux_t demux_;
+        uint32_t source_ = 0;
+        std::unique_ptr<std::atomic<uint64_t>[]> hashes_;
+        FrameIndex index_;
+        std::shared_ptr<Preloader> preloader_;
+        int priority_ = 0;
+        uint8_t videoType_ = 0;
+        std::atomic<bool> trusted_{false};
+
+        // Called once the index is ready, before any reader exists.
+        void Initialize()
+        {
+            IdentifySource();
+
+            // Section type field of the first frame
+            if (!index_.frames.empty())
+            {
+                SeekFile(file_, index_.frames[0].offset + 3);
+                if (fread(&videoType_, 1, 1, file_) != 1) videoType_ = 0;
+            }
+        }
+
+        void IdentifySource()
+        {
+            source_ = FrameCache::Get().GetSourceID(path_, GetFileSize(file_));
+            hashes_.reset(new std::atomic<uint64_t>[index_.frames.size()]());
+        }
+
+        // Payload hash for duplicate frame detection. It's only computed for
+        // frames that have the same size as one of their neighbors (a hold
+        // frame can't be anything else), and cached in the hash table.
+        uint64_t GetFrameHash(int index, const ReadBuffer& buffer)
+        {
+            const auto& frames = index_.frames;
+            auto count = GetFrameCount();
+            auto size = frames[index].size;
+            if (buffer.GetSize() != size) return 0;
+            if (size != frames[(index + count - 1) % count].size &&
+                size != frames[(index + 1) % count].size) return 0;
+
+            auto hash = hashes_[index].load(std::memory_order_relaxed);
+            if (hash == 0)
+            {
+                hash = buffer.ComputeHash();
+                hashes_[index].store(hash, std::memory_order_relaxed);
+            }
+            return hash;
+        }
+
+        void Close()
+        {
+            if (file_ != nullptr) fclose(file_);
+            file_ = nullptr;
+        }
+
+        #pragma endregion
+
+        #pragma region MP4 index reader
+
+        // Build the frame index from the MP4/MOV sample tables.
+        bool ReadMovieIndex()
+        {
+            MP4D_demux_t demux;
+            std::memset(&demux, 0, sizeof(MP4D_demux_t));
+            if (MP4D__open_ex(&demux, file_, MP4D_OPEN_HAP_VIDEO_ONLY) == 0) return false;
+
+            // Only the Hap video track has its sample tables loaded.
+            auto ntrack = 0u;
+            while (ntrack < demux.track_count && demux.track[ntrack].sample_count == 0) ntrack++;
+
+            if (ntrack == demux.track_count)
+            {
+                MP4D__close(&demux);
+                return false;
+            }
+
+            const auto& track = demux.track[ntrack];
+
+            auto dur = static_cast<double>(track.duration_hi);
+            dur = dur * 0x100000000L + track.duration_lo;
+
+            index_.width = track.SampleDescription.video.width;
+            index_.height = track.SampleDescription.video.height;
+            index_.duration = track.timescale > 0 ? dur / track.timescale : 0;
+            index_.frames.reserve(track.sample_count);
+
+            // Walk through the chunks in a single pass. Note that a track
+            // with a single chunk has all the samples in it.
+            auto group = 0u;
+            auto sample = 0u;
+            for (auto chunk = 0u; chunk < track.chunk_count && sample < track.sample_count; chunk++)
+            {
+                if (group + 1 < track.sample_to_chunk_count &&
+                    chunk + 1 == track.sample_to_chunk[group + 1].first_chunk) group++;
+
+                auto count = track.chunk_count == 1 || track.sample_to_chunk_count == 0 ?
+                    track.sample_count : track.sample_to_chunk[group].samples_per_chunk;
+
+                auto offset = track.chunk_offset[chunk];
+                for (auto i = 0u; i < count && sample < track.sample_count; i++)
+                {
+                    FrameIndex::Entry entry = { offset, track.entry_size[sample] };
+                    index_.frames.push_back(entry);
+                    offset += track.entry_size[sample++];
+                }
+            }
+
+            // Sample times (stts), only when they cover all the frames
+            if (track.timescale > 0 && track.timestamp != nullptr &&
+                track.timestamp_count >= index_.frames.size())
+            {
+                index_.times.reserve(index_.frames.size());
+                for (auto i = 0u; i < index_.frames.size(); i++)
+                    index_.times.push_back(static_cast<double>(track.timestamp[i]) / track.timescale);
+            }
+
+            MP4D__close(&demux);
+
+            if (index_.IsEmpty()) index_.Clear();
+            return !index_.IsEmpty();
+        }
 
         #pragma endregion
     };
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+
+namespace KlakHap
+{
+    // Portable wrappers for the stdio functions that differ between platforms
+
+    inline FILE* OpenFile(const char* path, const char* mode)
+    {
+    #ifdef _MSC_VER
+        FILE* file;
+        if (fopen_s(&file, path, mode) != 0) return nullptr;
+        return file;
+    #else
+        return fopen(path, mode);
+    #endif
+    }
+
+    inline bool SeekFile(FILE* file, uint64_t offset)
+    {
+    #if defined(_WIN32)
+        return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+    #else
+        return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+    #endif
+    }
+
+    inline uint64_t GetFileSize(FILE* file)
+    {
+    #if defined(_WIN32)
+        _fseeki64(file, 0, SEEK_END);
+        auto size = _ftelli64(file);
+    #else
+        fseeko(file, 0, SEEK_END);
+        auto size = ftello(file);
+    #endif
+        return size < 0 ? 0 : static_cast<uint64_t>(size);
+    }
+}
@@ -0,0 +1,353 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstddef>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <new>
+#include "MemoryGovernor.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace KlakHap
+{
+    //
+    // Frame buffer pool
+    //
+    // Page-level allocator for frame-sized buffers (compressed frames in the
+    // stream readers and decoded images). Blocks are mapped directly from
+    // the OS, backed by huge pages when possible and prefaulted, so that the
+    // readers and decoders don't take page faults while filling them.
+    // Released blocks are kept in the pool (up to the retention limit) and
+    // reused by any stream, without clearing them.
+    //
+    class FramePool
+    {
+    public:
+
+        // Intentionally leaked, so that buffers released during static
+        // destruction can still be returned to the pool.
+        static FramePool& Get()
+        {
+            static FramePool* instance = new FramePool();
+            return *instance;
+        }
+
+        #pragma region Block allocation
+
+        // Returns a block of at least the given size, or nullptr on failure.
+        // The actual size of the block is stored in capacity.
+        void* Acquire(size_t size, size_t& capacity)
+        {
+            capacity = RoundUp(size);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                // Reuse a pooled block unless it's much larger than needed.
+                auto it = free_.lower_bound(capacity);
+                if (it != free_.end() && it->first <= capacity + capacity / 2)
+                {
+                    auto block = it->second;
+                    capacity = it->first;
+                    free_.erase(it);
+                    Account(-static_cast<int64_t>(capacity));
+                    return block;
+                }
+            }
+
+            return Map(capacity);
+        }
+
+        void Release(void* block, size_t capacity)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (pooled_ + capacity <= retention_)
+                {
+                    free_.insert(std::make_pair(capacity, block));
+                    Account(static_cast<int64_t>(capacity));
+                    return;
+                }
+            }
+
+            Unmap(block, capacity);
+        }
+
+        #pragma endregion
+
+        #pragma region Pool control
+
+        void SetRetention(uint64_t bytes)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            retention_ = bytes;
+            while (pooled_ > retention_) UnmapLargest();
+        }
+
+        uint64_t GetRetention() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return retention_;
+        }
+
+        uint64_t GetPooledBytes() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return pooled_;
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        static const size_t kSmallUnit = 64 << 10;
+        static const size_t kHugePageSize = 2 << 20;
+
+        FramePool()
+        {
+            MemoryGovernor::Get().Register(MemoryGovernor::FramePool, 0,
+                [this](uint64_t bytes) { return Reclaim(bytes); });
+        }
+
+        mutable std::mutex mutex_;
+        std::multimap<size_t, void*> free_;
+        uint64_t pooled_ = 0;
+        uint64_t retention_ = 256ull << 20;
+
+        // Small blocks are rounded up to 64 KiB, large ones to the huge page
+        // size, so that blocks of similar frames fall into the same class.
+        static size_t RoundUp(size_t size)
+        {
+            auto unit = size < kHugePageSize ? kSmallUnit : kHugePageSize;
+            return (size + unit - 1) / unit * unit;
+        }
+
+        // Called with the lock held.
+        void Account(int64_t bytes)
+        {
+            pooled_ += bytes;
+            MemoryGovernor::Get().Add(MemoryGovernor::FramePool, bytes);
+        }
+
+        // Called with the lock held.
+        void UnmapLargest()
+        {
+            auto it = std::prev(free_.end());
+            Unmap(it->second, it->first);
+            Account(-static_cast<int64_t>(it->first));
+            free_.erase(it);
+        }
+
+        // Called by the memory governor under pressure.
+        uint64_t Reclaim(uint64_t bytes)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto before = pooled_;
+            while (before - pooled_ < bytes && !free_.empty()) UnmapLargest();
+            return before - pooled_;
+        }
+
+        #pragma endregion
+
+        #pragma region Platform-specific page mapping
+
+        // Touch every page so that the faults are taken here, not while
+        // filling the buffer.
+        static void Prefault(void* block, size_t size)
+        {
+            auto p = static_cast<volatile uint8_t*>(block);
+            for (size_t i = 0; i < size; i += 4096) p[i] = 0;
+        }
+
+    #if defined(_WIN32)
+
+        static void* Map(size_t size)
+        {
+            // Large pages need the "Lock pages in memory" privilege. They're
+            // committed and locked on allocation, so no prefault is needed.
+            static const auto large = GetLargePageMinimum();
+            if (large > 0 && size % large == 0)
+            {
+                auto p = VirtualAlloc(nullptr, size,
+                    MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+                if (p != nullptr) return p;
+            }
+
+            auto p = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            if (p != nullptr) Prefault(p, size);
+            return p;
+        }
+
+        static void Unmap(void* block, size_t)
+        {
+            VirtualFree(block, 0, MEM_RELEASE);
+        }
+
+    #else
+
+        static void* Map(size_t size)
+        {
+            const auto prot = PROT_READ | PROT_WRITE;
+            const auto flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+            if (size < kHugePageSize)
+            {
+                auto p = mmap(nullptr, size, prot, flags, -1, 0);
+                if (p == MAP_FAILED) return nullptr;
+                Prefault(p, size);
+                return p;
+            }
+
+        #if defined(MAP_HUGETLB) && defined(MAP_POPULATE)
+            // Explicit huge pages (only available when reserved by the system)
+            auto huge = mmap(nullptr, size, prot, flags | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+            if (huge != MAP_FAILED) return huge;
+        #endif
+
+            // Map with an extra huge page and trim both ends, so that the
+            // block is aligned for transparent huge pages.
+            auto raw = mmap(nullptr, size + kHugePageSize, prot, flags, -1, 0);
+            if (raw == MAP_FAILED) return nullptr;
+
+            auto addr = reinterpret_cast<uintptr_t>(raw);
+            auto aligned = (addr + kHugePageSize - 1) & ~(uintptr_t)(kHugePageSize - 1);
+            auto head = aligned - addr;
+            if (head > 0) munmap(raw, head);
+            munmap(reinterpret_cast<void*>(aligned + size), kHugePageSize - head);
+
+            auto p = reinterpret_cast<void*>(aligned);
+        #if defined(MADV_HUGEPAGE)
+            madvise(p, size, MADV_HUGEPAGE);
+        #endif
+            Prefault(p, size);
+            return p;
+        }
+
+        static void Unmap(void* block, size_t size)
+        {
+            munmap(block, size);
+        }
+
+    #endif
+
+        #pragma endregion
+    };
+
+    //
+    // Frame buffer
+    //
+    // Move-only byte buffer allocated from the frame buffer pool. It can be
+    // used in place of std::vector<uint8_t>, except that resize() neither
+    // preserves nor initializes the contents.
+    //
+    class FrameBuffer
+    {
+    public:
+
+        #pragma region Constructor/destructor
+
+        FrameBuffer() {}
+
+        explicit FrameBuffer(size_t size)
+        {
+            resize(size);
+        }
+
+        ~FrameBuffer()
+        {
+            Free();
+        }
+
+        FrameBuffer(const FrameBuffer&) = delete;
+        FrameBuffer& operator=(const FrameBuffer&) = delete;
+
+        FrameBuffer(FrameBuffer&& other)
+          : data_(other.data_), size_(other.size_), capacity_(other.capacity_)
+        {
+            other.data_ = nullptr;
+            other.size_ = other.capacity_ = 0;
+        }
+
+        FrameBuffer& operator=(FrameBuffer&& other)
+        {
+            if (this != &other)
+            {
+                Free();
+                data_ = other.data_;
+                size_ = other.size_;
+                capacity_ = other.capacity_;
+                other.data_ = nullptr;
+                other.size_ = other.capacity_ = 0;
+            }
+            return *this;
+        }
+
+        #pragma endregion
+
+        #pragma region Public accessors
+
+        uint8_t* data() { return data_; }
+        const uint8_t* data() const { return data_; }
+        size_t size() const { return size_; }
+        size_t capacity() const { return capacity_; }
+
+        #pragma endregion
+
+        #pragma region Public methods
+
+        // The contents are undefined after resizing. The block is kept when
+        // the new size fits in it.
+        void resize(size_t size)
+        {
+            if (size > capacity_)
+            {
+                Free();
+                size_t capacity;
+                auto block = FramePool::Get().Acquire(size, capacity);
+                if (block == nullptr) throw std::bad_alloc();
+                data_ = static_cast<uint8_t*>(block);
+                capacity_ = capacity;
+            }
+            size_ = size;
+        }
+
+        // Keeps the block for reuse.
+        void clear()
+        {
+            size_ = 0;
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        uint8_t* data_ = nullptr;
+        size_t size_ = 0;
+        size_t capacity_ = 0;
+
+        void Free()
+        {
+            if (data_ != nullptr) FramePool::Get().Release(data_, capacity_);
+            data_ = nullptr;
+            size_ = capacity_ = 0;
+        }
+
+        #pragma endregion
+    };
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "FrameBuffer.h"
+#include "MemoryGovernor.h"
+
+namespace KlakHap
+{
+    //
+    // Decoded frame cache
+    //
+    // A global LRU cache of decoded (DXT/BC) frames keyed by source file and
+    // frame index. Short loops that fit in the budget are decoded only once;
+    // later iterations share the cached images without copying. Disabled
+    // while the budget is zero (default).
+    //
+    // Cached images are immutable. A decoder that holds a cached image must
+    // allocate a new one before decoding into it.
+    //
+    class FrameCache
+    {
+    public:
+
+        using Image = std::shared_ptr<FrameBuffer>;
+
+        static FrameCache& Get()
+        {
+            static FrameCache instance;
+            return instance;
+        }
+
+        #pragma region Source identification
+
+        // Returns a non-zero ID for a source file. The file size is taken
+        // into account, so that a rewritten file doesn't hit stale frames.
+        uint32_t GetSourceID(const std::string& path, uint64_t size)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto key = path + '\n' + std::to_string(size);
+            auto it = sources_.find(key);
+            if (it != sources_.end()) return it->second;
+            auto id = static_cast<uint32_t>(sources_.size() + 1);
+            sources_[key] = id;
+            return id;
+        }
+
+        #pragma endregion
+
+        #pragma region Cache operations
+
+        bool IsEnabled() const
+        {
+            return budget_.load(std::memory_order_relaxed) > 0;
+        }
+
+        Image Find(uint32_t source, int frame)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            auto it = map_.find(MakeKey(source, frame));
+            if (it == map_.end())
+            {
+                misses_++;
+                return nullptr;
+            }
+
+            // Move the entry to the front (most recently used).
+            lru_.splice(lru_.begin(), lru_, it->second);
+            hits_++;
+            return it->second->image;
+        }
+
+        void Insert(uint32_t source, int frame, Image image)
+        {
+            auto size = static_cast<uint64_t>(image->size());
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                auto budget = budget_.load(std::memory_order_relaxed);
+                if (size > budget) return;
+
+                auto key = MakeKey(source, frame);
+                if (map_.count(key) > 0) return;
+
+                lru_.push_front(Entry{ key, std::move(image) });
+                map_[key] = lru_.begin();
+                usage_ += size;
+                MemoryGovernor::Get().Add(MemoryGovernor::FrameCache, static_cast<int64_t>(size));
+
+                EvictOverBudget(budget);
+            }
+
+            MemoryGovernor::Get().Enforce();
+        }
+
+        #pragma endregion
+
+        #pragma region Budget and statistics
+
+        void SetBudget(uint64_t bytes)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            budget_.store(bytes, std::memory_order_relaxed);
+            EvictOverBudget(bytes);
+        }
+
+        uint64_t GetBudget() const
+        {
+            return budget_.load(std::memory_order_relaxed);
+        }
+
+        uint64_t GetUsage() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return usage_;
+        }
+
+        uint64_t GetHitCount() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return hits_;
+        }
+
+        uint64_t GetMissCount() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return misses_;
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        struct Entry
+        {
+            uint64_t key;
+            Image image;
+        };
+
+        FrameCache()
+        {
+            clientID_ = MemoryGovernor::Get().Register(MemoryGovernor::FrameCache, 0,
+                [this](uint64_t bytes) { return Reclaim(bytes); });
+        }
+
+        ~FrameCache()
+        {
+            MemoryGovernor::Get().Unregister(clientID_);
+        }
+
+        int clientID_;
+        mutable std::mutex mutex_;
+        std::unordered_map<std::string, uint32_t> sources_;
+        std::list<Entry> lru_;
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> map_;
+        std::atomic<uint64_t> budget_{0};
+        uint64_t usage_ = 0;
+        uint64_t hits_ = 0;
+        uint64_t misses_ = 0;
+
+        static uint64_t MakeKey(uint32_t source, int frame)
+        {
+            return (static_cast<uint64_t>(source) << 32) | static_cast<uint32_t>(frame);
+        }
+
+        void EvictOverBudget(uint64_t budget)
+        {
+            while (usage_ > budget && !lru_.empty()) EvictLast();
+        }
+
+        void EvictLast()
+        {
+            auto size = lru_.back().image->size();
+            usage_ -= size;
+            MemoryGovernor::Get().Add(MemoryGovernor::FrameCache, -static_cast<int64_t>(size));
+            map_.erase(lru_.back().key);
+            lru_.pop_back();
+        }
+
+        // Called by the memory governor under pressure.
+        uint64_t Reclaim(uint64_t bytes)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto before = usage_;
+            while (before - usage_ < bytes && !lru_.empty()) EvictLast();
+            return before - usage_;
+        }
+
+        #pragma endregion
+    };
+}
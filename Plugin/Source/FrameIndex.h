@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace KlakHap
+{
+    // Flat table of the video frames in a stream
+    // Any container or recovery method ends up filling this table, so that
+    // the demuxer can locate a frame with a single lookup.
+    struct FrameIndex
+    {
+        struct Entry
+        {
+            uint64_t offset;
+            uint32_t size;
+        };
+
+        int width = 0;
+        int height = 0;
+        double duration = 0;
+        std::vector<Entry> frames;
+
+        // Presentation time of each frame in seconds, from the container's
+        // sample timing. Empty when the source has none (e.g. recovered
+        // streams); Frames are evenly spaced then.
+        std::vector<double> times;
+
+        bool IsEmpty() const
+        {
+            return frames.empty();
+        }
+
+        void Clear()
+        {
+            width = height = 0;
+            duration = 0;
+            frames.clear();
+            times.clear();
+        }
+    };
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "File.h"
+#include "FrameIndex.h"
+#include "ReadBuffer.h"
+
+namespace KlakHap
+{
+    //
+    // Hap frame store
+    //
+    // A flat container made for random access: A header, a fixed-width frame
+    // table (offset/size/presentation time), then the Hap payloads, each of
+    // them starting on a page boundary. A frame can be located with a single
+    // table lookup, and the payloads can be read with O_DIRECT or mapped into
+    // memory without copying. All fields are little-endian.
+    //
+    class FrameStore
+    {
+    public:
+
+        #pragma region Public methods
+
+        // Check the magic number of an open file.
+        static bool IsFrameStore(FILE* file)
+        {
+            char magic[4];
+            auto ok = SeekFile(file, 0) && fread(magic, 4, 1, file) == 1 &&
+                      std::memcmp(magic, Magic(), 4) == 0;
+            SeekFile(file, 0);
+            return ok;
+        }
+
+        static bool Read(FILE* file, FrameIndex& index)
+        {
+            if (!IsFrameStore(file)) return false;
+
+            auto fileSize = GetFileSize(file);
+
+            Header header;
+            auto ok = SeekFile(file, 0) &&
+                      fread(&header, sizeof(header), 1, file) == 1 &&
+                      IsCompatible(header) &&
+                      header.tableOffset <= fileSize &&
+                      header.frameCount <= (fileSize - header.tableOffset) / sizeof(Entry) &&
+                      SeekFile(file, header.tableOffset);
+
+            if (ok)
+            {
+                index.width = header.width;
+                index.height = header.height;
+                index.duration = header.duration;
+                index.frames.resize(header.frameCount);
+                index.times.resize(header.frameCount);
+
+                for (auto i = 0u; i < header.frameCount; i++)
+                {
+                    Entry entry;
+                    if (fread(&entry, sizeof(entry), 1, file) != 1 ||
+                        entry.offset % header.alignment != 0 ||
+                        entry.offset + entry.size > fileSize)
+                    {
+                        ok = false;
+                        break;
+                    }
+                    index.frames[i].offset = entry.offset;
+                    index.frames[i].size = entry.size;
+                    index.times[i] = entry.time;
+                }
+            }
+
+            if (!ok) index.Clear();
+            return ok;
+        }
+
+        // Write a frame store from a frame index and a frame source that
+        // provides ReadFrame(int, ReadBuffer&) (e.g. Demuxer).
+        template <typename Source>
+        static bool Write(const std::string& path, const FrameIndex& index, Source& source)
+        {
+            if (index.IsEmpty()) return false;
+
+            auto file = OpenFile(path.c_str(), "wb");
+            if (file == nullptr) return false;
+
+            auto count = static_cast<uint32_t>(index.frames.size());
+
+            Header header = {};
+            std::memcpy(header.magic, Magic(), 4);
+            header.version = kVersion;
+            header.width = static_cast<uint32_t>(index.width);
+            header.height = static_cast<uint32_t>(index.height);
+            header.frameCount = count;
+            header.alignment = kAlignment;
+            header.duration = index.duration;
+            header.tableOffset = sizeof(Header);
+
+            // Frame table layout: The source's sample times are kept as they
+            // are. Frames without timing are evenly spaced.
+            auto timed = index.times.size() == index.frames.size();
+            std::vector<Entry> table(count);
+            auto offset = Align(header.tableOffset + sizeof(Entry) * count);
+            for (auto i = 0u; i < count; i++)
+            {
+                table[i].offset = offset;
+                table[i].size = index.frames[i].size;
+                table[i].reserved = 0;
+                table[i].time = timed ? index.times[i] : index.duration * i / count;
+                offset = Align(offset + table[i].size);
+            }
+
+            auto ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                      fwrite(table.data(), sizeof(Entry), count, file) == count;
+
+            // Payloads with zero padding
+            ReadBuffer buffer;
+            std::vector<uint8_t> padding(kAlignment, 0);
+            auto pos = header.tableOffset + sizeof(Entry) * count;
+
+            for (auto i = 0u; ok && i < count; i++)
+            {
+                source.ReadFrame(static_cast<int>(i), buffer);
+                auto size = buffer.GetSize();
+
+                ok = size == table[i].size &&
+                     fwrite(padding.data(), 1, table[i].offset - pos, file) == table[i].offset - pos &&
+                     fwrite(buffer.GetData(), 1, size, file) == size;
+
+                pos = table[i].offset + size;
+            }
+
+            // Pad the tail, so that the last page can be read as a whole.
+            ok = ok && fwrite(padding.data(), 1, Align(pos) - pos, file) == Align(pos) - pos;
+
+            ok = fclose(file) == 0 && ok;
+            if (!ok) std::remove(path.c_str());
+            return ok;
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region File layout
+
+        static const char* Magic() { return "KHFS"; }
+        static const uint32_t kVersion = 1;
+        static const uint32_t kAlignment = 4096;
+
+        struct Header
+        {
+            char magic[4];
+            uint32_t version;
+            uint32_t width;
+            uint32_t height;
+            uint32_t frameCount;
+            uint32_t alignment;
+            double duration;
+            uint64_t tableOffset;
+            uint64_t reserved[3];
+        };
+
+        struct Entry
+        {
+            uint64_t offset;
+            uint32_t size;
+            uint32_t reserved;
+            double time;
+        };
+
+        static_assert(sizeof(Header) == 64, "Unexpected header layout");
+        static_assert(sizeof(Entry) == 24, "Unexpected entry layout");
+
+        static bool IsCompatible(const Header& header)
+        {
+            return std::memcmp(header.magic, Magic(), 4) == 0 &&
+                   header.version == kVersion &&
+                   header.frameCount > 0 && header.duration > 0 &&
+                   header.alignment > 0 && header.tableOffset >= sizeof(Header);
+        }
+
+        static uint64_t Align(uint64_t offset)
+        {
+            return (offset + kAlignment - 1) / kAlignment * kAlignment;
+        }
+
+        #pragma endregion
+    };
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "File.h"
+#include "FrameIndex.h"
+
+namespace KlakHap
+{
+    //
+    // Sidecar index file
+    //
+    // Stores a frame index next to a movie file (<movie>.hapidx), so that a
+    // file without a usable container index can be opened without scanning
+    // it again. All fields are little-endian.
+    //
+    class IndexFile
+    {
+    public:
+
+        #pragma region Public methods
+
+        static std::string GetPath(const char* moviePath)
+        {
+            return std::string(moviePath) + ".hapidx";
+        }
+
+        static bool Read(const std::string& path, FrameIndex& index)
+        {
+            auto file = OpenFile(path.c_str(), "rb");
+            if (file == nullptr) return false;
+
+            // The frame count is checked against the file size before the
+            // table is allocated.
+            auto fileSize = GetFileSize(file);
+
+            Header header;
+            auto ok = SeekFile(file, 0) &&
+                      fread(&header, sizeof(header), 1, file) == 1 &&
+                      IsCompatible(header) &&
+                      header.frameCount <= (fileSize - sizeof(Header)) / sizeof(Entry);
+
+            if (ok)
+            {
+                index.width = header.width;
+                index.height = header.height;
+                index.duration = header.duration;
+                index.frames.resize(header.frameCount);
+
+                for (auto& frame : index.frames)
+                {
+                    Entry entry;
+                    if (fread(&entry, sizeof(entry), 1, file) != 1)
+                    {
+                        ok = false;
+                        break;
+                    }
+                    frame.offset = entry.offset;
+                    frame.size = entry.size;
+                }
+            }
+
+            fclose(file);
+            if (!ok) index.Clear();
+            return ok;
+        }
+
+        static bool Write(const std::string& path, const FrameIndex& index)
+        {
+            auto file = OpenFile(path.c_str(), "wb");
+            if (file == nullptr) return false;
+
+            Header header = {};
+            std::memcpy(header.magic, Magic(), 4);
+            header.version = kVersion;
+            header.width = static_cast<uint32_t>(index.width);
+            header.height = static_cast<uint32_t>(index.height);
+            header.frameCount = static_cast<uint32_t>(index.frames.size());
+            header.duration = index.duration;
+
+            auto ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+            for (auto i = 0u; ok && i < index.frames.size(); i++)
+            {
+                Entry entry = {};
+                entry.offset = index.frames[i].offset;
+                entry.size = index.frames[i].size;
+                ok = fwrite(&entry, sizeof(entry), 1, file) == 1;
+            }
+
+            fclose(file);
+            if (!ok) std::remove(path.c_str());
+            return ok;
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region File layout
+
+        static const char* Magic() { return "KHIX"; }
+        static const uint32_t kVersion = 1;
+
+        struct Header
+        {
+            char magic[4];
+            uint32_t version;
+            uint32_t width;
+            uint32_t height;
+            uint32_t frameCount;
+            uint32_t reserved;
+            double duration;
+        };
+
+        struct Entry
+        {
+            uint64_t offset;
+            uint32_t size;
+            uint32_t reserved;
+        };
+
+        static_assert(sizeof(Header) == 32, "Unexpected header layout");
+        static_assert(sizeof(Entry) == 16, "Unexpected entry layout");
+
+        static bool IsCompatible(const Header& header)
+        {
+            return std::memcmp(header.magic, Magic(), 4) == 0 &&
+                   header.version == kVersion &&
+                   header.frameCount > 0 && header.duration > 0;
+        }
+
+        #pragma endregion
+    };
+}
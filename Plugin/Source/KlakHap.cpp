@@ -1,7 +1,14 @@
+#include <algorithm>
 #include <unordered_map>
+#include "Atlas.h"
+#include "ClipLoader.h"
 #include "Decoder.h"
 #include "Demuxer.h"
+#include "FrameCache.h"
+#include "MemoryGovernor.h"
 #include "ReadBuffer.h"
+#include "Scheduler.h"
+#include "StreamReader.h"
 #include "IUnityRenderingExtensions.h"
 
 #if defined(_WIN32)
@@ -19,6 +26,9 @@ namespace
 
     std::unordered_map<uint32_t, Decoder*> decoderMap_;
 
+    // Atlas decoders share the callback with their own IDs.
+    std::unordered_map<uint32_t, Atlas*> atlasMap_;
+
     #pragma endregion
 
     #pragma region Texture update callback implementation
@@ -43,11 +53,19 @@ namespace
         case kUnityRenderingExtFormatRGBA_DXT5_UNorm:
         case kUnityRenderingExtFormatRGBA_BC7_SRGB:
         case kUnityRenderingExtFormatRGBA_BC7_UNorm:
+        case kUnityRenderingExtFormatRGB_BC6H_UFloat:
+        case kUnityRenderingExtFormatRGB_BC6H_SFloat:
             return 4;
         }
         return 0;
     }
 
+    bool IsRGBAFormat(UnityRenderingExtTextureFormat format)
+    {
+        return format == kUnityRenderingExtFormatR8G8B8A8_SRGB ||
+               format == kUnityRenderingExtFormatR8G8B8A8_UNorm;
+    }
+
     // Callback for texture update events
     void TextureUpdateCallback(int eventID, void* data)
     {
@@ -57,8 +75,25 @@ namespace
         {
             // UpdateTextureBegin: Return texture image data.
             auto params = reinterpret_cast<UnityRenderingExtTextureUpdateParamsV2*>(data);
+
+            auto atlas = atlasMap_.find(params->userData);
+            if (atlas != atlasMap_.end())
+            {
+                params->bpp = GetFakeBpp(params->format);
+                params->texData = const_cast<void*>(atlas->second->LockBuffer());
+                return;
+            }
+
             auto it = decoderMap_.find(params->userData);
-            if (it != decoderMap_.end())
+            if (it == decoderMap_.end()) return;
+
+            if (IsRGBAFormat(params->format))
+            {
+                // Fallback texture for targets without BC support
+                params->bpp = 4;
+                params->texData = const_cast<void*>(it->second->LockRGBABuffer());
+            }
+            else
             {
                 params->bpp = GetFakeBpp(params->format);
                 params->texData = const_cast<void*>(it->second->LockBuffer());
@@ -68,8 +103,21 @@ namespace
         {
             // UpdateTextureEnd:
             auto params = reinterpret_cast<UnityRenderingExtTextureUpdateParamsV2*>(data);
+
+            auto atlas = atlasMap_.find(params->userData);
+            if (atlas != atlasMap_.end())
+            {
+                atlas->second->UnlockBuffer();
+                return;
+            }
+
             auto it = decoderMap_.find(params->userData);
-            if (it != decoderMap_.end()) it->second->UnlockBuffer();
+            if (it == decoderMap_.end()) return;
+
+            if (IsRGBAFormat(params->format))
+                it->second->UnlockRGBABuffer();
+            else
+                it->second->UnlockBuffer();
         }
     }
 
@@ -118,6 +166,11 @@ extern "C" Demuxer UNITY_INTERFACE_EXPORT * KlakHap_OpenDemuxer(const char* file
     return new Demuxer(filepath);
 }
 
+extern "C" Demuxer UNITY_INTERFACE_EXPORT * KlakHap_OpenDemuxerWithRecovery(const char* filepath, int width, int height, double frameRate)
+{
+    return new Demuxer(filepath, width, height, frameRate);
+}
+
 extern "C" void UNITY_INTERFACE_EXPORT KlakHap_CloseDemuxer(Demuxer* demuxer)
 {
     if (demuxer != nullptr) delete demuxer;
@@ -129,31 +182,34 @@ extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_DemuxerIsValid(Demuxer* demuxe
     return demuxer->IsValid() ? 1 : 0;
 }
 
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_SaveDemuxerIndex(Demuxer* demuxer)
+{
+    if (demuxer == nullptr) return 0;
+    return demuxer->SaveIndex() ? 1 : 0;
+}
+
 extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_CountFrames(Demuxer* demuxer)
 {
     if (demuxer == nullptr) return 0;
-    return demuxer->GetVideoTrack().sample_count;
+    return demuxer->GetFrameCount();
 }
 
 extern "C" double UNITY_INTERFACE_EXPORT KlakHap_GetDuration(Demuxer* demuxer)
 {
     if (demuxer == nullptr) return 0;
-    auto track = demuxer->GetVideoTrack();
-    auto dur = static_cast<double>(track.duration_hi);
-    dur = dur * 0x100000000L + track.duration_lo;
-    return dur / track.timescale;
+    return demuxer->GetDuration();
 }
 
 extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetVideoWidth(Demuxer* demuxer)
 {
     if (demuxer == nullptr) return 0;
-    return demuxer->GetVideoTrack().SampleDescription.video.width;
+    return demuxer->GetWidth();
 }
 
 extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetVideoHeight(Demuxer* demuxer)
 {
     if (demuxer == nullptr) return 0;
-    return demuxer->GetVideoTrack().SampleDescription.video.height;
+    return demuxer->GetHeight();
 }
 
 extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_AnalyzeVideoType(Demuxer* demuxer)
@@ -162,6 +218,39 @@ extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_AnalyzeVideoType(Demuxer* demu
     return demuxer->ReadVideoTypeField();
 }
 
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_EnableDemuxerPreload(Demuxer* demuxer, int64_t window)
+{
+    if (demuxer == nullptr) return;
+    if (window < 0)
+        demuxer->DisablePreload();
+    else
+        demuxer->EnablePreload(static_cast<uint64_t>(window));
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_SetDemuxerPriority(Demuxer* demuxer, int32_t priority)
+{
+    if (demuxer == nullptr) return;
+    demuxer->SetPriority(priority);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_SetDemuxerTrusted(Demuxer* demuxer, int32_t trusted)
+{
+    if (demuxer == nullptr) return;
+    demuxer->SetTrusted(trusted != 0);
+}
+
+extern "C" int64_t UNITY_INTERFACE_EXPORT KlakHap_GetDemuxerPreloadSize(Demuxer* demuxer)
+{
+    if (demuxer == nullptr) return 0;
+    return static_cast<int64_t>(demuxer->GetPreloadSize());
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_IsDemuxerPreloadEvicted(Demuxer* demuxer)
+{
+    if (demuxer == nullptr) return 0;
+    return demuxer->IsPreloadEvicted() ? 1 : 0;
+}
+
 extern "C" void UNITY_INTERFACE_EXPORT KlakHap_ReadFrame(Demuxer* demuxer, int frameNumber, ReadBuffer* buffer)
 {
     if (demuxer == nullptr || buffer == nullptr) return;
@@ -170,6 +259,135 @@ extern "C" void UNITY_INTERFACE_EXPORT KlakHap_ReadFrame(Demuxer* demuxer, int f
 
 #pragma endregion
 
+#pragma region Stream reader functions
+
+extern "C" StreamReader UNITY_INTERFACE_EXPORT * KlakHap_CreateStreamReader(Demuxer* demuxer, float time, float delta)
+{
+    if (demuxer == nullptr || !demuxer->IsValid()) return nullptr;
+    return new StreamReader(*demuxer, time, delta);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_DestroyStreamReader(StreamReader* reader)
+{
+    if (reader != nullptr) delete reader;
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_RestartStreamReader(StreamReader* reader, float time, float delta)
+{
+    if (reader == nullptr) return;
+    reader->Restart(time, delta);
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_SeekStreamReader(StreamReader* reader, float time, float delta)
+{
+    if (reader == nullptr) return 0;
+    return reader->Seek(time, delta) ? 1 : 0;
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetStreamReaderDepth(StreamReader* reader)
+{
+    if (reader == nullptr) return 0;
+    return reader->GetDepth();
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_SetStreamReaderByteCap(StreamReader* reader, int64_t bytes)
+{
+    if (reader == nullptr) return;
+    reader->SetByteCap(static_cast<uint64_t>(std::max<int64_t>(bytes, 0)));
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_SetStreamReaderPriority(StreamReader* reader, int32_t priority)
+{
+    if (reader == nullptr) return;
+    reader->SetPriority(priority);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_SetStreamReaderCacheSize(StreamReader* reader, int32_t frames)
+{
+    if (reader == nullptr) return;
+    reader->SetCacheSize(frames);
+}
+
+extern "C" const ReadBuffer UNITY_INTERFACE_EXPORT * KlakHap_AdvanceStreamReader(StreamReader* reader, float time)
+{
+    if (reader == nullptr) return nullptr;
+    return reader->Advance(time);
+}
+
+#pragma endregion
+
+#pragma region Preload budget functions
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_SetPreloadBudget(int64_t bytes)
+{
+    Preloader::SetBudget(static_cast<uint64_t>(std::max<int64_t>(bytes, 0)));
+}
+
+extern "C" int64_t UNITY_INTERFACE_EXPORT KlakHap_GetPreloadBudget()
+{
+    return static_cast<int64_t>(Preloader::GetBudget());
+}
+
+extern "C" int64_t UNITY_INTERFACE_EXPORT KlakHap_GetPreloadUsage()
+{
+    return static_cast<int64_t>(Preloader::GetTotalUsage());
+}
+
+#pragma endregion
+
+#pragma region Memory governor functions
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_SetMemoryCap(int64_t bytes)
+{
+    MemoryGovernor::Get().SetCap(static_cast<uint64_t>(std::max<int64_t>(bytes, 0)));
+}
+
+extern "C" int64_t UNITY_INTERFACE_EXPORT KlakHap_GetMemoryCap()
+{
+    return static_cast<int64_t>(MemoryGovernor::Get().GetCap());
+}
+
+// Category: 0 = read-ahead, 1 = preload, 2 = frame cache, 3 = decoder,
+// 4 = frame pool, others = total
+extern "C" int64_t UNITY_INTERFACE_EXPORT KlakHap_GetMemoryUsage(int32_t category)
+{
+    auto& governor = MemoryGovernor::Get();
+    if (category < 0 || category >= MemoryGovernor::CategoryCount)
+        return static_cast<int64_t>(governor.GetTotalUsage());
+    return static_cast<int64_t>(governor.GetUsage(static_cast<MemoryGovernor::Category>(category)));
+}
+
+#pragma endregion
+
+#pragma region Frame cache functions
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_SetFrameCacheBudget(int64_t bytes)
+{
+    FrameCache::Get().SetBudget(static_cast<uint64_t>(std::max<int64_t>(bytes, 0)));
+}
+
+extern "C" int64_t UNITY_INTERFACE_EXPORT KlakHap_GetFrameCacheBudget()
+{
+    return static_cast<int64_t>(FrameCache::Get().GetBudget());
+}
+
+extern "C" int64_t UNITY_INTERFACE_EXPORT KlakHap_GetFrameCacheUsage()
+{
+    return static_cast<int64_t>(FrameCache::Get().GetUsage());
+}
+
+extern "C" int64_t UNITY_INTERFACE_EXPORT KlakHap_GetFrameCacheHits()
+{
+    return static_cast<int64_t>(FrameCache::Get().GetHitCount());
+}
+
+extern "C" int64_t UNITY_INTERFACE_EXPORT KlakHap_GetFrameCacheMisses()
+{
+    return static_cast<int64_t>(FrameCache::Get().GetMissCount());
+}
+
+#pragma endregion
+
 #pragma region Decoder functions
 
 extern "C" Decoder UNITY_INTERFACE_EXPORT *KlakHap_CreateDecoder(int width, int height, int typeID)
@@ -177,8 +395,16 @@ extern "C" Decoder UNITY_INTERFACE_EXPORT *KlakHap_CreateDecoder(int width, int
     return new Decoder(width, height, typeID);
 }
 
+// Proxy level 1 = 1/2 resolution, 2 = 1/4 resolution. With mipmaps, the
+// buffer holds the full mip chain.
+extern "C" Decoder UNITY_INTERFACE_EXPORT *KlakHap_CreateDecoderWithOptions(int width, int height, int typeID, int proxyLevel, int32_t mipmaps)
+{
+    return new Decoder(width, height, typeID, proxyLevel, mipmaps != 0);
+}
+
 extern "C" void UNITY_INTERFACE_EXPORT KlakHap_DestroyDecoder(Decoder* decoder)
 {
+    if (decoder != nullptr) Scheduler::Get().Remove(decoder);
     delete decoder;
 }
 
@@ -192,10 +418,24 @@ extern "C" void UNITY_INTERFACE_EXPORT KlakHap_AssignDecoder(uint32_t id, Decode
 
 extern "C" void UNITY_INTERFACE_EXPORT KlakHap_DecodeFrame(Decoder* decoder, const ReadBuffer* input)
 {
-    if (decoder == nullptr) return;
+    if (decoder == nullptr || input == nullptr) return;
     decoder->DecodeFrame(*input);
 }
 
+// Decode a frame straight into strided memory (pitch = bytes between rows of
+// blocks) without changing the current frame
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_DecodeFrameInto(Decoder* decoder, const ReadBuffer* input, void* dest, int64_t size, int32_t pitch)
+{
+    if (decoder == nullptr || input == nullptr || dest == nullptr || size <= 0 || pitch <= 0) return 0;
+    return decoder->DecodeInto(*input, static_cast<uint8_t*>(dest), static_cast<size_t>(size), static_cast<size_t>(pitch)) ? 1 : 0;
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetDecoderRowBytes(Decoder* decoder)
+{
+    if (decoder == nullptr) return 0;
+    return static_cast<int32_t>(decoder->GetRowBytes());
+}
+
 extern "C" const void UNITY_INTERFACE_EXPORT *KlakHap_LockDecoderBuffer(Decoder* decoder)
 {
     if (decoder == nullptr) return nullptr;
@@ -214,4 +454,238 @@ extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetDecoderBufferSize(Decoder*
     return static_cast<int32_t>(decoder->GetBufferSize());
 }
 
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetDecoderWidth(Decoder* decoder)
+{
+    if (decoder == nullptr) return 0;
+    return decoder->GetWidth();
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetDecoderHeight(Decoder* decoder)
+{
+    if (decoder == nullptr) return 0;
+    return decoder->GetHeight();
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetDecoderMipCount(Decoder* decoder)
+{
+    if (decoder == nullptr) return 0;
+    return decoder->GetMipCount();
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_IsDecoderBufferUpdated(Decoder* decoder)
+{
+    if (decoder == nullptr) return 0;
+    return decoder->IsBufferUpdated() ? 1 : 0;
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_ShowDecoderStandby(Decoder* decoder)
+{
+    if (decoder == nullptr) return 0;
+    return decoder->ShowStandby() ? 1 : 0;
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_SetDecoderRGBAOutput(Decoder* decoder, int32_t enable)
+{
+    if (decoder == nullptr) return 0;
+    return decoder->SetRGBAOutput(enable != 0) ? 1 : 0;
+}
+
+extern "C" const void UNITY_INTERFACE_EXPORT *KlakHap_LockDecoderRGBABuffer(Decoder* decoder)
+{
+    if (decoder == nullptr) return nullptr;
+    return decoder->LockRGBABuffer();
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_UnlockDecoderRGBABuffer(Decoder* decoder)
+{
+    if (decoder == nullptr) return;
+    decoder->UnlockRGBABuffer();
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetDecoderRGBABufferSize(Decoder* decoder)
+{
+    if (decoder == nullptr) return 0;
+    return static_cast<int32_t>(decoder->GetRGBABufferSize());
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_CopyDecoderPixels(Decoder* decoder, void* dest, int32_t pitch)
+{
+    if (decoder == nullptr || dest == nullptr) return 0;
+    return decoder->CopyPixels(static_cast<uint8_t*>(dest), pitch) ? 1 : 0;
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_CopyDecoderPlanes(Decoder* decoder, void* r, void* g, void* b, void* a, int32_t pitch)
+{
+    if (decoder == nullptr) return 0;
+    uint8_t* planes[] = {
+        static_cast<uint8_t*>(r), static_cast<uint8_t*>(g),
+        static_cast<uint8_t*>(b), static_cast<uint8_t*>(a)
+    };
+    return decoder->CopyPlanes(planes, pitch) ? 1 : 0;
+}
+
+#pragma endregion
+
+#pragma region Atlas functions
+
+extern "C" Atlas UNITY_INTERFACE_EXPORT *KlakHap_CreateAtlas(int tileWidth, int tileHeight, int columns, int rows, int typeID)
+{
+    return new Atlas(tileWidth, tileHeight, columns, rows, typeID);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_DestroyAtlas(Atlas* atlas)
+{
+    delete atlas;
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_AssignAtlas(uint32_t id, Atlas* atlas)
+{
+    if (atlas != nullptr)
+        atlasMap_[id] = atlas;
+    else
+        atlasMap_.erase(id);
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetAtlasWidth(Atlas* atlas)
+{
+    if (atlas == nullptr) return 0;
+    return atlas->GetWidth();
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetAtlasHeight(Atlas* atlas)
+{
+    if (atlas == nullptr) return 0;
+    return atlas->GetHeight();
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_AddAtlasClip(Atlas* atlas, const char* path)
+{
+    if (atlas == nullptr || path == nullptr) return -1;
+    return atlas->AddClip(path);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_RemoveAtlasClip(Atlas* atlas, int32_t slot)
+{
+    if (atlas != nullptr) atlas->RemoveClip(slot);
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetAtlasClipWidth(Atlas* atlas, int32_t slot)
+{
+    if (atlas == nullptr) return 0;
+    return atlas->GetClipWidth(slot);
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetAtlasClipHeight(Atlas* atlas, int32_t slot)
+{
+    if (atlas == nullptr) return 0;
+    return atlas->GetClipHeight(slot);
+}
+
+extern "C" double UNITY_INTERFACE_EXPORT KlakHap_GetAtlasClipDuration(Atlas* atlas, int32_t slot)
+{
+    if (atlas == nullptr) return 0;
+    return atlas->GetClipDuration(slot);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_SetAtlasClipTime(Atlas* atlas, int32_t slot, float time)
+{
+    if (atlas != nullptr) atlas->SetTime(slot, time);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_UpdateAtlas(Atlas* atlas)
+{
+    if (atlas != nullptr) atlas->Update();
+}
+
+extern "C" const void UNITY_INTERFACE_EXPORT *KlakHap_LockAtlasBuffer(Atlas* atlas)
+{
+    if (atlas == nullptr) return nullptr;
+    return atlas->LockBuffer();
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_UnlockAtlasBuffer(Atlas* atlas)
+{
+    if (atlas != nullptr) atlas->UnlockBuffer();
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_GetAtlasBufferSize(Atlas* atlas)
+{
+    if (atlas == nullptr) return 0;
+    return static_cast<int32_t>(atlas->GetBufferSize());
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_IsAtlasBufferUpdated(Atlas* atlas)
+{
+    if (atlas == nullptr) return 0;
+    return atlas->IsBufferUpdated() ? 1 : 0;
+}
+
+#pragma endregion
+
+#pragma region Clip loader functions
+
+extern "C" ClipLoader UNITY_INTERFACE_EXPORT *KlakHap_CreateClipLoader(const char* filepath, float time, float delta, Decoder* decoder, int64_t preload)
+{
+    if (filepath == nullptr) return nullptr;
+    return new ClipLoader(filepath, time, delta, decoder, preload);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_DestroyClipLoader(ClipLoader* loader)
+{
+    if (loader != nullptr) delete loader;
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_IsClipLoaderDone(ClipLoader* loader)
+{
+    if (loader == nullptr) return 1;
+    return loader->IsDone() ? 1 : 0;
+}
+
+extern "C" int32_t UNITY_INTERFACE_EXPORT KlakHap_IsClipPredecoded(ClipLoader* loader)
+{
+    if (loader == nullptr || !loader->IsDone()) return 0;
+    return loader->IsPredecoded() ? 1 : 0;
+}
+
+extern "C" Demuxer UNITY_INTERFACE_EXPORT *KlakHap_DetachClipDemuxer(ClipLoader* loader)
+{
+    if (loader == nullptr || !loader->IsDone()) return nullptr;
+    return loader->DetachDemuxer();
+}
+
+extern "C" StreamReader UNITY_INTERFACE_EXPORT *KlakHap_DetachClipStreamReader(ClipLoader* loader)
+{
+    if (loader == nullptr || !loader->IsDone()) return nullptr;
+    return loader->DetachStreamReader();
+}
+
+#pragma endregion
+
+#pragma region Decode scheduler functions
+
+// Deadline: Seconds from now until the frame is presented
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_ScheduleDecode(Decoder* decoder, StreamReader* reader, float time, float deadline)
+{
+    if (decoder == nullptr || reader == nullptr) return;
+    Scheduler::Get().Submit(decoder, reader, time, deadline);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT KlakHap_FlushDecoder(Decoder* decoder)
+{
+    if (decoder == nullptr) return;
+    Scheduler::Get().Flush(decoder);
+}
+
+extern "C" int64_t UNITY_INTERFACE_EXPORT KlakHap_GetDroppedFrameCount(Decoder* decoder)
+{
+    if (decoder == nullptr) return 0;
+    return static_cast<int64_t>(Scheduler::Get().GetDroppedCount(decoder));
+}
+
+extern "C" int64_t UNITY_INTERFACE_EXPORT KlakHap_GetLateFrameCount(Decoder* decoder)
+{
+    if (decoder == nullptr) return 0;
+    return static_cast<int64_t>(Scheduler::Get().GetLateCount(decoder));
+}
+
 #pragma endregion
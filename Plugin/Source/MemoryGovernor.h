@@ -0,0 +1,172 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+namespace KlakHap
+{
+    //
+    // Plugin-wide memory governor
+    //
+    // Keeps track of the memory used by the buffers in each category and
+    // enforces a global cap (unlimited by default). Components that own
+    // reclaimable memory register a reclaimer with a priority. When the total
+    // usage exceeds the cap, the governor asks them to release memory in this
+    // order: pooled free buffers, decoded frame cache, preload arenas,
+    // read-ahead buffers. Within a category, lower priority clients are asked
+    // first.
+    //
+    // Enforce() must not be called while holding a component lock, as the
+    // reclaimers take their own locks.
+    //
+    class MemoryGovernor
+    {
+    public:
+
+        enum Category { ReadAhead, Preload, FrameCache, Decoder, FramePool, CategoryCount };
+
+        // Asked to release the given number of bytes. Returns the number of
+        // bytes that will be released (possibly asynchronously).
+        using Reclaimer = std::function<uint64_t(uint64_t)>;
+
+        static MemoryGovernor& Get()
+        {
+            static MemoryGovernor instance;
+            return instance;
+        }
+
+        #pragma region Client registration
+
+        int Register(Category category, int priority, Reclaimer reclaimer)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            clients_.push_back(Client{ ++lastID_, category, priority, std::move(reclaimer) });
+            return lastID_;
+        }
+
+        // No reclaimer is running for the client after this returns.
+        void Unregister(int id)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            clients_.erase(std::remove_if(clients_.begin(), clients_.end(),
+                [=](const Client& c) { return c.id == id; }), clients_.end());
+        }
+
+        void SetPriority(int id, int priority)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& c : clients_) if (c.id == id) c.priority = priority;
+        }
+
+        #pragma endregion
+
+        #pragma region Accounting
+
+        void Add(Category category, int64_t bytes)
+        {
+            usage_[category].fetch_add(bytes, std::memory_order_relaxed);
+        }
+
+        uint64_t GetUsage(Category category) const
+        {
+            auto bytes = usage_[category].load(std::memory_order_relaxed);
+            return bytes > 0 ? static_cast<uint64_t>(bytes) : 0;
+        }
+
+        uint64_t GetTotalUsage() const
+        {
+            uint64_t total = 0;
+            for (auto i = 0; i < CategoryCount; i++)
+                total += GetUsage(static_cast<Category>(i));
+            return total;
+        }
+
+        // Bytes that can be allocated without exceeding the cap
+        uint64_t GetHeadroom() const
+        {
+            auto cap = GetCap();
+            if (cap == 0) return std::numeric_limits<uint64_t>::max();
+            auto total = GetTotalUsage();
+            return total < cap ? cap - total : 0;
+        }
+
+        #pragma endregion
+
+        #pragma region Cap control
+
+        // Zero means unlimited.
+        void SetCap(uint64_t bytes)
+        {
+            cap_.store(bytes, std::memory_order_relaxed);
+            Enforce();
+        }
+
+        uint64_t GetCap() const
+        {
+            return cap_.load(std::memory_order_relaxed);
+        }
+
+        // Reclaim memory from the clients while the usage exceeds the cap.
+        void Enforce()
+        {
+            auto cap = GetCap();
+            if (cap == 0 || GetTotalUsage() <= cap) return;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            auto total = GetTotalUsage();
+            if (total <= cap) return;
+            auto excess = total - cap;
+
+            // Reclaim order: cheapest to rebuild first
+            static const Category order[] = { FramePool, FrameCache, Preload, ReadAhead };
+
+            for (auto category : order)
+            {
+                std::vector<Client*> targets;
+                for (auto& c : clients_) if (c.category == category) targets.push_back(&c);
+                std::stable_sort(targets.begin(), targets.end(),
+                    [](const Client* a, const Client* b) { return a->priority < b->priority; });
+
+                for (auto client : targets)
+                {
+                    auto freed = client->reclaim(excess);
+                    if (freed >= excess) return;
+                    excess -= freed;
+                }
+            }
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        MemoryGovernor()
+        {
+            for (auto& usage : usage_) usage.store(0);
+        }
+
+        struct Client
+        {
+            int id;
+            Category category;
+            int priority;
+            Reclaimer reclaim;
+        };
+
+        std::mutex mutex_;
+        std::vector<Client> clients_;
+        int lastID_ = 0;
+        std::atomic<int64_t> usage_[CategoryCount];
+        std::atomic<uint64_t> cap_{0};
+
+        #pragma endregion
+    };
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include "ProxyEncoder.h"
+
+namespace KlakHap
+{
+    //
+    // BC mip chain
+    //
+    // Builds the lower mip levels of a decoded frame in the block domain
+    // (see ProxyEncoder). The levels are stored one after another from the
+    // largest, each tightly packed, in the same layout as a mipmapped
+    // texture's raw data, so that the whole chain can be uploaded at once.
+    // Each level is made from the previous one and split into row bands
+    // that are encoded in parallel.
+    //
+    class MipChain
+    {
+    public:
+
+        #pragma region Layout
+
+        static bool IsSupported(int typeID)
+        {
+            return ProxyEncoder::IsSupported(typeID);
+        }
+
+        // Full chain down to 1x1
+        static int GetLevelCount(int width, int height)
+        {
+            auto count = 1;
+            for (auto size = std::max(width, height); size > 1; size >>= 1) count++;
+            return count;
+        }
+
+        static int GetLevelExtent(int width, int level)
+        {
+            return std::max(width >> level, 1);
+        }
+
+        static size_t GetLevelSize(int typeID, int width, int height, int level)
+        {
+            auto w = GetLevelExtent(width, level), h = GetLevelExtent(height, level);
+            return static_cast<size_t>((w + 3) / 4) * ((h + 3) / 4) *
+                   BlockDecoder::GetBlockSize(typeID);
+        }
+
+        static size_t GetChainSize(int typeID, int width, int height)
+        {
+            size_t total = 0;
+            auto count = GetLevelCount(width, height);
+            for (auto level = 0; level < count; level++)
+                total += GetLevelSize(typeID, width, height, level);
+            return total;
+        }
+
+        #pragma endregion
+
+        #pragma region Generation
+
+        // Fill the lower levels of the chain. Level 0 must be at the head of
+        // the buffer.
+        static bool Build(int typeID, uint8_t* chain, size_t chainSize, int width, int height)
+        {
+            if (!IsSupported(typeID) || chainSize < GetChainSize(typeID, width, height)) return false;
+
+            auto count = GetLevelCount(width, height);
+            auto source = chain;
+
+            for (auto level = 1; level < count; level++)
+            {
+                auto sourceSize = GetLevelSize(typeID, width, height, level - 1);
+                auto dest = source + sourceSize;
+                if (!ProxyEncoder::EncodeMip(
+                    typeID, source, sourceSize,
+                    GetLevelExtent(width, level - 1), GetLevelExtent(height, level - 1),
+                    dest, GetLevelSize(typeID, width, height, level))) return false;
+                source = dest;
+            }
+
+            return true;
+        }
+
+        #pragma endregion
+    };
+}
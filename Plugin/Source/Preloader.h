@@ -0,0 +1,566 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "File.h"
+#include "FrameIndex.h"
+#include "MemoryGovernor.h"
+#include "ReadBuffer.h"
+#include "TaskPool.h"
+
+namespace KlakHap
+{
+    //
+    // Compressed frame preloader
+    //
+    // Keeps the frames of a clip in a contiguous memory arena, so that a frame
+    // read turns into a pointer lookup. It holds either the whole clip or a
+    // window around the playhead that fits in a given byte budget. The window
+    // is re-centered on a background thread when the playhead moves away from
+    // its center.
+    //
+    // All the preloaders share a global budget. When the total size exceeds
+    // the budget, the least recently used arenas are evicted, and their owners
+    // fall back to reading from the file. An arena stays accounted until its
+    // last reference is dropped, as the read buffers that point into it (e.g.
+    // the stream reader's scrub cache) keep it alive. The memory governor may also evict
+    // arenas under pressure, starting from the lowest priority. An evicted
+    // preloader loads its arena again on a later lookup, once the budget has
+    // room for it without evicting the others.
+    //
+    class Preloader
+    {
+    public:
+
+        #pragma region Constructor/destructor
+
+        // window: Byte budget of the window around the playhead
+        //         (zero to load the whole clip)
+        Preloader(const std::string& path, const FrameIndex& index, uint64_t window, int priority)
+          : path_(path), index_(index), window_(window)
+        {
+            Registry::Get().Add(this);
+            clientID_ = MemoryGovernor::Get().Register(MemoryGovernor::Preload, priority,
+                [this](uint64_t) { return Registry::Get().Drop(this); });
+
+            // Initial load around the head of the clip
+            auto arena = Load(0, nullptr);
+            if (arena) Commit(arena);
+
+            // The window has to follow the playhead unless it covers the
+            // whole clip (it may not when the clip exceeds the global budget).
+            windowed_ = !arena || arena->count < static_cast<int>(index_.frames.size());
+            if (windowed_) StartWorker();
+        }
+
+        ~Preloader()
+        {
+            MemoryGovernor::Get().Unregister(clientID_);
+
+            if (worker_.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    stop_ = true;
+                }
+                cond_.notify_one();
+                worker_.join();
+            }
+
+            Registry::Get().Remove(this);
+        }
+
+        #pragma endregion
+
+        #pragma region Public methods
+
+        // Point the buffer to a preloaded frame. Returns false when the frame
+        // isn't in the arena.
+        bool Lookup(int index, ReadBuffer& buffer)
+        {
+            std::shared_ptr<const Arena> arena;
+            auto evicted = false;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                arena = arena_;
+                evicted = evicted_;
+
+                if (windowed_ && !evicted_ && !loading_ && NeedsRecenter(arena.get(), index))
+                {
+                    request_ = index;
+                    cond_.notify_one();
+                }
+            }
+
+            if (evicted) RequestReload(index);
+
+            if (!arena || !arena->Contains(index)) return false;
+
+            lastUse_ = ++Registry::Get().clock;
+
+            auto i = index - arena->first;
+            buffer.SetView(arena->data.get() + arena->offsets[i],
+                           static_cast<size_t>(arena->offsets[i + 1] - arena->offsets[i]),
+                           arena);
+            return true;
+        }
+
+        uint64_t GetResidentSize() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return arena_ ? arena_->size : 0;
+        }
+
+        // True while the arena is evicted and waiting for a reload
+        bool IsEvicted() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return evicted_;
+        }
+
+        void SetPriority(int priority)
+        {
+            MemoryGovernor::Get().SetPriority(clientID_, priority);
+        }
+
+        #pragma endregion
+
+        #pragma region Global budget
+
+        static void SetBudget(uint64_t bytes)
+        {
+            Registry::Get().SetBudget(bytes);
+        }
+
+        static uint64_t GetBudget()
+        {
+            return Registry::Get().GetBudget();
+        }
+
+        static uint64_t GetTotalUsage()
+        {
+            return Registry::Get().GetTotal();
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Arena
+
+        struct Arena
+        {
+            std::unique_ptr<uint8_t[]> data;
+            std::vector<uint64_t> offsets; // [count + 1]
+            int first = 0;
+            int count = 0;
+            uint64_t size = 0;
+
+            bool Contains(int index) const
+            {
+                return index >= first && index < first + count;
+            }
+        };
+
+        static const int kMinFramesPerThread = 16;
+
+        // Load the frames around the given center frame into a new arena.
+        // The frames already in the old arena are copied from it.
+        std::shared_ptr<Arena> Load(int center, std::shared_ptr<const Arena> old, bool reload = false) const
+        {
+            const auto& frames = index_.frames;
+            auto total = static_cast<int>(frames.size());
+            if (center < 0 || center >= total) return nullptr;
+
+            // The window can't be larger than the global budget, nor the
+            // memory governor's headroom (the old arena will be released).
+            // A re-centered or reloaded window only takes the unused part of
+            // the budget, plus the old window.
+            auto limit = Registry::Get().GetBudget();
+            auto reusable = old ? old->size : 0;
+            if (old || reload) limit = std::min(limit, Registry::Get().GetRoom() + reusable);
+            if (window_ > 0) limit = std::min(limit, window_);
+            auto available = MemoryGovernor::Get().GetHeadroom();
+            if (available < limit && available + reusable < limit) limit = available + reusable;
+
+            // Grow the window in both directions until it reaches the limit.
+            auto first = center, last = center;
+            uint64_t size = 0;
+            for (auto grow = true; grow;)
+            {
+                grow = false;
+                if (last < total && size + frames[last].size <= limit)
+                {
+                    size += frames[last++].size;
+                    grow = true;
+                }
+                if (first > 0 && size + frames[first - 1].size <= limit)
+                {
+                    size += frames[--first].size;
+                    grow = true;
+                }
+            }
+            if (first == last) return nullptr;
+
+            // Arena allocation (not zero-filled)
+            std::unique_ptr<uint8_t[]> data(new (std::nothrow) uint8_t[static_cast<size_t>(size)]);
+            if (!data) return nullptr;
+            auto arena = Registry::Get().Allocate(std::move(data), size);
+
+            arena->first = first;
+            arena->count = last - first;
+            arena->offsets.resize(arena->count + 1, 0);
+            for (auto i = 0; i < arena->count; i++)
+                arena->offsets[i + 1] = arena->offsets[i] + frames[first + i].size;
+
+            // Parallel read: Split the window into contiguous parts.
+            auto threads = TaskPool::GetConcurrency();
+            auto parts = std::max(1, std::min(threads, arena->count / kMinFramesPerThread));
+            std::vector<char> results(parts, 0);
+
+            TaskPool::Get().Run(parts, [&](int p) {
+                results[p] = ReadPart(*arena, old.get(), p, parts);
+            });
+
+            for (auto ok : results) if (!ok) return nullptr;
+            return arena;
+        }
+
+        // Read the p-th part of the arena. Runs of frames that are contiguous
+        // in the file are read with a single call.
+        char ReadPart(Arena& arena, const Arena* old, int p, int parts) const
+        {
+            const auto& frames = index_.frames;
+            auto begin = arena.count * p / parts;
+            auto end = arena.count * (p + 1) / parts;
+
+            auto file = OpenFile(path_.c_str(), "rb");
+            if (file == nullptr) return 0;
+
+            auto ok = true;
+            for (auto i = begin; ok && i < end;)
+            {
+                auto frame = arena.first + i;
+                auto dest = arena.data.get() + arena.offsets[i];
+
+                if (old != nullptr && old->Contains(frame))
+                {
+                    auto j = frame - old->first;
+                    std::copy(old->data.get() + old->offsets[j],
+                              old->data.get() + old->offsets[j + 1], dest);
+                    i++;
+                    continue;
+                }
+
+                auto run = i + 1;
+                while (run < end && !(old != nullptr && old->Contains(arena.first + run)) &&
+                       frames[arena.first + run].offset ==
+                       frames[arena.first + run - 1].offset + frames[arena.first + run - 1].size) run++;
+
+                auto size = static_cast<size_t>(arena.offsets[run] - arena.offsets[i]);
+                ok = SeekFile(file, frames[frame].offset) && fread(dest, 1, size, file) == size;
+                i = run;
+            }
+
+            fclose(file);
+            return ok ? 1 : 0;
+        }
+
+        // Check if the window should be moved to keep the playhead in the
+        // middle half of it.
+        bool NeedsRecenter(const Arena* arena, int index) const
+        {
+            auto total = static_cast<int>(index_.frames.size());
+            if (index < 0 || index >= total) return false;
+            if (arena == nullptr || !arena->Contains(index)) return true;
+            auto margin = arena->count / 4;
+            return (index < arena->first + margin && arena->first > 0) ||
+                   (index >= arena->first + arena->count - margin && arena->first + arena->count < total);
+        }
+
+        #pragma endregion
+
+        #pragma region Arena management
+
+        std::string path_;
+        const FrameIndex& index_;
+        uint64_t window_;
+        bool windowed_ = false;
+
+        mutable std::mutex mutex_;
+        std::shared_ptr<const Arena> arena_;
+        bool evicted_ = false;
+        uint64_t evictedSize_ = 0;
+
+        // Reload attempts are throttled, as each one scans the registry.
+        using Clock = std::chrono::steady_clock;
+        static const int kReloadIntervalMS = 500;
+        std::atomic<int64_t> nextReload_{0};
+
+        std::thread worker_;
+        std::condition_variable cond_;
+        int request_ = -1;
+        bool loading_ = false;
+        bool stop_ = false;
+
+        // Registry bookkeeping (guarded by the registry lock)
+        uint64_t charged_ = 0;
+        std::atomic<uint64_t> lastUse_{0};
+
+        int clientID_;
+
+        void Commit(std::shared_ptr<const Arena> arena)
+        {
+            auto size = arena->size;
+            std::shared_ptr<const Arena> old; // Released without the lock
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (evicted_) return;
+                old = std::move(arena_);
+                arena_ = std::move(arena);
+            }
+            lastUse_ = ++Registry::Get().clock;
+            Registry::Get().Charge(this, size);
+            MemoryGovernor::Get().Enforce();
+        }
+
+        // Called by the registry with its lock held. The arena is returned
+        // to be released after unlocking. In-flight buffers keep it alive
+        // until they are released.
+        std::shared_ptr<const Arena> Evict()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (arena_) evictedSize_ = arena_->size;
+            evicted_ = true;
+            return std::move(arena_);
+        }
+
+        // Ask the worker to load the evicted arena again when the registry
+        // and the memory governor have room for it. The registry lock is
+        // taken without holding our lock, as the registry calls Evict() with
+        // its lock held.
+        void RequestReload(int index)
+        {
+            auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                Clock::now().time_since_epoch()).count();
+            auto next = nextReload_.load();
+            if (now < next || !nextReload_.compare_exchange_strong(next, now + kReloadIntervalMS)) return;
+
+            uint64_t size;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!evicted_ || loading_) return;
+                size = evictedSize_;
+            }
+
+            if (Registry::Get().GetRoom() < size) return;
+            if (MemoryGovernor::Get().GetHeadroom() < size) return;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!evicted_ || loading_) return;
+            if (!worker_.joinable()) StartWorker();
+            request_ = index;
+            cond_.notify_one();
+        }
+
+        void StartWorker()
+        {
+            worker_ = std::thread(&Preloader::WorkerThread, this);
+        }
+
+        void WorkerThread()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true)
+            {
+                cond_.wait(lock, [this]() { return stop_ || request_ >= 0; });
+                if (stop_) break;
+
+                // A request on an evicted arena is a reload. Commit() drops
+                // the result when it's evicted again in the meantime.
+                auto reload = evicted_;
+                evicted_ = false;
+
+                auto center = request_;
+                auto old = arena_;
+                request_ = -1;
+                loading_ = true;
+                lock.unlock();
+
+                // The arenas are released before locking, as their deleters
+                // take the registry lock.
+                auto count = 0;
+                {
+                    auto arena = Load(center, std::move(old), reload);
+                    if (arena) count = arena->count;
+                    if (arena) Commit(std::move(arena));
+                }
+
+                lock.lock();
+                if (reload && count == 0) evicted_ = true;
+                if (reload && count > 0) windowed_ = count < static_cast<int>(index_.frames.size());
+                loading_ = false;
+            }
+        }
+
+        #pragma endregion
+
+        #pragma region Global registry
+
+        class Registry
+        {
+        public:
+
+            static Registry& Get()
+            {
+                static Registry instance;
+                return instance;
+            }
+
+            std::atomic<uint64_t> clock{0};
+
+            void Add(Preloader* preloader)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                members_.push_back(preloader);
+            }
+
+            // The arena's own memory remains accounted until it's released.
+            void Remove(Preloader* preloader)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                members_.erase(std::remove(members_.begin(), members_.end(), preloader), members_.end());
+            }
+
+            // Create an arena that is accounted until its last reference is
+            // dropped.
+            std::shared_ptr<Arena> Allocate(std::unique_ptr<uint8_t[]> data, uint64_t size)
+            {
+                std::shared_ptr<Arena> arena(new Arena, [](Arena* a) {
+                    Get().Release(a->size);
+                    delete a;
+                });
+                arena->data = std::move(data);
+                arena->size = size;
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    total_ += size;
+                }
+                Account(static_cast<int64_t>(size));
+                return arena;
+            }
+
+            // Make the arena of a preloader evictable, then evict the least
+            // recently used arenas while the total exceeds the budget.
+            void Charge(Preloader* preloader, uint64_t bytes)
+            {
+                ArenaList released; // Released after unlocking
+                std::lock_guard<std::mutex> lock(mutex_);
+                preloader->charged_ = bytes;
+                EvictOverBudget(released);
+            }
+
+            // Evict the arena of a preloader (called by the memory governor).
+            // Returns the number of bytes released, which is zero while the
+            // arena is pinned by in-flight buffers.
+            uint64_t Drop(Preloader* preloader)
+            {
+                std::shared_ptr<const Arena> arena;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    if (preloader->charged_ == 0) return 0;
+                    arena = preloader->Evict();
+                    preloader->charged_ = 0;
+                }
+                auto bytes = arena && arena.use_count() == 1 ? arena->size : 0;
+                arena.reset();
+                return bytes;
+            }
+
+            void SetBudget(uint64_t bytes)
+            {
+                ArenaList released; // Released after unlocking
+                std::lock_guard<std::mutex> lock(mutex_);
+                budget_ = bytes;
+                EvictOverBudget(released);
+            }
+
+            uint64_t GetBudget() const
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return budget_;
+            }
+
+            uint64_t GetTotal() const
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return total_;
+            }
+
+            // Unused part of the budget
+            uint64_t GetRoom() const
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                return budget_ > total_ ? budget_ - total_ : 0;
+            }
+
+        private:
+
+            using ArenaList = std::vector<std::shared_ptr<const Arena>>;
+
+            mutable std::mutex mutex_;
+            std::vector<Preloader*> members_;
+            uint64_t budget_ = 4ull << 30;
+            uint64_t total_ = 0;
+
+            static void Account(int64_t bytes)
+            {
+                MemoryGovernor::Get().Add(MemoryGovernor::Preload, bytes);
+            }
+
+            // Called by the arena deleter.
+            void Release(uint64_t bytes)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    total_ -= bytes;
+                }
+                Account(-static_cast<int64_t>(bytes));
+            }
+
+            // The evicted arenas are moved to the list, so that the caller
+            // releases them after unlocking. The total goes down when they
+            // are actually freed.
+            void EvictOverBudget(ArenaList& released)
+            {
+                uint64_t evicted = 0;
+                while (total_ > budget_ + evicted)
+                {
+                    Preloader* victim = nullptr;
+                    for (auto member : members_)
+                        if (member->charged_ > 0 &&
+                            (victim == nullptr || member->lastUse_ < victim->lastUse_))
+                            victim = member;
+                    if (victim == nullptr) break;
+
+                    released.push_back(victim->Evict());
+                    evicted += victim->charged_;
+                    victim->charged_ = 0;
+                }
+            }
+        };
+
+        #pragma endregion
+    };
+}
@@ -0,0 +1,357 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "BlockDecoder.h"
+#include "TaskPool.h"
+
+namespace KlakHap
+{
+    //
+    // Proxy encoder
+    //
+    // Generates a lower resolution (1/2 or 1/4) frame from a decoded one in
+    // the block domain, for preview monitors and distant screens: Each output
+    // block is made from a group of 2x2 or 4x4 input blocks by box-filtering
+    // their pixels and re-encoding them with bounding-box endpoints. The
+    // output stays in the input format, so the upload size and the GPU memory
+    // drop by 4x or 16x.
+    //
+    // Hap Q blocks are filtered in the scaled YCoCg space, so groups that mix
+    // blocks with different CoCg scales lose some chroma accuracy.
+    //
+    class ProxyEncoder
+    {
+    public:
+
+        #pragma region Public methods
+
+        // Frame size at the given level. Proxies are rounded up to the block
+        // size.
+        static int GetProxySize(int size, int level)
+        {
+            if (level <= 0) return size;
+            auto scaled = (size + (1 << level) - 1) >> level;
+            return (scaled + 3) / 4 * 4;
+        }
+
+        static bool IsSupported(int typeID)
+        {
+            return BlockDecoder::IsSupported(typeID);
+        }
+
+        // Returns false when the format or the level is unsupported or the
+        // buffers are too small.
+        static bool Encode(
+            int typeID, const uint8_t* source, size_t sourceSize,
+            int width, int height, int level, uint8_t* dest, size_t destSize
+        )
+        {
+            if (level < 1 || level > kMaxLevel) return false;
+            return Run(typeID, source, sourceSize, width, height, 1 << level,
+                       GetProxySize(width, level), GetProxySize(height, level),
+                       dest, destSize);
+        }
+
+        // Next level of a mip chain: max(1, size / 2) in both dimensions.
+        // With odd sizes, the last partial block of the source can be
+        // dropped, so the edges of non-power-of-two chains are approximate.
+        static bool EncodeMip(
+            int typeID, const uint8_t* source, size_t sourceSize,
+            int width, int height, uint8_t* dest, size_t destSize
+        )
+        {
+            return Run(typeID, source, sourceSize, width, height, 2,
+                       std::max(width / 2, 1), std::max(height / 2, 1),
+                       dest, destSize);
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Job description
+
+        static const int kMaxLevel = 2;
+        static const int kMinRowsPerBand = 16;
+        static const int kMaxBands = 8;
+
+        struct Job
+        {
+            int format;
+            const uint8_t* source;
+            int columns, rows, factor;
+            uint8_t* dest;
+            int outColumns;
+            size_t blockSize;
+        };
+
+        static bool Run(
+            int typeID, const uint8_t* source, size_t sourceSize,
+            int width, int height, int factor, int outWidth, int outHeight,
+            uint8_t* dest, size_t destSize
+        )
+        {
+            if (!IsSupported(typeID)) return false;
+            auto blockSize = BlockDecoder::GetBlockSize(typeID);
+
+            auto columns = (width + 3) / 4, rows = (height + 3) / 4;
+            auto outColumns = (outWidth + 3) / 4, outRows = (outHeight + 3) / 4;
+
+            if (static_cast<size_t>(columns) * rows * blockSize > sourceSize) return false;
+            if (static_cast<size_t>(outColumns) * outRows * blockSize > destSize) return false;
+
+            Job job = { typeID & 0xf, source, columns, rows, factor, dest, outColumns, blockSize };
+
+            // Split the output rows into bands, one per hardware thread.
+            auto threads = TaskPool::GetConcurrency();
+            auto bands = std::max(1, std::min(threads, outRows / kMinRowsPerBand));
+            bands = std::min(bands, kMaxBands);
+
+            TaskPool::Get().Run(bands, [&](int b) {
+                EncodeRows(job, outRows * b / bands, outRows * (b + 1) / bands);
+            });
+
+            return true;
+        }
+
+        #pragma endregion
+
+        #pragma region Row encoding
+
+        static void EncodeRows(const Job& job, int begin, int end)
+        {
+            const auto f = job.factor;
+            const size_t pitch = 16 * f;
+
+            // Expanded pixels of a block group (up to 16x16)
+            uint8_t pixels[16 * 16 * 4];
+            uint8_t filtered[16 * 4];
+
+            for (auto row = begin; row < end; row++)
+            {
+                auto out = job.dest + job.blockSize * job.outColumns * row;
+
+                for (auto col = 0; col < job.outColumns; col++, out += job.blockSize)
+                {
+                    // Groups on the right/bottom edges repeat the last blocks.
+                    for (auto by = 0; by < f; by++)
+                    {
+                        auto sr = std::min(row * f + by, job.rows - 1);
+                        for (auto bx = 0; bx < f; bx++)
+                        {
+                            auto sc = std::min(col * f + bx, job.columns - 1);
+                            auto block = job.source + job.blockSize * (static_cast<size_t>(sr) * job.columns + sc);
+                            BlockDecoder::DecodeBlock(job.format, block, pixels + pitch * 4 * by + 16 * bx, pitch);
+                        }
+                    }
+
+                    if (f == 2)
+                        BoxFilter<2>(pixels, filtered);
+                    else
+                        BoxFilter<4>(pixels, filtered);
+
+                    switch (job.format)
+                    {
+                    case 0xb: EncodeColor(filtered, out); break;
+                    case 0xe:
+                    case 0xf: EncodeAlpha(filtered, 3, out); EncodeColor(filtered, out + 8); break;
+                    case 0x1: EncodeAlpha(filtered, 0, out); break;
+                    }
+                }
+            }
+        }
+
+        // (4F x 4F) pixels -> 4x4 pixels
+        template <int F>
+        static void BoxFilter(const uint8_t* pixels, uint8_t* output)
+        {
+            const size_t pitch = 16 * F;
+            const int shift = F == 2 ? 2 : 4;
+
+            for (auto y = 0; y < 4; y++, pixels += pitch * F)
+            {
+            #if defined(KLAKHAP_BLOCK_SSE2)
+
+                // Vertical sums in 16-bit lanes (two pixels per vector)
+                auto zero = _mm_setzero_si128();
+                __m128i sum[2 * F];
+                for (auto k = 0; k < 2 * F; k++) sum[k] = zero;
+
+                for (auto j = 0; j < F; j++)
+                {
+                    auto src = reinterpret_cast<const __m128i*>(pixels + pitch * j);
+                    for (auto k = 0; k < F; k++)
+                    {
+                        auto v = _mm_loadu_si128(src + k);
+                        sum[k * 2 + 0] = _mm_add_epi16(sum[k * 2 + 0], _mm_unpacklo_epi8(v, zero));
+                        sum[k * 2 + 1] = _mm_add_epi16(sum[k * 2 + 1], _mm_unpackhi_epi8(v, zero));
+                    }
+                }
+
+                // Horizontal sums: F / 2 vectors per output pixel
+                __m128i h[4];
+                for (auto x = 0; x < 4; x++)
+                {
+                    auto v = sum[x * F / 2];
+                    for (auto k = 1; k < F / 2; k++) v = _mm_add_epi16(v, sum[x * F / 2 + k]);
+                    h[x] = _mm_add_epi16(v, _mm_srli_si128(v, 8));
+                }
+
+                auto round = _mm_set1_epi16(F * F / 2);
+                auto lo = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(h[0], h[1]), round), shift);
+                auto hi = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(h[2], h[3]), round), shift);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(output + y * 16), _mm_packus_epi16(lo, hi));
+
+            #else
+
+                uint16_t sum[16 * F] = {};
+                for (auto j = 0; j < F; j++)
+                    for (size_t k = 0; k < pitch; k++) sum[k] += pixels[pitch * j + k];
+
+                for (auto x = 0; x < 4; x++)
+                {
+                    for (auto c = 0; c < 4; c++)
+                    {
+                        auto total = F * F / 2;
+                        for (auto i = 0; i < F; i++) total += sum[(x * F + i) * 4 + c];
+                        output[y * 16 + x * 4 + c] = static_cast<uint8_t>(total >> shift);
+                    }
+                }
+
+            #endif
+            }
+        }
+
+        #pragma endregion
+
+        #pragma region Block encoders
+
+        static uint32_t To565(int r, int g, int b)
+        {
+            return ((r * 31 + 127) / 255 << 11) | ((g * 63 + 127) / 255 << 5) | ((b * 31 + 127) / 255);
+        }
+
+        static void From565(uint32_t c, int* rgb)
+        {
+            auto r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+            rgb[0] = static_cast<int>((r << 3) | (r >> 2));
+            rgb[1] = static_cast<int>((g << 2) | (g >> 4));
+            rgb[2] = static_cast<int>((b << 3) | (b >> 2));
+        }
+
+        // Color block (DXT1 or the color part of DXT5) in the four-color
+        // mode. The endpoints are the corners of the inset bounding box along
+        // the diagonal that follows the correlation of the channels.
+        static void EncodeColor(const uint8_t* pixels, uint8_t* block)
+        {
+            int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 }, mean[3] = { 0, 0, 0 };
+
+            for (auto i = 0; i < 16; i++)
+            {
+                for (auto c = 0; c < 3; c++)
+                {
+                    int v = pixels[i * 4 + c];
+                    lo[c] = std::min(lo[c], v);
+                    hi[c] = std::max(hi[c], v);
+                    mean[c] += v;
+                }
+            }
+
+            // Use the channel with the largest range as the reference and
+            // flip the other channels when they're inversely correlated.
+            auto ref = 0;
+            for (auto c = 1; c < 3; c++)
+                if (hi[c] - lo[c] > hi[ref] - lo[ref]) ref = c;
+
+            for (auto c = 0; c < 3; c++)
+            {
+                if (c == ref) continue;
+                auto cov = 0;
+                for (auto i = 0; i < 16; i++)
+                    cov += (pixels[i * 4 + ref] * 16 - mean[ref]) * (pixels[i * 4 + c] * 16 - mean[c]);
+                if (cov < 0) std::swap(lo[c], hi[c]);
+            }
+
+            // Inset by 1/16 of the range
+            for (auto c = 0; c < 3; c++)
+            {
+                auto inset = (hi[c] - lo[c]) / 16;
+                hi[c] -= inset;
+                lo[c] += inset;
+            }
+
+            // c0 > c1 selects the four-color mode in DXT1. When they're
+            // equal, all the indices are left 0.
+            auto c0 = To565(hi[0], hi[1], hi[2]);
+            auto c1 = To565(lo[0], lo[1], lo[2]);
+            if (c0 < c1) std::swap(c0, c1);
+
+            uint32_t indices = 0;
+
+            if (c0 != c1)
+            {
+                // Project the pixels onto the line between the quantized
+                // endpoints and pick the nearest of the four steps.
+                int p0[3], p1[3];
+                From565(c0, p0);
+                From565(c1, p1);
+
+                int dir[3] = { p0[0] - p1[0], p0[1] - p1[1], p0[2] - p1[2] };
+                auto length = dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2];
+
+                // Step (0 = c1, 3 = c0) -> index
+                static const uint32_t remap[4] = { 1, 3, 2, 0 };
+                auto scale = 3.0f / length;
+
+                for (auto i = 0; i < 16; i++)
+                {
+                    auto px = pixels + i * 4;
+                    auto dot = (px[0] - p1[0]) * dir[0] + (px[1] - p1[1]) * dir[1] + (px[2] - p1[2]) * dir[2];
+                    auto step = std::min(std::max(static_cast<int>(dot * scale + 0.5f), 0), 3);
+                    indices |= remap[step] << (2 * i);
+                }
+            }
+
+            block[0] = static_cast<uint8_t>(c0);
+            block[1] = static_cast<uint8_t>(c0 >> 8);
+            block[2] = static_cast<uint8_t>(c1);
+            block[3] = static_cast<uint8_t>(c1 >> 8);
+            for (auto i = 0; i < 4; i++) block[4 + i] = static_cast<uint8_t>(indices >> (8 * i));
+        }
+
+        // Alpha block (DXT5) or BC4 block from the given channel, in the
+        // eight-value mode.
+        static void EncodeAlpha(const uint8_t* pixels, int channel, uint8_t* block)
+        {
+            int lo = 255, hi = 0;
+            for (auto i = 0; i < 16; i++)
+            {
+                int v = pixels[i * 4 + channel];
+                lo = std::min(lo, v);
+                hi = std::max(hi, v);
+            }
+
+            uint64_t indices = 0;
+
+            if (hi > lo)
+            {
+                // Palette: a0 = hi, a1 = lo, then six steps from hi to lo
+                auto scale = 7.0f / (hi - lo);
+                for (auto i = 0; i < 16; i++)
+                {
+                    auto t = static_cast<int>((pixels[i * 4 + channel] - lo) * scale + 0.5f);
+                    uint64_t index = t == 7 ? 0 : (t == 0 ? 1 : 8 - t);
+                    indices |= index << (3 * i);
+                }
+            }
+
+            block[0] = static_cast<uint8_t>(hi);
+            block[1] = static_cast<uint8_t>(lo);
+            for (auto i = 0; i < 6; i++) block[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+        }
+
+        #pragma endregion
+    };
+}
@@ -1,12 +1,80 @@
 #pragma once
 
 #include <stdint.h>
-#include <vector>
+#include <cstring>
+#include <memory>
+#include "FrameBuffer.h"
 
 namespace KlakHap
 {
     struct ReadBuffer
     {
-        std::vector<uint8_t> storage;
+        FrameBuffer storage;
+
+        // Zero-copy view into memory owned by someone else (e.g. a preload
+        // arena). The owner is kept alive with the pin while it's in use.
+        const uint8_t* view = nullptr;
+        size_t viewSize = 0;
+        std::shared_ptr<const void> pin;
+
+        // Identity of the frame (source ID from FrameCache, frame index).
+        // Zero source means unknown.
+        uint32_t source = 0;
+        int frame = -1;
+
+        // Payload hash used for duplicate frame detection (zero if unknown)
+        uint64_t hash = 0;
+
+        // The payload comes from a source that was verified by the user, so
+        // it can be decoded without validation (see Demuxer::SetTrusted).
+        bool trusted = false;
+
+        const uint8_t* GetData() const
+        {
+            return view != nullptr ? view : storage.data();
+        }
+
+        size_t GetSize() const
+        {
+            return view != nullptr ? viewSize : storage.size();
+        }
+
+        void SetView(const uint8_t* data, size_t size, std::shared_ptr<const void> owner)
+        {
+            view = data;
+            viewSize = size;
+            pin = std::move(owner);
+        }
+
+        void ClearView()
+        {
+            view = nullptr;
+            viewSize = 0;
+            pin.reset();
+        }
+
+        // Fast non-cryptographic 64-bit hash of the payload. Never returns
+        // zero.
+        uint64_t ComputeHash() const
+        {
+            auto data = GetData();
+            auto size = GetSize();
+
+            uint64_t h = 0x9e3779b97f4a7c15ull ^ size;
+            size_t i = 0;
+            for (; i + 8 <= size; i += 8)
+            {
+                uint64_t word;
+                std::memcpy(&word, data + i, 8);
+                h = (h ^ word) * 0xff51afd7ed558ccdull;
+                h ^= h >> 32;
+            }
+            for (; i < size; i++) h = (h ^ data[i]) * 0x100000001b3ull;
+
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ull;
+            h ^= h >> 33;
+            return h != 0 ? h : 1;
+        }
     };
 }
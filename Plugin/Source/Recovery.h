@@ -0,0 +1,402 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "File.h"
+#include "FrameIndex.h"
+#include "hap.h"
+#include "snappy-c.h"
+
+namespace KlakHap
+{
+    //
+    // Frame index recovery
+    //
+    // Rebuilds a frame index from a movie file that lost its container index
+    // (e.g. a recording that crashed before writing the moov box). It scans
+    // the media data for Hap frame headers and follows the chain of frames
+    // from each header found. The file is split into large strides that are
+    // scanned in parallel, then the partial chains are stitched together.
+    //
+    // Frame dimensions and the frame rate can't be recovered from the frame
+    // data, so they have to be given by the caller.
+    //
+    class Recovery
+    {
+    public:
+
+        #pragma region Public methods
+
+        static bool Scan(const char* path,
+                         int width, int height, double frameRate,
+                         FrameIndex& index)
+        {
+            index.Clear();
+            if (width <= 0 || height <= 0 || frameRate <= 0) return false;
+
+            auto file = OpenFile(path, "rb");
+            if (file == nullptr) return false;
+
+            Range range;
+            auto found = FindMediaData(file, range);
+            fclose(file);
+            if (!found) return false;
+
+            Scanner scanner(path, range, width, height);
+            if (!scanner.Run()) return false;
+
+            index.width = width;
+            index.height = height;
+            index.frames = scanner.GetFrames();
+            index.duration = index.frames.size() / frameRate;
+            return !index.IsEmpty();
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Media data location
+
+        struct Range { uint64_t start, end; };
+
+        static uint32_t ReadBE32(const uint8_t* p)
+        {
+            return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+                   (uint32_t(p[2]) << 8) | p[3];
+        }
+
+        // Walk through the top-level boxes and find the extent of 'mdat'.
+        // A crashed recorder usually leaves the size field unpatched, so an
+        // invalid size is treated as "till the end of the file". When there
+        // is no recognizable box structure, the whole file is scanned.
+        static bool FindMediaData(FILE* file, Range& range)
+        {
+            auto fileSize = GetFileSize(file);
+            range.start = 0;
+            range.end = fileSize;
+
+            uint64_t pos = 0;
+            while (pos + 8 <= fileSize)
+            {
+                uint8_t header[16];
+                if (!SeekFile(file, pos) || fread(header, 8, 1, file) != 1) break;
+
+                uint64_t size = ReadBE32(header);
+                auto type = ReadBE32(header + 4);
+                auto headerSize = 8u;
+
+                if (size == 1)
+                {
+                    if (fread(header + 8, 8, 1, file) != 1) break;
+                    size = (uint64_t(ReadBE32(header + 8)) << 32) | ReadBE32(header + 12);
+                    headerSize = 16u;
+                }
+
+                if (type == FourCC('m', 'd', 'a', 't'))
+                {
+                    range.start = pos + headerSize;
+                    auto valid = size >= headerSize && pos + size <= fileSize;
+                    range.end = valid && size > headerSize ? pos + size : fileSize;
+                    return true;
+                }
+
+                if (size < 8 || pos + size > fileSize) break;
+                pos += size;
+            }
+
+            return fileSize > 0;
+        }
+
+        static constexpr uint32_t FourCC(char a, char b, char c, char d)
+        {
+            return (uint32_t(a) << 24) | (uint32_t(b) << 16) |
+                   (uint32_t(c) << 8) | uint32_t(d);
+        }
+
+        #pragma endregion
+
+        #pragma region Parallel scanner
+
+        class Scanner
+        {
+        public:
+
+            Scanner(const char* path, Range range, int width, int height)
+              : path_(path), range_(range), width_(width), height_(height) {}
+
+            bool Run()
+            {
+                // The first frame in the media data determines the texture
+                // format of the stream.
+                auto file = OpenFile(path_.c_str(), "rb");
+                if (file == nullptr) return false;
+                first_ = Resync(file, range_.start, range_.end);
+                auto found = first_ < range_.end && ProbeAt(file, first_, firstType_) > 0;
+                fclose(file);
+                if (!found) return false;
+
+                // Stride layout: At least 64MB per stride to keep the seek
+                // overhead low, at most one stride per hardware thread.
+                auto length = range_.end - first_;
+                auto threads = std::max(1u, std::thread::hardware_concurrency());
+                auto stride = std::max(uint64_t(kMinStride), length / threads + 1);
+                auto count = static_cast<size_t>((length + stride - 1) / stride);
+
+                strides_.resize(count);
+                for (auto i = 0u; i < count; i++)
+                {
+                    strides_[i].range.start = first_ + stride * i;
+                    strides_[i].range.end = std::min(range_.end, strides_[i].range.start + stride);
+                }
+
+                std::vector<std::thread> workers;
+                for (auto i = 1u; i < count; i++)
+                    workers.emplace_back(&Scanner::ScanStride, this, i);
+                ScanStride(0);
+                for (auto& worker : workers) worker.join();
+
+                return Stitch();
+            }
+
+            const std::vector<FrameIndex::Entry>& GetFrames() const
+            {
+                return frames_;
+            }
+
+        private:
+
+            static const uint64_t kMinStride = 64ull << 20;
+            static const size_t kProbeSize = 4096;
+            static const size_t kBlockSize = 1 << 20;
+
+            struct Stride
+            {
+                Range range;
+                std::vector<FrameIndex::Entry> frames;
+                uint64_t next = 0;
+                bool ok = true;
+            };
+
+            std::string path_;
+            Range range_;
+            int width_, height_;
+            std::vector<Stride> strides_;
+            std::vector<FrameIndex::Entry> frames_;
+
+            // Uncompressed texture size for a given frame type
+            size_t ExpectedTextureSize(unsigned int type) const
+            {
+                auto blocks = size_t((width_ + 3) / 4) * ((height_ + 3) / 4);
+                switch (type & 0xf)
+                {
+                case 0xb: return blocks * 8;  // DXT1
+                case 0x1: return blocks * 8;  // BC4
+                case 0xe: return blocks * 16; // DXT5
+                case 0xf: return blocks * 16; // DXT5 (YCoCg)
+                case 0xc: return blocks * 16; // BC7
+                case 0x2: return blocks * 16; // BC6H (unsigned)
+                case 0x3: return blocks * 16; // BC6H (signed)
+                }
+                return 0;
+            }
+
+            // Check if the probed data is the head of a frame that fits in
+            // the range, and return the frame length.
+            uint32_t Probe(const uint8_t* data, size_t size, uint64_t offset, uint8_t& type) const
+            {
+                unsigned long length;
+                if (HapGetFrameLength(data, size, &length) != HapResult_No_Error) return 0;
+                if (length <= 8 || offset + length > range_.end) return 0;
+
+                type = data[3];
+
+                // A single-texture frame is checked against the expected
+                // texture size, which rejects most false positives that
+                // don't have a Decode Instructions Container.
+                auto expected = ExpectedTextureSize(type);
+                auto header = (data[0] | data[1] | data[2]) ? 4u : 8u;
+
+                switch (type >> 4)
+                {
+                case 0xa:
+                    if (length - header != expected) return 0;
+                    break;
+                case 0xb:
+                    {
+                        size_t decoded;
+                        if (snappy_uncompressed_length(reinterpret_cast<const char*>(data + header),
+                                size - header, &decoded) != SNAPPY_OK) return 0;
+                        if (decoded != expected) return 0;
+                    }
+                    break;
+                }
+
+                return static_cast<uint32_t>(length);
+            }
+
+            // Read the head of a frame candidate and probe it.
+            uint32_t ProbeAt(FILE* file, uint64_t offset, uint8_t& type) const
+            {
+                uint8_t head[kProbeSize];
+                auto size = static_cast<size_t>(std::min(uint64_t(kProbeSize), range_.end - offset));
+                if (size < 8 || !SeekFile(file, offset)) return 0;
+                size = fread(head, 1, size, file);
+                return Probe(head, size, offset, type);
+            }
+
+            // Search for the next frame header by scanning byte-by-byte.
+            // Returns the limit position when nothing was found.
+            uint64_t Resync(FILE* file, uint64_t pos, uint64_t limit) const
+            {
+                std::vector<uint8_t> block(kBlockSize + kProbeSize);
+
+                while (pos < limit)
+                {
+                    auto size = static_cast<size_t>(std::min<uint64_t>(block.size(), range_.end - pos));
+                    if (!SeekFile(file, pos)) break;
+                    size = fread(block.data(), 1, size, file);
+                    if (size < 8) break;
+
+                    auto scan = std::min(size - 7, size_t(kBlockSize));
+                    for (auto i = 0u; i < scan && pos + i < limit; i++)
+                    {
+                        // Quick rejection with the section type byte
+                        if (!IsFrameType(block[i + 3])) continue;
+
+                        uint8_t type;
+                        auto avail = std::min(size - i, size_t(kProbeSize));
+                        auto found = avail == kProbeSize || pos + size == range_.end ?
+                            Probe(&block[i], avail, pos + i, type) :
+                            ProbeAt(file, pos + i, type);
+
+                        if (found > 0) return pos + i;
+                    }
+
+                    pos += scan;
+                }
+
+                return limit;
+            }
+
+            static bool IsFrameType(uint8_t type)
+            {
+                if (type == 0x0d) return true; // Multiple images
+                auto comp = type >> 4, format = type & 0xf;
+                return (comp == 0xa || comp == 0xb || comp == 0xc) &&
+                       (format == 0xb || format == 0xe || format == 0xf ||
+                        format == 0x1 || format == 0xc || format == 0x2 ||
+                        format == 0x3);
+            }
+
+            // Follow the frame chain from a given position. Walking stops
+            // when a frame starts at or after "limit", or when it lands on
+            // an offset in "stop" (a chain found by another stride).
+            uint64_t Walk(FILE* file, uint64_t pos, uint64_t limit,
+                          const std::vector<FrameIndex::Entry>* stop,
+                          std::vector<FrameIndex::Entry>& out) const
+            {
+                while (pos < limit)
+                {
+                    if (stop != nullptr && Contains(*stop, pos)) return pos;
+
+                    uint8_t type;
+                    auto length = ProbeAt(file, pos, type);
+
+                    if (length == 0)
+                    {
+                        // Lost the chain (e.g. interleaved audio data)
+                        pos = Resync(file, pos + 1, limit);
+                        continue;
+                    }
+
+                    // Frames in a stream must share the same texture format.
+                    if ((type & 0xf) != (firstType_ & 0xf))
+                    {
+                        pos = Resync(file, pos + 1, limit);
+                        continue;
+                    }
+
+                    FrameIndex::Entry entry = { pos, length };
+                    out.push_back(entry);
+                    pos += length;
+                }
+                return pos;
+            }
+
+            static bool Contains(const std::vector<FrameIndex::Entry>& frames, uint64_t offset)
+            {
+                auto it = std::lower_bound(frames.begin(), frames.end(), offset,
+                    [](const FrameIndex::Entry& e, uint64_t o) { return e.offset < o; });
+                return it != frames.end() && it->offset == offset;
+            }
+
+            void ScanStride(size_t i)
+            {
+                auto& stride = strides_[i];
+                auto file = OpenFile(path_.c_str(), "rb");
+                if (file == nullptr) { stride.ok = false; return; }
+
+                // Each stride resyncs from its start, except the first one
+                // that starts from the first frame.
+                auto start = i == 0 ? first_ :
+                    Resync(file, stride.range.start, stride.range.end);
+
+                stride.next = Walk(file, start, stride.range.end, nullptr, stride.frames);
+                fclose(file);
+            }
+
+            // Stitch the partial chains together. When the chain from the
+            // previous stride doesn't meet the chain found by the next
+            // stride, the gap is walked again sequentially.
+            bool Stitch()
+            {
+                auto file = OpenFile(path_.c_str(), "rb");
+                if (file == nullptr) return false;
+
+                auto next = first_;
+                auto ok = true;
+
+                for (auto& stride : strides_)
+                {
+                    if (!stride.ok) { ok = false; break; }
+
+                    // The previous chain went through the whole stride.
+                    if (next >= stride.range.end) continue;
+
+                    // Frames before the expected position are overlapped by
+                    // the previous chain, so they must be false positives.
+                    std::vector<FrameIndex::Entry> tail(
+                        std::lower_bound(stride.frames.begin(), stride.frames.end(), next,
+                            [](const FrameIndex::Entry& e, uint64_t o) { return e.offset < o; }),
+                        stride.frames.end());
+
+                    // Walk the gap if the chains don't meet.
+                    if (tail.empty() || tail.front().offset != next)
+                        next = Walk(file, next, stride.range.end, &tail, frames_);
+
+                    // Append the chain from the meeting point.
+                    if (Contains(tail, next))
+                    {
+                        auto meet = std::lower_bound(tail.begin(), tail.end(), next,
+                            [](const FrameIndex::Entry& e, uint64_t o) { return e.offset < o; });
+                        frames_.insert(frames_.end(), meet, tail.end());
+                        next = stride.next;
+                    }
+                }
+
+                fclose(file);
+                return ok && !frames_.empty();
+            }
+
+            uint64_t first_ = 0;
+            uint8_t firstType_ = 0;
+        };
+
+        #pragma endregion
+    };
+}
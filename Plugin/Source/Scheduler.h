@@ -0,0 +1,276 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Decoder.h"
+#include "StreamReader.h"
+
+namespace KlakHap
+{
+    //
+    // Decode scheduler
+    //
+    // Runs the decode jobs of all the streams on a shared pool of worker
+    // threads, earliest presentation deadline first. Each stream has at most
+    // one queued job; a new job replaces the queued one, inheriting its
+    // deadline. A job that can't make its deadline (judging from the stream's
+    // recent decode times) is dropped, unless the stream has already dropped
+    // several frames in a row, in which case it's decoded anyway and counted
+    // as late.
+    //
+    // Jobs of a stream never run concurrently, so the stream reader keeps a
+    // single consumer.
+    //
+    class Scheduler
+    {
+    public:
+
+        using Clock = std::chrono::steady_clock;
+
+        static Scheduler& Get()
+        {
+            static Scheduler instance;
+            return instance;
+        }
+
+        #pragma region Job control
+
+        // Advance the stream to the given time and decode the frame, within
+        // the given number of seconds from now.
+        void Submit(Decoder* decoder, StreamReader* reader, float time, float deadline)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                auto& job = jobs_[decoder];
+
+                auto due = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<float>(std::max(deadline, 0.0f)));
+
+                if (job.queued)
+                {
+                    // Superseded before starting: The stream keeps the
+                    // earlier deadline, so that it isn't starved by others.
+                    job.dropped++;
+                    job.consecutiveDrops++;
+                    due = std::min(due, job.deadline);
+                }
+
+                job.reader = reader;
+                job.time = time;
+                job.deadline = due;
+                job.queued = true;
+
+                StartWorkers();
+            }
+
+            work_.notify_one();
+        }
+
+        // Cancel the queued job of the decoder and wait for the running one.
+        void Flush(Decoder* decoder)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto it = jobs_.find(decoder);
+            if (it == jobs_.end()) return;
+            auto& job = it->second;
+            if (job.queued) { job.queued = false; job.dropped++; }
+            idle_.wait(lock, [&]() { return !IsRunning(decoder); });
+
+            // Look it up again, as the table may be rehashed while waiting.
+            it = jobs_.find(decoder);
+            if (it != jobs_.end()) it->second.missed = false;
+        }
+
+        // Forget the decoder. The workers are stopped with the last one.
+        void Remove(Decoder* decoder)
+        {
+            std::vector<std::thread> workers;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (jobs_.find(decoder) == jobs_.end()) return;
+
+                // Submit() may rehash the table while waiting, so the job
+                // is looked up again each time, and erased by the key.
+                idle_.wait(lock, [&]() { return !IsRunning(decoder); });
+                if (jobs_.erase(decoder) == 0) return;
+
+                if (!jobs_.empty()) return;
+                stop_ = true;
+                workers.swap(workers_);
+            }
+
+            work_.notify_all();
+            for (auto& t : workers) t.join();
+        }
+
+        #pragma endregion
+
+        #pragma region Statistics
+
+        // Frames skipped because they were superseded or couldn't make
+        // their deadlines
+        uint64_t GetDroppedCount(Decoder* decoder) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = jobs_.find(decoder);
+            return it != jobs_.end() ? it->second.dropped : 0;
+        }
+
+        // Frames decoded after their deadlines
+        uint64_t GetLateCount(Decoder* decoder) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = jobs_.find(decoder);
+            return it != jobs_.end() ? it->second.late : 0;
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        struct Job
+        {
+            StreamReader* reader = nullptr;
+            float time = 0;
+            Clock::time_point deadline;
+            bool queued = false;
+            bool running = false;
+
+            // Moving average of the decode time
+            Clock::duration estimate = Clock::duration::zero();
+            int consecutiveDrops = 0;
+
+            // The current frame of the stream was dropped.
+            bool missed = false;
+
+            uint64_t dropped = 0;
+            uint64_t late = 0;
+        };
+
+        static const int kMaxConsecutiveDrops = 2;
+
+        Scheduler() {}
+
+        mutable std::mutex mutex_;
+        std::condition_variable work_;
+        std::condition_variable idle_;
+        std::unordered_map<Decoder*, Job> jobs_;
+        std::vector<std::thread> workers_;
+        bool stop_ = false;
+
+        // Called with the lock held.
+        void StartWorkers()
+        {
+            if (!workers_.empty()) return;
+            stop_ = false;
+            auto count = std::max(2u, std::thread::hardware_concurrency());
+            for (auto i = 0u; i < count; i++)
+                workers_.emplace_back(&Scheduler::WorkerThread, this);
+        }
+
+        // Called with the lock held.
+        bool IsRunning(Decoder* decoder) const
+        {
+            auto it = jobs_.find(decoder);
+            return it != jobs_.end() && it->second.running;
+        }
+
+        // Called with the lock held.
+        std::pair<Decoder* const, Job>* PickEarliest()
+        {
+            std::pair<Decoder* const, Job>* pick = nullptr;
+            for (auto& pair : jobs_)
+            {
+                auto& job = pair.second;
+                if (!job.queued || job.running) continue;
+                if (!pick || job.deadline < pick->second.deadline) pick = &pair;
+            }
+            return pick;
+        }
+
+        #pragma endregion
+
+        #pragma region Worker thread function
+
+        void WorkerThread()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            while (true)
+            {
+                std::pair<Decoder* const, Job>* pick = nullptr;
+                work_.wait(lock, [&]() { return stop_ || (pick = PickEarliest()) != nullptr; });
+                if (stop_) break;
+
+                auto decoder = pick->first;
+                auto& job = pick->second;
+                job.queued = false;
+                job.running = true;
+
+                auto reader = job.reader;
+                auto time = job.time;
+                auto deadline = job.deadline;
+                auto estimate = job.estimate;
+                auto mayDrop = job.consecutiveDrops < kMaxConsecutiveDrops;
+                auto missed = job.missed;
+
+                lock.unlock();
+
+                // The stream is always advanced, so that the read-ahead
+                // keeps up with the playhead even while dropping frames.
+                auto input = reader->Advance(time);
+                if (input == nullptr && missed) input = reader->GetCurrent();
+
+                auto decoded = false, dropped = false;
+                auto start = Clock::now();
+
+                if (input != nullptr && !decoder->IsResident(*input))
+                {
+                    if (mayDrop && start + estimate > deadline)
+                    {
+                        dropped = true;
+                    }
+                    else
+                    {
+                        decoder->DecodeFrame(*input);
+                        decoded = true;
+                    }
+                }
+
+                auto end = Clock::now();
+
+                lock.lock();
+
+                if (input != nullptr) job.missed = dropped;
+
+                if (dropped)
+                {
+                    job.dropped++;
+                    job.consecutiveDrops++;
+                }
+                else if (decoded)
+                {
+                    job.estimate = job.estimate == Clock::duration::zero() ?
+                        end - start : (job.estimate * 7 + (end - start)) / 8;
+                    job.consecutiveDrops = 0;
+                    if (end > deadline) job.late++;
+                }
+
+                job.running = false;
+                idle_.notify_all();
+            }
+        }
+
+        #pragma endregion
+    };
+}
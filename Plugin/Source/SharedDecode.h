@@ -0,0 +1,154 @@
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+#include "FrameCache.h"
+
+namespace KlakHap
+{
+    //
+    // Shared decode table
+    //
+    // Dedupes decoding of the same frame across decoders (e.g. several
+    // players showing the same clip in sync). The first decoder that asks
+    // for a frame decodes it and publishes the image; the others wait for
+    // it and share the image by reference, including the buffer used for
+    // texture uploads. Images are held weakly, so a frame is only shared
+    // while some decoder still has it.
+    //
+    class SharedDecode
+    {
+    public:
+
+        using Image = FrameCache::Image;
+
+        static SharedDecode& Get()
+        {
+            static SharedDecode instance;
+            return instance;
+        }
+
+        #pragma region Sharing operations
+
+        // Returns the image of the frame when another decoder has decoded it
+        // (waiting for it when it's in progress). Returns nullptr when the
+        // caller is responsible for decoding the frame; the caller must call
+        // Publish() after decoding.
+        Image Join(uint32_t source, int frame)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            auto key = MakeKey(source, frame);
+
+            while (true)
+            {
+                auto it = map_.find(key);
+
+                if (it == map_.end())
+                {
+                    map_[key].pending = true;
+                    return nullptr;
+                }
+
+                if (it->second.pending)
+                {
+                    ready_.wait(lock);
+                    continue;
+                }
+
+                auto image = it->second.image.lock();
+                if (image)
+                {
+                    shares_++;
+                    return image;
+                }
+
+                it->second.pending = true;
+                return nullptr;
+            }
+        }
+
+        // Null image means the decoding failed.
+        void Publish(uint32_t source, int frame, const Image& image)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+
+                auto key = MakeKey(source, frame);
+                if (image)
+                {
+                    auto& entry = map_[key];
+                    entry.image = image;
+                    entry.pending = false;
+                }
+                else
+                {
+                    map_.erase(key);
+                }
+
+                if (++publishes_ % kSweepInterval == 0) Sweep();
+            }
+
+            ready_.notify_all();
+        }
+
+        // Remove the entry if it refers to the image, so that the image can
+        // be overwritten once the caller is the only owner.
+        void Retract(uint32_t source, int frame, const Image& image)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = map_.find(MakeKey(source, frame));
+            if (it != map_.end() && !it->second.pending &&
+                it->second.image.lock() == image) map_.erase(it);
+        }
+
+        uint64_t GetShareCount() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return shares_;
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region Private members
+
+        struct Entry
+        {
+            std::weak_ptr<FrameBuffer> image;
+            bool pending = false;
+        };
+
+        static const uint32_t kSweepInterval = 64;
+
+        SharedDecode() {}
+
+        mutable std::mutex mutex_;
+        std::condition_variable ready_;
+        std::unordered_map<uint64_t, Entry> map_;
+        uint32_t publishes_ = 0;
+        uint64_t shares_ = 0;
+
+        static uint64_t MakeKey(uint32_t source, int frame)
+        {
+            return (static_cast<uint64_t>(source) << 32) | static_cast<uint32_t>(frame);
+        }
+
+        // Remove the entries whose images are no longer held by anyone.
+        void Sweep()
+        {
+            for (auto it = map_.begin(); it != map_.end();)
+            {
+                if (!it->second.pending && it->second.image.expired())
+                    it = map_.erase(it);
+                else
+                    ++it;
+            }
+        }
+
+        #pragma endregion
+    };
+}
@@ -0,0 +1,872 @@
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Demuxer.h"
+#include "MemoryGovernor.h"
+#include "ReadBuffer.h"
+#include "TaskPool.h"
+
+namespace KlakHap
+{
+    //
+    // Stream reader
+    //
+    // Reads frames ahead of the playhead on a background thread. Read buffers
+    // go around two single-producer/single-consumer rings: The lead ring
+    // carries filled buffers from the reader thread to the consumer, and the
+    // free ring returns them. Advance() only touches the rings, and takes the
+    // lock only to wake up the reader thread when it's sleeping.
+    //
+    // The read-ahead depth (number of buffers) adapts to the measured read
+    // latency, the frame consumption rate and the frame size, within a byte
+    // cap. Buffers are allocated and trimmed on the reader thread, within the
+    // memory governor's headroom; Under memory pressure, the governor squeezes
+    // the buffers down toward the minimum depth. On slow
+    // storage, where a single read may take longer than a frame, the reader
+    // thread reads several frames in parallel.
+    //
+    // Free buffers keep their frames and serve as a scrub cache. The reader
+    // thread fills it in its spare time with the frames on both sides of the
+    // playhead, weighted toward the direction of motion, so that a direction
+    // change or a small step back can be served without reading the file.
+    // Seek() moves the read position without file I/O when the frame is in
+    // the cache; Restart() is only needed on a miss.
+    //
+    // Advance() and Restart() are consumer-side methods; They must not be
+    // called concurrently.
+    //
+    class StreamReader
+    {
+    public:
+
+        #pragma region Constructor/destructor
+
+        StreamReader(Demuxer& demuxer, float time, float delta)
+          : demuxer_(demuxer)
+        {
+            for (auto i = 0u; i < kInitialDepth; i++)
+            {
+                slots_.emplace_back(new Slot);
+                free_.Push(slots_.back().get());
+            }
+            depth_ = static_cast<int>(slots_.size());
+            request_ = Request{ time, SafeDelta(delta), 0 };
+            pending_ = true;
+            clientID_ = MemoryGovernor::Get().Register(MemoryGovernor::ReadAhead, 0,
+                [this](uint64_t bytes) { return Reclaim(bytes); });
+            thread_ = std::thread(&StreamReader::ReaderThread, this);
+        }
+
+        ~StreamReader()
+        {
+            MemoryGovernor::Get().Unregister(clientID_);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                terminate_ = true;
+            }
+            wake_.notify_one();
+            prefetch_.notify_one();
+            thread_.join();
+            if (prefetcher_.joinable()) prefetcher_.join();
+
+            MemoryGovernor::Get().Add(MemoryGovernor::ReadAhead,
+                                      -static_cast<int64_t>(accounted_.load()));
+        }
+
+        #pragma endregion
+
+        #pragma region Consumer methods
+
+        // Move the read position. Returns after the first frame at the new
+        // position was read.
+        void Restart(float time, float delta)
+        {
+            auto generation = PostRequest(time, delta);
+            std::unique_lock<std::mutex> lock(mutex_);
+            read_.wait(lock, [=]() { return produced_ == generation || terminate_; });
+        }
+
+        // Move the read position, only when the frame at the new position is
+        // the current one or in the scrub cache. The reader thread pushes a
+        // cached frame without reading the file, so the wait is short.
+        // Returns false on a miss.
+        bool Seek(float time, float delta)
+        {
+            auto frame = GetFrameNumber(time);
+            if (current_ != nullptr && current_->index == frame) return true;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (std::find(cached_.begin(), cached_.end(), frame) == cached_.end()) return false;
+            }
+
+            auto generation = PostRequest(time, delta);
+            std::unique_lock<std::mutex> lock(mutex_);
+            read_.wait(lock, [=]() { return produced_ == generation || terminate_; });
+            return true;
+        }
+
+        // Returns a buffer only when the frame was changed.
+        const ReadBuffer* Advance(float time)
+        {
+            // Add an epsilon-ish value to avoid rounding error.
+            time += 1e-6f;
+
+            auto generation = generation_.load(std::memory_order_relaxed);
+            auto changed = false, freed = false;
+
+            // Scan the lead ring.
+            Slot* peek;
+            while (lead_.Peek(peek))
+            {
+                if (peek->generation != generation)
+                {
+                    // Stale frame from before a restart
+                    lead_.Pop(peek);
+                    free_.Push(peek);
+                    freed = true;
+                    continue;
+                }
+
+                if (current_ != nullptr)
+                {
+                    if (current_->time <= peek->time)
+                    {
+                        // Forward playback case:
+                        // Break if it hasn't reached the next frame.
+                        if (time < peek->time) break;
+                    }
+                    else
+                    {
+                        // Reverse playback case:
+                        // Break if it's still on the current frame.
+                        if (current_->time < time) break;
+                    }
+
+                    // Free the current frame before replacing it.
+                    free_.Push(current_);
+                    freed = true;
+                }
+
+                lead_.Pop(current_);
+                changed = true;
+            }
+
+            if (changed) MeasureConsumption();
+
+            // The scrub cache follows the playhead.
+            auto playhead = playhead_.load(std::memory_order_relaxed);
+            TrackPlayhead(time);
+            if (cacheSize_.load(std::memory_order_relaxed) > 0 &&
+                playhead != playhead_.load(std::memory_order_relaxed)) freed = true;
+
+            // Poke the reader thread.
+            if (freed) WakeReader();
+
+            return changed ? &current_->buffer : nullptr;
+        }
+
+        // The frame returned by the last frame change in Advance()
+        const ReadBuffer* GetCurrent() const
+        {
+            return current_ != nullptr ? &current_->buffer : nullptr;
+        }
+
+        #pragma endregion
+
+        #pragma region Read-ahead depth
+
+        // Current number of read buffers
+        int GetDepth() const
+        {
+            return depth_.load(std::memory_order_relaxed);
+        }
+
+        // Upper limit of the total size of the read buffers
+        void SetByteCap(uint64_t bytes)
+        {
+            byteCap_.store(bytes, std::memory_order_relaxed);
+        }
+
+        // Priority in the memory governor (lower ones are squeezed first)
+        void SetPriority(int priority)
+        {
+            MemoryGovernor::Get().SetPriority(clientID_, priority);
+        }
+
+        // Number of frames kept around the playhead for scrubbing
+        void SetCacheSize(int frames)
+        {
+            cacheSize_.store(std::min(std::max(frames, 0), int(kMaxCacheSize)),
+                             std::memory_order_relaxed);
+            WakeReader();
+        }
+
+        #pragma endregion
+
+    private:
+
+        #pragma region SPSC ring
+
+        template <typename T, size_t N>
+        class Ring
+        {
+        public:
+
+            bool Push(T item)
+            {
+                auto tail = tail_.load(std::memory_order_relaxed);
+                if (tail - head_.load(std::memory_order_acquire) == N) return false;
+                items_[tail % N] = item;
+                tail_.store(tail + 1, std::memory_order_release);
+                return true;
+            }
+
+            bool Peek(T& item) const
+            {
+                auto head = head_.load(std::memory_order_relaxed);
+                if (head == tail_.load(std::memory_order_acquire)) return false;
+                item = items_[head % N];
+                return true;
+            }
+
+            bool Pop(T& item)
+            {
+                if (!Peek(item)) return false;
+                head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+                return true;
+            }
+
+            bool IsEmpty() const
+            {
+                return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+            }
+
+        private:
+
+            T items_[N];
+            std::atomic<size_t> head_{0};
+            std::atomic<size_t> tail_{0};
+        };
+
+        #pragma endregion
+
+        #pragma region Private members
+
+        static const size_t kInitialDepth = 4;
+        static const size_t kMinDepth = 3;
+        static const size_t kMaxDepth = 64;
+        static const size_t kTrimHysteresis = 2;
+        static const size_t kMaxParallelReads = 8;
+        static const int kMaxCacheSize = 256;
+
+        using Clock = std::chrono::steady_clock;
+
+        struct Slot
+        {
+            ReadBuffer buffer;
+            int index = -1;
+            float time = 0;
+            uint32_t generation = 0;
+        };
+
+        struct Request
+        {
+            float time, delta;
+            uint32_t generation;
+        };
+
+        Demuxer& demuxer_;
+        std::vector<std::unique_ptr<Slot>> slots_; // Owned by the reader thread
+        std::vector<FILE*> handles_;               // Owned by the reader thread
+        Slot* current_ = nullptr;
+
+        // Extra room for the slots added on restarts
+        Ring<Slot*, kMaxDepth * 2> lead_; // Reader thread -> consumer
+        Ring<Slot*, kMaxDepth * 2> free_; // Consumer -> reader thread
+
+        std::thread thread_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable read_;
+        std::atomic<uint32_t> generation_{0};
+        Request request_;
+        uint32_t produced_ = 0;
+        bool pending_ = false;
+        bool terminate_ = false;
+        std::atomic<bool> sleeping_{false};
+
+        // Depth control
+        std::atomic<int> depth_{0};
+        std::atomic<uint64_t> byteCap_{256ull << 20};
+        std::atomic<float> interval_{1.0f / 60}; // Consumer -> reader thread
+        Clock::time_point lastChange_;           // Consumer only
+        float latencyPeak_ = 0;                  // Reader thread only
+        float frameBytes_ = 0;                   // Reader thread only
+
+        // Memory governor
+        static const uint64_t kNoSqueeze = ~0ull;
+        int clientID_;
+        std::atomic<uint64_t> squeeze_{kNoSqueeze};
+        std::atomic<uint64_t> accounted_{0};
+        std::atomic<size_t> slotCount_{0};
+
+        // Scrub cache
+        std::atomic<int> cacheSize_{0};
+        std::atomic<int> playhead_{0};           // Consumer -> reader thread
+        std::atomic<float> velocity_{0};         // Consumer -> reader thread
+        std::vector<int> cached_;                // Reader thread -> consumer (guarded by the lock)
+        Clock::time_point lastSample_;           // Consumer only
+        float lastTime_ = 0;                     // Consumer only
+
+        // Prefetch job (guarded by the lock)
+        std::thread prefetcher_;
+        std::condition_variable prefetch_;
+        Slot* prefetchSlot_ = nullptr;
+        int prefetchFrame_ = -1;
+        bool prefetchDone_ = false;
+
+        // Measure the interval of frame changes on the consumer side.
+        void MeasureConsumption()
+        {
+            auto now = Clock::now();
+            if (lastChange_ != Clock::time_point())
+            {
+                auto dt = std::chrono::duration<float>(now - lastChange_).count();
+                dt = std::min(std::max(dt, 1e-3f), 1.0f);
+                auto prev = interval_.load(std::memory_order_relaxed);
+                interval_.store(prev + (dt - prev) * 0.2f, std::memory_order_relaxed);
+            }
+            lastChange_ = now;
+        }
+
+        // Record a read on the reader thread. The latency is tracked with a
+        // slowly decaying peak, as stalls matter more than the average.
+        void MeasureRead(float latency, size_t bytes)
+        {
+            latencyPeak_ = std::max(latency, latencyPeak_ * 0.95f);
+            frameBytes_ += (static_cast<float>(bytes) - frameBytes_) * 0.2f;
+        }
+
+        // Number of buffers needed to hide the read latency: Twice the peak
+        // latency in frames, plus the current frame and the next one.
+        size_t GetDesiredDepth() const
+        {
+            auto interval = std::max(interval_.load(std::memory_order_relaxed), 1e-3f);
+            auto depth = static_cast<size_t>(std::ceil(latencyPeak_ * 2 / interval)) + 2;
+
+            if (frameBytes_ > 0)
+            {
+                auto cap = GetEffectiveCap();
+                depth = std::min(depth, static_cast<size_t>(cap / frameBytes_));
+            }
+
+            return std::min(std::max(depth, size_t(kMinDepth)), size_t(kMaxDepth));
+        }
+
+        uint64_t GetEffectiveCap() const
+        {
+            return std::min(byteCap_.load(std::memory_order_relaxed), squeeze_.load());
+        }
+
+        // Report the buffer memory to the governor (reader thread).
+        void UpdateAccounting()
+        {
+            uint64_t bytes = 0;
+            for (const auto& slot : slots_)
+                if (slot.get() != prefetchSlot_) bytes += slot->buffer.storage.capacity();
+
+            auto prev = accounted_.exchange(bytes);
+            slotCount_.store(slots_.size());
+            MemoryGovernor::Get().Add(MemoryGovernor::ReadAhead,
+                                      static_cast<int64_t>(bytes) - static_cast<int64_t>(prev));
+            if (bytes > prev) MemoryGovernor::Get().Enforce();
+        }
+
+        // Called by the memory governor under pressure: Lower the byte cap
+        // toward the minimum depth. The buffers are trimmed on the reader
+        // thread, so the bytes are released asynchronously.
+        uint64_t Reclaim(uint64_t bytes)
+        {
+            auto current = accounted_.load();
+            auto slots = slotCount_.load();
+            if (slots <= kMinDepth || current == 0) return 0;
+
+            auto floor = current / slots * kMinDepth;
+            auto target = current > floor + bytes ? current - bytes : floor;
+            if (target >= squeeze_.load()) return 0;
+
+            squeeze_.store(target);
+            WakeReader();
+            return current - target;
+        }
+
+        // Wake up the reader thread after pushing to the free ring. The fence
+        // pairs with the one in the reader thread, so that either the reader
+        // sees the pushed slot or this sees the sleeping flag.
+        void WakeReader()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!sleeping_.load(std::memory_order_relaxed)) return;
+            { std::lock_guard<std::mutex> lock(mutex_); }
+            wake_.notify_one();
+        }
+
+        // Send a restart request to the reader thread. Returns the generation
+        // number of the request.
+        uint32_t PostRequest(float time, float delta)
+        {
+            uint32_t generation;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                generation = ++generation_;
+                request_ = Request{ time, SafeDelta(delta), generation };
+                pending_ = true;
+            }
+            wake_.notify_one();
+
+            // Flush out the lead ring. Stale buffers pushed after this point
+            // are dropped in Advance().
+            Slot* slot;
+            while (lead_.Pop(slot)) free_.Push(slot);
+            WakeReader();
+
+            // The consumption rate will be measured again from here.
+            lastChange_ = Clock::time_point();
+            TrackPlayhead(time);
+
+            return generation;
+        }
+
+        // Time -> Frame count
+        // Rounding strategy: We don't prefer std::round because it can show
+        // a frame before the playhead reaches it (especially when using
+        // slow-mo). On the other hand, std::floor causes frame skipping due
+        // to rounding errors. To avoid these problems, we use the "adding a
+        // very-very small fractional frame" approach. 1/1000 might be safe
+        // and enough for all the cases. Clips without a valid duration stay
+        // at frame 0.
+        int GetFrameCount(float time) const
+        {
+            auto total = demuxer_.GetFrameCount();
+            auto duration = demuxer_.GetDuration();
+            if (total <= 0 || !(duration > 0)) return 0;
+            return static_cast<int>(time * total / duration + 1e-3f);
+        }
+
+        // Frame count -> Wrapped frame number
+        int WrapFrameCount(int count) const
+        {
+            auto total = demuxer_.GetFrameCount();
+            if (total <= 0) return 0;
+            auto frame = count % total;
+            return frame < 0 ? frame + total : frame;
+        }
+
+        // Time -> Wrapped frame number
+        int GetFrameNumber(float time) const
+        {
+            return WrapFrameCount(GetFrameCount(time));
+        }
+
+        // Used to avoid too small delta time values.
+        float SafeDelta(float delta) const
+        {
+            auto total = demuxer_.GetFrameCount();
+            auto min = total > 0 ? static_cast<float>(demuxer_.GetDuration() / total) : 0.0f;
+            return std::max(std::abs(delta), min) * (delta < 0 ? -1 : 1);
+        }
+
+        #pragma endregion
+
+        #pragma region Thread function
+
+        void ReaderThread()
+        {
+            // Stream attributes
+            auto totalTime = demuxer_.GetDuration();
+            auto totalFrames = demuxer_.GetFrameCount();
+
+            // Free slots owned by this thread, searched by frame index. The
+            // ones that aren't in flight serve as the scrub cache.
+            std::vector<Slot*> pool;
+
+            Request state = {};
+            auto readAhead = GetDesiredDepth();
+
+            while (true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+
+                    // Wait for a free slot, a request or a cache miss.
+                    sleeping_.store(true, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    wake_.wait(lock, [&]() {
+                        return terminate_ || pending_ || !free_.IsEmpty() ||
+                               NeedsReadAhead(pool, readAhead) ||
+                               FindPrefetch(pool) >= 0 || prefetchDone_;
+                    });
+                    sleeping_.store(false, std::memory_order_relaxed);
+
+                    if (terminate_) break;
+
+                    // Take back the prefetched slot.
+                    if (prefetchDone_)
+                    {
+                        prefetchSlot_->index = prefetchFrame_;
+                        pool.push_back(prefetchSlot_);
+                        prefetchSlot_ = nullptr;
+                        prefetchDone_ = false;
+                    }
+
+                    // Apply the restart request.
+                    if (pending_)
+                    {
+                        state = request_;
+                        pending_ = false;
+                    }
+
+                    // Publish the cached frames for Seek(). It's a hint; A
+                    // frame evicted after this is just read from the file.
+                    cached_.clear();
+                    if (cacheSize_.load(std::memory_order_relaxed) > 0)
+                        for (auto s : pool) if (s->index >= 0) cached_.push_back(s->index);
+                }
+
+                // Collect the returned slots.
+                Slot* slot;
+                while (free_.Pop(slot)) pool.push_back(slot);
+
+                // Release the squeeze when the memory pressure is gone.
+                auto& governor = MemoryGovernor::Get();
+                auto squeezed = squeeze_.load() != kNoSqueeze;
+                if (squeezed && governor.GetHeadroom() > frameBytes_ * kTrimHysteresis)
+                {
+                    squeeze_.store(kNoSqueeze);
+                    squeezed = false;
+                }
+
+                // Depth adjustment: Allocate new slots within the headroom,
+                // or trim free slots when the depth is well above the desired
+                // one (or right away when squeezed).
+                readAhead = GetDesiredDepth();
+                auto cache = GetCacheCapacity(readAhead);
+                auto desired = readAhead + cache;
+                auto headroom = static_cast<float>(governor.GetHeadroom());
+                while (slots_.size() < desired && (slots_.size() < kMinDepth || headroom >= frameBytes_))
+                {
+                    slots_.emplace_back(new Slot);
+                    pool.push_back(slots_.back().get());
+                    headroom -= frameBytes_;
+                }
+                if (slots_.size() > desired + (squeezed ? 0 : kTrimHysteresis))
+                {
+                    while (slots_.size() > desired && !pool.empty())
+                    {
+                        auto victim = TakeVictim(pool);
+                        slots_.erase(std::find_if(slots_.begin(), slots_.end(),
+                            [=](const std::unique_ptr<Slot>& s) { return s.get() == victim; }));
+                    }
+                }
+
+                // The first frame after a restart has to be read even when
+                // stale frames fill the lead ring, as the consumer is blocked
+                // until then. Add a slot if no free one is left.
+                auto restarted = produced_ != state.generation;
+                if (restarted && pool.empty())
+                {
+                    slots_.emplace_back(new Slot);
+                    pool.push_back(slots_.back().get());
+                }
+
+                // The slots above the cache capacity are used for reading
+                // ahead, including the ones kept by the hysteresis.
+                readAhead = slots_.size() > cache ? slots_.size() - cache : 1;
+                depth_.store(static_cast<int>(readAhead), std::memory_order_relaxed);
+                UpdateAccounting();
+
+                // Fill the cache in the spare time.
+                if (!restarted && !NeedsReadAhead(pool, readAhead))
+                {
+                    auto frame = FindPrefetch(pool);
+                    if (frame < 0) continue;
+
+                    // Prefetching runs on a separate thread, so that it
+                    // doesn't delay restarts.
+                    if (!prefetcher_.joinable())
+                        prefetcher_ = std::thread(&StreamReader::PrefetchThread, this);
+
+                    slot = TakeVictim(pool);
+                    slot->index = -1;
+                    {
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        prefetchSlot_ = slot;
+                        prefetchFrame_ = frame;
+                    }
+                    prefetch_.notify_one();
+                    continue;
+                }
+
+                // Read a single frame per iteration, so that the first frame
+                // after a restart is pushed as soon as possible. When a read
+                // takes longer than half a frame interval, a single reader
+                // can't keep up anyway, so read a batch of frames in parallel.
+                auto batch = size_t(1);
+                if (latencyPeak_ > interval_.load(std::memory_order_relaxed) * 0.5f &&
+                    InFlight(pool) < readAhead)
+                    batch = std::min(std::min(readAhead - InFlight(pool), pool.size()),
+                                     size_t(kMaxParallelReads));
+
+                std::vector<Slot*> jobs;
+                std::vector<int> frames;
+                std::vector<float> times;
+
+                for (auto i = size_t(0); i < batch; i++)
+                {
+                    // Time -> Frame count -> Frame snapped time
+                    auto frameCount = GetFrameCount(state.time);
+                    auto snappedTime = totalFrames > 0 ?
+                        static_cast<float>(frameCount * totalTime / totalFrames) : 0.0f;
+
+                    // Frame count -> Wrapped frame number
+                    auto frameNumber = WrapFrameCount(frameCount);
+
+                    // Look for a free slot that has the same frame number.
+                    // Evict the least useful cached frame otherwise.
+                    auto found = std::find_if(pool.begin(), pool.end(),
+                        [=](const Slot* s) { return s->index == frameNumber; });
+
+                    if (found != pool.end())
+                    {
+                        jobs.push_back(*found);
+                        *found = pool.back();
+                        pool.pop_back();
+                    }
+                    else
+                    {
+                        jobs.push_back(TakeVictim(pool));
+                    }
+
+                    frames.push_back(frameNumber);
+                    times.push_back(snappedTime);
+                    state.time += state.delta;
+                }
+
+                // Frame data read (no lock held)
+                ReadFrames(jobs, frames);
+
+                for (auto i = size_t(0); i < jobs.size(); i++)
+                {
+                    // The time field is updated even on reuse to handle
+                    // wrapping-around hits.
+                    jobs[i]->time = times[i];
+                    jobs[i]->generation = state.generation;
+                    lead_.Push(jobs[i]);
+                }
+
+                // Notify the first read after a restart.
+                if (produced_ != state.generation)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        produced_ = state.generation;
+                    }
+                    read_.notify_all();
+                }
+            }
+
+            // Unblock a pending restart.
+            read_.notify_all();
+
+            for (auto file : handles_) fclose(file);
+        }
+
+        // Read frames into slots. Slots that already have the frame are
+        // skipped. The first read uses the demuxer's own file handle, and the
+        // rest use extra handles, in parallel on the shared task pool.
+        void ReadFrames(const std::vector<Slot*>& slots, const std::vector<int>& frames)
+        {
+            std::vector<size_t> reads;
+            for (auto i = size_t(0); i < slots.size(); i++)
+                if (slots[i]->index != frames[i]) reads.push_back(i);
+
+            std::vector<float> latencies(reads.size(), 0);
+
+            while (handles_.size() + 1 < reads.size())
+                handles_.push_back(demuxer_.OpenReadHandle());
+
+            auto read = [&](size_t r, FILE* file)
+            {
+                auto start = Clock::now();
+                if (file != nullptr)
+                    demuxer_.ReadFrame(frames[reads[r]], slots[reads[r]]->buffer, file);
+                else
+                    demuxer_.ReadFrame(frames[reads[r]], slots[reads[r]]->buffer);
+                latencies[r] = std::chrono::duration<float>(Clock::now() - start).count();
+            };
+
+            TaskPool::Get().Run(static_cast<int>(reads.size()), [&](int r) {
+                if (r == 0) read(0, nullptr);
+                else if (handles_[r - 1] != nullptr) read(r, handles_[r - 1]);
+            });
+
+            // Fallback for the reads that couldn't get a handle
+            for (auto r = size_t(1); r < reads.size(); r++)
+                if (handles_[r - 1] == nullptr) read(r, nullptr);
+
+            for (auto r = size_t(0); r < reads.size(); r++)
+            {
+                slots[reads[r]]->index = frames[reads[r]];
+                MeasureRead(latencies[r], slots[reads[r]]->buffer.GetSize());
+            }
+        }
+
+        // Number of slots that are in the rings or held by the consumer
+        size_t InFlight(const std::vector<Slot*>& pool) const
+        {
+            return slots_.size() - pool.size() - (prefetchSlot_ != nullptr ? 1 : 0);
+        }
+
+        bool NeedsReadAhead(const std::vector<Slot*>& pool, size_t readAhead) const
+        {
+            return !pool.empty() && InFlight(pool) < readAhead;
+        }
+
+        #pragma endregion
+
+        #pragma region Scrub cache
+
+        // Number of cache slots that fits in the byte cap
+        size_t GetCacheCapacity(size_t readAhead) const
+        {
+            auto frames = static_cast<size_t>(cacheSize_.load(std::memory_order_relaxed));
+            if (frames == 0 || frameBytes_ <= 0) return frames;
+            auto cap = static_cast<size_t>(GetEffectiveCap() / frameBytes_);
+            return cap > readAhead ? std::min(frames, cap - readAhead) : 0;
+        }
+
+        // Usefulness of a cached frame (lower is better). The cache window
+        // extends to both sides of the playhead, and the side the playhead
+        // is moving toward gets the larger share.
+        float GetCacheCost(int index) const
+        {
+            if (index < 0) return std::numeric_limits<float>::max();
+
+            auto size = static_cast<float>(cacheSize_.load(std::memory_order_relaxed));
+            auto velocity = velocity_.load(std::memory_order_relaxed);
+            auto ahead = 1 + size * (0.5f + 0.4f * std::min(std::max(velocity, -1.0f), 1.0f));
+            auto behind = 2 + size - ahead;
+
+            auto offset = static_cast<float>(index - playhead_.load(std::memory_order_relaxed));
+            if (velocity < 0) offset = -offset;
+            return offset >= 0 ? offset / ahead : -offset / behind;
+        }
+
+        // Remove the least useful frame from the pool.
+        Slot* TakeVictim(std::vector<Slot*>& pool) const
+        {
+            auto victim = std::max_element(pool.begin(), pool.end(),
+                [=](const Slot* a, const Slot* b) { return GetCacheCost(a->index) < GetCacheCost(b->index); });
+            auto slot = *victim;
+            *victim = pool.back();
+            pool.pop_back();
+            return slot;
+        }
+
+        // Find the most useful frame in the cache window that isn't in any
+        // slot yet. Returns -1 when there is nothing worth reading.
+        int FindPrefetch(const std::vector<Slot*>& pool) const
+        {
+            auto size = cacheSize_.load(std::memory_order_relaxed);
+            if (size == 0 || pool.empty() || prefetchSlot_ != nullptr) return -1;
+
+            // Slot indices are only written by the reader thread, so they can
+            // be read here even for the slots in flight.
+            std::vector<int> present;
+            for (const auto& slot : slots_) present.push_back(slot->index);
+            std::sort(present.begin(), present.end());
+
+            auto playhead = playhead_.load(std::memory_order_relaxed);
+            auto total = demuxer_.GetFrameCount();
+            auto best = -1;
+            auto bestCost = std::numeric_limits<float>::max();
+
+            for (auto offset = -size; offset <= size; offset++)
+            {
+                auto frame = playhead + offset;
+                if (frame < 0 || frame >= total) continue;
+                if (std::binary_search(present.begin(), present.end(), frame)) continue;
+                auto cost = GetCacheCost(frame);
+                if (cost < bestCost) { best = frame; bestCost = cost; }
+            }
+
+            // Only worth reading when it beats the worst cached frame.
+            if (best < 0) return -1;
+            auto worst = 0.0f;
+            for (auto slot : pool) worst = std::max(worst, GetCacheCost(slot->index));
+            return bestCost < worst ? best : -1;
+        }
+
+        // Track the playhead on the consumer side.
+        void TrackPlayhead(float time)
+        {
+            auto now = Clock::now();
+            if (lastSample_ != Clock::time_point())
+            {
+                auto dt = std::chrono::duration<float>(now - lastSample_).count();
+                if (dt < 1e-3f) return;
+                auto v = (time - lastTime_) / dt;
+                auto prev = velocity_.load(std::memory_order_relaxed);
+                velocity_.store(prev + (v - prev) * 0.3f, std::memory_order_relaxed);
+            }
+            lastSample_ = now;
+            lastTime_ = time;
+
+            playhead_.store(GetFrameNumber(time), std::memory_order_relaxed);
+        }
+
+        // Read a frame into the cache with a separate file handle.
+        void PrefetchThread()
+        {
+            auto file = demuxer_.OpenReadHandle();
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true)
+            {
+                prefetch_.wait(lock, [this]() {
+                    return terminate_ || (prefetchSlot_ != nullptr && !prefetchDone_);
+                });
+                if (terminate_) break;
+
+                auto slot = prefetchSlot_;
+                auto frame = prefetchFrame_;
+                lock.unlock();
+
+                if (file != nullptr) demuxer_.ReadFrame(frame, slot->buffer, file);
+
+                lock.lock();
+                if (file == nullptr) prefetchFrame_ = -1;
+                prefetchDone_ = true;
+                wake_.notify_one();
+            }
+
+            if (file != nullptr) fclose(file);
+        }
+
+        #pragma endregion
+    };
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace KlakHap
+{
+    //
+    // Shared task pool
+    //
+    // Persistent worker threads for the data-parallel parts of the plugin
+    // (block row bands, atlas slots, arena parts, parallel frame reads), so
+    // that they don't start threads on every call. Run() splits a job into
+    // parts and returns when all of them are done. The calling thread takes
+    // parts too, so a job always completes even when all the workers are
+    // busy, e.g. with nested calls from the decode scheduler's workers.
+    //
+    class TaskPool
+    {
+    public:
+
+        static TaskPool& Get()
+        {
+            static TaskPool instance;
+            return instance;
+        }
+
+        // Number of threads that can run the parts of a job at once
+        static int GetConcurrency()
+        {
+            return static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        }
+
+        // Run body(0) ... body(count - 1) in parallel.
+        void Run(int count, const std::function<void(int)>& body)
+        {
+            if (count <= 0) return;
+            if (count == 1) { body(0); return; }
+
+            std::shared_ptr<Job> job(new Job(count, body));
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                StartWorkers();
+                queue_.push_back(job);
+            }
+            work_.notify_all();
+
+            job->Help();
+
+            std::unique_lock<std::mutex> lock(job->mutex);
+            job->finished.wait(lock, [&]() { return job->done == job->count; });
+        }
+
+    private:
+
+        #pragma region Private members
+
+        struct Job
+        {
+            Job(int count, const std::function<void(int)>& body)
+              : count(count), body(body) {}
+
+            const int count;
+            const std::function<void(int)>& body;
+            std::atomic<int> next{0};
+
+            std::mutex mutex;
+            std::condition_variable finished;
+            int done = 0; // Guarded by the mutex
+
+            bool IsTaken() const
+            {
+                return next.load() >= count;
+            }
+
+            // Take and run parts until none is left.
+            void Help()
+            {
+                for (int part; (part = next.fetch_add(1)) < count;)
+                {
+                    body(part);
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (++done == count) finished.notify_all();
+                }
+            }
+        };
+
+        std::mutex mutex_;
+        std::condition_variable work_;
+        std::deque<std::shared_ptr<Job>> queue_;
+        std::vector<std::thread> workers_;
+        bool stop_ = false;
+
+        TaskPool() {}
+
+        ~TaskPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            work_.notify_all();
+            for (auto& t : workers_) t.join();
+        }
+
+        // Called with the lock held. The calling thread of Run() is the
+        // last one of the hardware threads.
+        void StartWorkers()
+        {
+            if (!workers_.empty()) return;
+            auto count = std::max(1, GetConcurrency() - 1);
+            for (auto i = 0; i < count; i++)
+                workers_.emplace_back(&TaskPool::WorkerThread, this);
+        }
+
+        #pragma endregion
+
+        #pragma region Worker thread function
+
+        void WorkerThread()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            while (true)
+            {
+                // Drop the jobs whose parts are all taken.
+                while (!queue_.empty() && queue_.front()->IsTaken()) queue_.pop_front();
+
+                work_.wait(lock, [this]() {
+                    while (!queue_.empty() && queue_.front()->IsTaken()) queue_.pop_front();
+                    return stop_ || !queue_.empty();
+                });
+                if (stop_) break;
+
+                auto job = queue_.front();
+                lock.unlock();
+                job->Help();
+                job.reset();
+                lock.lock();
+            }
+        }
+
+        #pragma endregion
+    };
+}
@@ -0,0 +1,488 @@
+// HapAlign - Rewrites a Hap movie file with page-aligned video frames
+//
+// Usage: HapAlign <input.mov> <output.mov>
+//
+// Every sample of the Hap video track is moved to a 4 KiB boundary in the
+// media data, with zero padding in between. The Hap track is rewritten with
+// one sample per chunk, and the chunk offset tables of all the tracks are
+// regenerated ('stco', or 'co64' for large files). Other tracks and boxes are
+// copied as they are, so the output stays a regular QuickTime file.
+//
+// Output layout: the other top-level boxes (e.g. 'ftyp', 'uuid') in their
+// original order, 'mdat', then 'moov'.
+
+#include <stdint.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "mp4defs.h"
+#include "mp4demux.h"
+#include "File.h"
+
+using namespace KlakHap;
+
+namespace
+{
+    const uint64_t kAlignment = 4096;
+
+    #pragma region Big-endian utilities
+
+    uint32_t ReadBE32(const uint8_t* p)
+    {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+               (uint32_t(p[2]) << 8) | p[3];
+    }
+
+    uint64_t ReadBE64(const uint8_t* p)
+    {
+        return (uint64_t(ReadBE32(p)) << 32) | ReadBE32(p + 4);
+    }
+
+    void WriteBE32(std::vector<uint8_t>& out, uint32_t x)
+    {
+        out.push_back(uint8_t(x >> 24));
+        out.push_back(uint8_t(x >> 16));
+        out.push_back(uint8_t(x >> 8));
+        out.push_back(uint8_t(x));
+    }
+
+    void WriteBE64(std::vector<uint8_t>& out, uint64_t x)
+    {
+        WriteBE32(out, uint32_t(x >> 32));
+        WriteBE32(out, uint32_t(x));
+    }
+
+    void AppendBox(std::vector<uint8_t>& out, uint32_t type, const std::vector<uint8_t>& payload)
+    {
+        WriteBE32(out, static_cast<uint32_t>(payload.size() + 8));
+        WriteBE32(out, type);
+        out.insert(out.end(), payload.begin(), payload.end());
+    }
+
+    #pragma endregion
+
+    #pragma region Box parsing
+
+    struct Box
+    {
+        uint64_t offset;  // Box start
+        uint64_t header;  // Header size
+        uint64_t size;    // Box size including the header
+        uint32_t type;
+    };
+
+    // Parse a box header. "head" points to the header bytes (up to 16 bytes
+    // available), and "limit" is the end of the parent box.
+    bool ParseHeader(const uint8_t* head, size_t available,
+                     uint64_t offset, uint64_t limit, Box& box)
+    {
+        if (available < 8) return false;
+        box.offset = offset;
+        box.header = 8;
+        box.size = ReadBE32(head);
+        box.type = ReadBE32(head + 4);
+        if (box.size == 1)
+        {
+            if (available < 16) return false;
+            box.size = ReadBE64(head + 8);
+            box.header = 16;
+        }
+        else if (box.size == 0)
+        {
+            box.size = limit - offset; // 'till the end' box
+        }
+        return box.size >= box.header && offset + box.size <= limit;
+    }
+
+    // Parse a box in memory.
+    bool ParseBox(const uint8_t* data, uint64_t offset, uint64_t limit, Box& box)
+    {
+        auto available = static_cast<size_t>(std::min(uint64_t(16), limit - offset));
+        return ParseHeader(data + offset, available, offset, limit, box);
+    }
+
+    // List the top-level boxes in a file.
+    bool ListBoxes(FILE* file, std::vector<Box>& boxes)
+    {
+        auto fileSize = GetFileSize(file);
+        for (uint64_t pos = 0; pos < fileSize;)
+        {
+            uint8_t head[16];
+            auto available = static_cast<size_t>(std::min(uint64_t(16), fileSize - pos));
+            if (!SeekFile(file, pos) || fread(head, 1, available, file) != available) return false;
+
+            Box box;
+            if (!ParseHeader(head, available, pos, fileSize, box)) return false;
+            boxes.push_back(box);
+            pos += box.size;
+        }
+        return true;
+    }
+
+    bool IsHapEntry(unsigned type)
+    {
+        return type == BOX_Hap1 || type == BOX_Hap5 || type == BOX_HapY ||
+               type == BOX_HapM || type == BOX_HapA;
+    }
+
+    #pragma endregion
+
+    #pragma region Re-muxer
+
+    class Remuxer
+    {
+    public:
+
+        Remuxer(FILE* input, FILE* output)
+          : input_(input), output_(output) {}
+
+        bool Run()
+        {
+            if (!ListBoxes(input_, boxes_)) return Error("Broken box structure");
+            if (!LoadMovie()) return false;
+            if (!BuildUnits()) return false;
+            if (!WriteLeadingBoxes()) return Error("Write error");
+            if (!WriteMediaData()) return Error("Write error");
+            if (!WriteMovie()) return false;
+            return true;
+        }
+
+        int GetFrameCount() const { return frameCount_; }
+
+    private:
+
+        // A range of bytes moved from the input to the output: A Hap frame,
+        // or a whole chunk of the other tracks.
+        struct Unit
+        {
+            uint64_t source;
+            uint64_t size;
+            uint64_t dest;
+            bool align;
+        };
+
+        FILE* input_;
+        FILE* output_;
+        std::vector<Box> boxes_;
+        std::vector<uint8_t> moov_;
+        uint64_t written_ = 0;
+        int hapTrack_ = -1;
+        int frameCount_ = 0;
+
+        std::vector<Unit> units_;
+        std::vector<std::vector<size_t>> trackUnits_; // [track][chunk] -> unit
+
+        static bool Error(const char* message)
+        {
+            std::fprintf(stderr, "%s\n", message);
+            return false;
+        }
+
+        #pragma region Input analysis
+
+        bool LoadMovie()
+        {
+            auto moov = std::find_if(boxes_.begin(), boxes_.end(),
+                [](const Box& b) { return b.type == BOX_moov; });
+            if (moov == boxes_.end()) return Error("No moov box found");
+
+            moov_.resize(static_cast<size_t>(moov->size));
+            if (!SeekFile(input_, moov->offset) ||
+                fread(moov_.data(), 1, moov_.size(), input_) != moov_.size())
+                return Error("Read error");
+
+            return true;
+        }
+
+        // End of the top-level box that contains the given offset
+        uint64_t GetContainerEnd(uint64_t offset) const
+        {
+            for (const auto& box : boxes_)
+                if (offset >= box.offset && offset < box.offset + box.size)
+                    return box.offset + box.size;
+            return offset;
+        }
+
+        bool BuildUnits()
+        {
+            MP4D_demux_t demux;
+            std::memset(&demux, 0, sizeof(demux));
+            if (MP4D__open(&demux, input_) == 0) return Error("Can't parse the movie");
+
+            trackUnits_.resize(demux.track_count);
+
+            for (auto t = 0u; t < demux.track_count; t++)
+            {
+                const auto& track = demux.track[t];
+
+                auto isHap = hapTrack_ < 0 && track.sample_count > 0 &&
+                             track.handler_type == MP4_HANDLER_TYPE_VIDE &&
+                             IsHapEntry(track.sample_entry_type);
+                if (isHap) hapTrack_ = static_cast<int>(t);
+
+                // Samples in the chunks (the same walk as Demuxer does)
+                auto group = 0u;
+                auto sample = 0u;
+                for (auto chunk = 0u; chunk < track.chunk_count; chunk++)
+                {
+                    if (group + 1 < track.sample_to_chunk_count &&
+                        chunk + 1 == track.sample_to_chunk[group + 1].first_chunk) group++;
+
+                    uint64_t offset = track.chunk_offset[chunk];
+
+                    if (!isHap)
+                    {
+                        // The chunk size is determined later from the layout.
+                        Unit unit = { offset, 0, 0, false };
+                        trackUnits_[t].push_back(units_.size());
+                        units_.push_back(unit);
+                        continue;
+                    }
+
+                    auto count = track.chunk_count == 1 || track.sample_to_chunk_count == 0 ?
+                        track.sample_count : track.sample_to_chunk[group].samples_per_chunk;
+
+                    for (auto i = 0u; i < count && sample < track.sample_count; i++)
+                    {
+                        Unit unit = { offset, track.entry_size[sample], 0, true };
+                        trackUnits_[t].push_back(units_.size());
+                        units_.push_back(unit);
+                        offset += track.entry_size[sample++];
+                    }
+                }
+
+                if (isHap) frameCount_ = static_cast<int>(sample);
+            }
+
+            MP4D__close(&demux);
+
+            if (hapTrack_ < 0 || frameCount_ == 0) return Error("No Hap video track found");
+
+            // The size of a non-Hap chunk spans until the next unit (or the
+            // end of the container box). Note that the sample sizes can't be
+            // used for that, as they don't represent byte counts with some
+            // QuickTime audio formats.
+            std::vector<uint64_t> starts;
+            for (const auto& unit : units_) starts.push_back(unit.source);
+            std::sort(starts.begin(), starts.end());
+
+            for (auto& unit : units_)
+            {
+                if (unit.align) continue;
+                auto next = std::upper_bound(starts.begin(), starts.end(), unit.source);
+                auto end = GetContainerEnd(unit.source);
+                if (next != starts.end()) end = std::min(end, *next);
+                unit.size = end - unit.source;
+            }
+
+            return true;
+        }
+
+        #pragma endregion
+
+        #pragma region Output
+
+        bool Pad(uint64_t bytes)
+        {
+            static const uint8_t zero[kAlignment] = {};
+            while (bytes > 0)
+            {
+                auto n = static_cast<size_t>(std::min(bytes, kAlignment));
+                if (fwrite(zero, 1, n, output_) != n) return false;
+                bytes -= n;
+            }
+            return true;
+        }
+
+        bool Copy(uint64_t offset, uint64_t size)
+        {
+            std::vector<uint8_t> buffer(static_cast<size_t>(std::min(size, uint64_t(1) << 20)));
+            if (!SeekFile(input_, offset)) return false;
+            while (size > 0)
+            {
+                auto n = static_cast<size_t>(std::min(size, uint64_t(buffer.size())));
+                if (fread(buffer.data(), 1, n, input_) != n) return false;
+                if (fwrite(buffer.data(), 1, n, output_) != n) return false;
+                size -= n;
+            }
+            return true;
+        }
+
+        // Copy the top-level boxes other than the media data and the movie
+        // (e.g. 'ftyp'). The ones after the media data are moved before it.
+        bool WriteLeadingBoxes()
+        {
+            for (const auto& box : boxes_)
+            {
+                if (box.type == BOX_mdat || box.type == BOX_moov || box.type == BOX_free ||
+                    box.type == BOX_skip || box.type == FOUR_CHAR_INT('w', 'i', 'd', 'e')) continue;
+                if (!Copy(box.offset, box.size)) return false;
+                written_ += box.size;
+            }
+            return true;
+        }
+
+        bool WriteMediaData()
+        {
+            // 64-bit size header, patched after writing the payload.
+            std::vector<uint8_t> header;
+            WriteBE32(header, 1);
+            WriteBE32(header, BOX_mdat);
+            WriteBE64(header, 0);
+
+            auto start = written_;
+            if (fwrite(header.data(), 1, header.size(), output_) != header.size()) return false;
+
+            // Units in the original order, so that interleaving is kept.
+            std::vector<size_t> order(units_.size());
+            for (auto i = 0u; i < order.size(); i++) order[i] = i;
+            std::stable_sort(order.begin(), order.end(),
+                [this](size_t a, size_t b) { return units_[a].source < units_[b].source; });
+
+            auto pos = start + header.size();
+            for (auto i : order)
+            {
+                auto& unit = units_[i];
+                if (unit.align)
+                {
+                    auto aligned = (pos + kAlignment - 1) / kAlignment * kAlignment;
+                    if (!Pad(aligned - pos)) return false;
+                    pos = aligned;
+                }
+                if (!Copy(unit.source, unit.size)) return false;
+                unit.dest = pos;
+                pos += unit.size;
+            }
+
+            header.clear();
+            WriteBE64(header, pos - start);
+            written_ = pos;
+            return SeekFile(output_, start + 8) &&
+                   fwrite(header.data(), 1, 8, output_) == 8 &&
+                   SeekFile(output_, pos);
+        }
+
+        bool WriteMovie()
+        {
+            auto track = -1;
+            std::vector<uint8_t> out;
+            if (!RewriteChildren(moov_.data(), 0, moov_.size(), BOX_moov, track, out))
+                return Error("Broken moov box");
+            return fwrite(out.data(), 1, out.size(), output_) == out.size() || Error("Write error");
+        }
+
+        #pragma endregion
+
+        #pragma region Movie box rewriting
+
+        // Rewrite the boxes in the given range and append them to out.
+        bool RewriteChildren(const uint8_t* data, uint64_t begin, uint64_t end,
+                             uint32_t parent, int& track, std::vector<uint8_t>& out)
+        {
+            for (auto pos = begin; pos < end;)
+            {
+                Box box;
+                if (!ParseBox(data, pos, end, box)) return false;
+                pos += box.size;
+
+                const auto payload = data + box.offset + box.header;
+                const auto payloadSize = box.size - box.header;
+
+                if (box.type == BOX_moov || box.type == BOX_trak || box.type == BOX_mdia ||
+                    box.type == BOX_minf || box.type == BOX_stbl)
+                {
+                    if (box.type == BOX_trak) track++;
+                    std::vector<uint8_t> children;
+                    if (!RewriteChildren(data, box.offset + box.header, box.offset + box.size,
+                                         box.type, track, children)) return false;
+                    AppendBox(out, box.type, children);
+                }
+                else if (parent == BOX_stbl && (box.type == BOX_stco || box.type == BOX_co64))
+                {
+                    if (track < 0 || track >= static_cast<int>(trackUnits_.size())) return false;
+                    AppendChunkOffsets(out, trackUnits_[track]);
+                }
+                else if (parent == BOX_stbl && box.type == BOX_stsc && track == hapTrack_)
+                {
+                    // One sample per chunk with the original description index
+                    auto sdi = payloadSize >= 20 && ReadBE32(payload + 4) > 0 ?
+                        ReadBE32(payload + 16) : 1u;
+                    std::vector<uint8_t> table;
+                    WriteBE32(table, 0); // version/flags
+                    WriteBE32(table, 1); // entry count
+                    WriteBE32(table, 1); // first chunk
+                    WriteBE32(table, 1); // samples per chunk
+                    WriteBE32(table, sdi);
+                    AppendBox(out, BOX_stsc, table);
+                }
+                else
+                {
+                    out.insert(out.end(), data + box.offset, data + box.offset + box.size);
+                }
+            }
+            return true;
+        }
+
+        void AppendChunkOffsets(std::vector<uint8_t>& out, const std::vector<size_t>& units)
+        {
+            auto large = false;
+            for (auto i : units) large |= units_[i].dest > 0xffffffffull;
+
+            std::vector<uint8_t> table;
+            WriteBE32(table, 0); // version/flags
+            WriteBE32(table, static_cast<uint32_t>(units.size()));
+            for (auto i : units)
+            {
+                if (large)
+                    WriteBE64(table, units_[i].dest);
+                else
+                    WriteBE32(table, static_cast<uint32_t>(units_[i].dest));
+            }
+            AppendBox(out, large ? BOX_co64 : BOX_stco, table);
+        }
+
+        #pragma endregion
+    };
+
+    #pragma endregion
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        std::fprintf(stderr, "Usage: %s <input.mov> <output.mov>\n", argv[0]);
+        return 1;
+    }
+
+    auto input = OpenFile(argv[1], "rb");
+    if (input == nullptr)
+    {
+        std::fprintf(stderr, "Can't open %s\n", argv[1]);
+        return 1;
+    }
+
+    auto output = OpenFile(argv[2], "wb");
+    if (output == nullptr)
+    {
+        std::fprintf(stderr, "Can't open %s\n", argv[2]);
+        fclose(input);
+        return 1;
+    }
+
+    Remuxer remuxer(input, output);
+    auto ok = remuxer.Run();
+
+    fclose(input);
+    ok = fclose(output) == 0 && ok;
+
+    if (!ok)
+    {
+        std::remove(argv[2]);
+        return 1;
+    }
+
+    std::printf("%s: %d frames aligned\n", argv[2], remuxer.GetFrameCount());
+    return 0;
+}
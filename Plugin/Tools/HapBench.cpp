@@ -0,0 +1,238 @@
+// HapBench - Benchmarks the Snappy decompression kernels on a Hap movie file
+//
+// Usage: HapBench <input.mov> [passes]
+//
+// All the video frames are loaded into memory, then decoded on a single
+// thread with each decompression kernel supported by the CPU, and in the
+// trusted mode (HapDecodeTrusted) with the reference and default kernels.
+// The output of every run is compared with the one of the reference
+// (tag-by-tag) loop, so this also serves as a bit-exactness test for the
+// SIMD kernels and the trusted mode.
+//
+// Then the decoded frames are re-encoded with each second-stage compressor
+// available in the build (Snappy, plus LZ4 and Zstandard when built with
+// HAP_ENABLE_LZ4/HAP_ENABLE_ZSTD) to compare their ratio and decoding speed
+// on the same content.
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "Demuxer.h"
+#include "hap.h"
+#include "snappy-internal.h"
+
+using namespace KlakHap;
+
+namespace
+{
+    namespace si = snappy::internal;
+
+    const char* kKernelNames[] = { "reference", "scalar", "ssse3", "avx2", "neon" };
+    const char* kCompressorNames[] = { "none", "snappy", "lz4", "zstd" };
+
+    // Chunk count used for the re-encoded frames
+    const unsigned int kChunkCount = 8;
+
+    void SerialCallback(HapDecodeWorkFunction work, void* p, unsigned int count, void*)
+    {
+        for (auto i = 0u; i < count; i++) work(p, i);
+    }
+
+    // Decodes all the frames into the output buffer, one frame after
+    // another, and counts the decoded bytes. Returns false on a decode error.
+    bool DecodeAll(const std::vector<ReadBuffer>& frames, std::vector<uint8_t>& output,
+                   size_t frameSize, bool trusted, size_t* total = nullptr)
+    {
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            unsigned long used;
+            unsigned int format;
+            auto data = frames[i].GetData();
+            auto size = static_cast<unsigned long>(frames[i].GetSize());
+            auto dest = output.data() + frameSize * i;
+            auto result = trusted ?
+                HapDecodeTrusted(data, size, 0, SerialCallback, nullptr,
+                                 dest, static_cast<unsigned long>(frameSize),
+                                 0, 0, &used, &format) :
+                HapDecode(data, size, 0, SerialCallback, nullptr,
+                          dest, static_cast<unsigned long>(frameSize),
+                          &used, &format);
+            if (result != HapResult_No_Error) return false;
+            if (total) *total += used;
+        }
+        return true;
+    }
+
+    // Re-encodes the decoded frames (frameBytes bytes each) with the given
+    // second-stage compressor. Returns false when the compressor isn't
+    // available in this build.
+    bool EncodeAll(const std::vector<uint8_t>& decoded, size_t frameSize, size_t frameBytes,
+                   unsigned int format, unsigned int compressor,
+                   std::vector<ReadBuffer>& output, size_t& total)
+    {
+        output.resize(decoded.size() / frameSize);
+        total = 0;
+        for (size_t i = 0; i < output.size(); i++)
+        {
+            const void* input = decoded.data() + frameSize * i;
+            auto bytes = static_cast<unsigned long>(frameBytes);
+            auto chunks = kChunkCount;
+            auto& storage = output[i].storage;
+            storage.resize(HapMaxEncodedLength(1, &bytes, &format, &chunks));
+            unsigned long used;
+            auto result = HapEncode(1, &input, &bytes, &format, &compressor, &chunks,
+                                    storage.data(), static_cast<unsigned long>(storage.size()), &used);
+            if (result != HapResult_No_Error) return false;
+            storage.resize(used);
+            total += used;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2 && argc != 3)
+    {
+        std::fprintf(stderr, "Usage: %s <input.mov> [passes]\n", argv[0]);
+        return 1;
+    }
+
+    auto passes = argc == 3 ? std::max(1, std::atoi(argv[2])) : 10;
+
+    Demuxer demuxer(argv[1]);
+    if (!demuxer.IsValid())
+    {
+        std::fprintf(stderr, "Can't open %s\n", argv[1]);
+        return 1;
+    }
+
+    // Compressed frames
+    std::vector<ReadBuffer> frames(demuxer.GetFrameCount());
+    size_t compressed = 0;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        demuxer.ReadFrame(static_cast<int>(i), frames[i]);
+        compressed += frames[i].GetSize();
+    }
+
+    // Large enough for any of the supported texture formats
+    auto frameSize = static_cast<size_t>((demuxer.GetWidth() + 3) / 4) *
+                     ((demuxer.GetHeight() + 3) / 4) * 16;
+
+    auto initial = si::GetDecompressionKernel();
+    si::SetDecompressionKernel(si::kDecompressReference);
+
+    std::vector<uint8_t> expected(frameSize * frames.size());
+    size_t decompressed = 0;
+    if (!DecodeAll(frames, expected, frameSize, false, &decompressed))
+    {
+        std::fprintf(stderr, "Can't decode %s\n", argv[1]);
+        return 1;
+    }
+
+    std::printf("%s: %d frames (%dx%d), %.1f MB compressed, %d passes\n",
+                argv[1], demuxer.GetFrameCount(), demuxer.GetWidth(),
+                demuxer.GetHeight(), compressed / 1e6, passes);
+
+    // The runs are timed in turns, so that they see the same system load.
+    struct Run { si::DecompressionKernel kernel; bool trusted; std::string name; };
+    std::vector<Run> runs;
+    for (int k = si::kDecompressReference; k <= si::kDecompressNEON; k++)
+    {
+        auto kernel = static_cast<si::DecompressionKernel>(k);
+        if (!si::SetDecompressionKernel(kernel)) continue;
+        std::string name = kKernelNames[k];
+        if (kernel == initial) name += " (default)";
+        runs.push_back({ kernel, false, name });
+    }
+    runs.push_back({ si::kDecompressReference, true, "reference (trusted)" });
+    if (initial != si::kDecompressReference)
+        runs.push_back({ initial, true, std::string(kKernelNames[initial]) + " (trusted)" });
+
+    std::vector<double> best(runs.size(), 1e30);
+    std::vector<bool> ok(runs.size(), true);
+    std::vector<uint8_t> output(expected.size());
+
+    for (auto pass = 0; pass < passes; pass++)
+    {
+        for (size_t i = 0; i < runs.size(); i++)
+        {
+            si::SetDecompressionKernel(runs[i].kernel);
+            std::fill(output.begin(), output.end(), 0);
+
+            auto start = std::chrono::steady_clock::now();
+            auto decoded = DecodeAll(frames, output, frameSize, runs[i].trusted);
+            auto end = std::chrono::steady_clock::now();
+
+            best[i] = std::min(best[i], std::chrono::duration<double>(end - start).count());
+            ok[i] = ok[i] && decoded && output == expected;
+        }
+    }
+
+    si::SetDecompressionKernel(initial);
+
+    auto failed = false;
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        std::printf("%-20s %8.3f ms/frame %8.0f MB/s (output) %6.2fx %s\n",
+                    runs[i].name.c_str(), best[i] * 1e3 / frames.size(),
+                    decompressed / best[i] / 1e6, best[0] / best[i],
+                    ok[i] ? "ok" : "MISMATCH");
+        failed |= !ok[i];
+    }
+
+    // Second-stage compressors (only for single-texture frames)
+    unsigned int textures = 0, format = 0;
+    auto frame0 = frames[0].GetData();
+    auto frame0Size = static_cast<unsigned long>(frames[0].GetSize());
+    if (HapGetFrameTextureCount(frame0, frame0Size, &textures) != HapResult_No_Error || textures != 1 ||
+        HapGetFrameTextureFormat(frame0, frame0Size, 0, &format) != HapResult_No_Error)
+        return failed ? 1 : 0;
+
+    std::printf("\nSecond-stage compressors (re-encoded in %u chunks, %s kernel)\n",
+                kChunkCount, kKernelNames[initial]);
+
+    auto frameBytes = decompressed / frames.size();
+    auto snappyTime = 0.0;
+
+    for (auto compressor : { HapCompressorSnappy, HapCompressorLZ4, HapCompressorZstd })
+    {
+        std::vector<ReadBuffer> encoded;
+        size_t total;
+        if (!EncodeAll(expected, frameSize, frameBytes, format, compressor, encoded, total))
+        {
+            std::printf("%-20s not available in this build\n", kCompressorNames[compressor]);
+            continue;
+        }
+
+        auto time = 1e30;
+        auto valid = true;
+        for (auto pass = 0; pass < passes; pass++)
+        {
+            std::fill(output.begin(), output.end(), 0);
+
+            auto start = std::chrono::steady_clock::now();
+            auto decoded = DecodeAll(encoded, output, frameSize, false);
+            auto end = std::chrono::steady_clock::now();
+
+            time = std::min(time, std::chrono::duration<double>(end - start).count());
+            valid = valid && decoded && output == expected;
+        }
+
+        if (compressor == HapCompressorSnappy) snappyTime = time;
+
+        std::printf("%-20s %8.3f ms/frame %8.0f MB/s (output) %6.2fx %5.1f%% size %s\n",
+                    kCompressorNames[compressor], time * 1e3 / frames.size(),
+                    decompressed / time / 1e6, snappyTime / time,
+                    100.0 * total / decompressed, valid ? "ok" : "MISMATCH");
+        failed |= !valid;
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,37 @@
+// HapStore - Converts a Hap movie file into the Hap frame store format
+//
+// Usage: HapStore <input.mov> <output.hapstore>
+//
+// The frame payloads are copied as they are (lossless re-muxing). Audio and
+// other non-Hap tracks are dropped.
+
+#include <cstdio>
+#include "Demuxer.h"
+#include "FrameStore.h"
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        std::fprintf(stderr, "Usage: %s <input.mov> <output.hapstore>\n", argv[0]);
+        return 1;
+    }
+
+    KlakHap::Demuxer demuxer(argv[1]);
+    if (!demuxer.IsValid())
+    {
+        std::fprintf(stderr, "Can't open %s\n", argv[1]);
+        return 1;
+    }
+
+    if (!KlakHap::FrameStore::Write(argv[2], demuxer.GetIndex(), demuxer))
+    {
+        std::fprintf(stderr, "Can't write %s\n", argv[2]);
+        return 1;
+    }
+
+    std::printf("%s: %d frames (%dx%d, %.3f sec)\n", argv[2],
+                demuxer.GetFrameCount(), demuxer.GetWidth(),
+                demuxer.GetHeight(), demuxer.GetDuration());
+    return 0;
+}
@@ -0,0 +1,28 @@
+SOURCES="\
+    ../Hap/hap.c \
+    ../MP4/mp4demux.c \
+    ../Snappy/snappy-c.cc \
+    ../Snappy/snappy-sinksource.cc \
+    ../Snappy/snappy-stubs-internal.cc \
+    ../Snappy/snappy.cc"
+
+# Optional second-stage compressors (non-standard Hap extension), enabled with
+# HAP_LZ4=1 and/or HAP_ZSTD=1 in the environment. They need liblz4/libzstd.
+EXT_FLAGS=""
+EXT_LIBS=""
+if [ -n "$HAP_LZ4" ]; then EXT_FLAGS="$EXT_FLAGS -DHAP_ENABLE_LZ4=1"; EXT_LIBS="$EXT_LIBS -llz4"; fi
+if [ -n "$HAP_ZSTD" ]; then EXT_FLAGS="$EXT_FLAGS -DHAP_ENABLE_ZSTD=1"; EXT_LIBS="$EXT_LIBS -lzstd"; fi
+
+for TOOL in HapStore HapAlign HapBench
+do
+    gcc -Wall -Wno-switch -Wno-unknown-pragmas -Wno-unused-result \
+        -O2 $EXT_FLAGS \
+        -I../Hap \
+        -I../MP4 \
+        -I../Snappy \
+        -I../Source \
+        $SOURCES \
+        $TOOL.cpp \
+        -lstdc++ -lpthread $EXT_LIBS \
+        -o $TOOL
+done